@@ -0,0 +1,62 @@
+// Commit latency per durability mode: every mutation runs with synchronous
+// persistence, so its latency is the cost of one snapshot + log commit.
+// Usage: bin/persist_bench [ops] [dir]
+#define _POSIX_C_SOURCE 200809L
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include "../include/disk.h"
+#include "../include/utils.h"
+
+static double now_us() {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (double)ts.tv_sec * 1e6 + (double)ts.tv_nsec / 1e3;
+}
+
+static int cmp_double(const void* a, const void* b) {
+    double x = *(const double*)a, y = *(const double*)b;
+    return (x > y) - (x < y);
+}
+
+int main(int argc, char** argv) {
+    int ops = argc > 1 ? atoi(argv[1]) : 200;
+    const char* dir = argc > 2 ? argv[2] : ".";
+    if (ops <= 0) ops = 200;
+    double* lat = (double*)malloc(sizeof(double) * (size_t)ops);
+    if (!lat) return 1;
+
+    char path[DISK_PERSIST_PATH_LEN];
+    snprintf(path, sizeof(path), "%s/persist_bench.json", dir);
+    printf("%-10s %8s %10s %10s %10s %10s\n", "mode", "ops", "mean_us", "p50_us", "p99_us", "max_us");
+
+    for (int d = DURABILITY_NONE; d <= DURABILITY_FSYNC; d++) {
+        disk_init_ex(path, (Durability)d);
+        disk_reset();
+        int fid = 0;
+        for (int i = 0; i < ops; i++) {
+            // alternate allocate/delete so the disk never fills up
+            double t0 = now_us();
+            if (i % 2 == 0) disk_allocate_contiguous(4, &fid);
+            else disk_logical_delete(fid);
+            lat[i] = now_us() - t0;
+        }
+        double sum = 0;
+        for (int i = 0; i < ops; i++) sum += lat[i];
+        qsort(lat, (size_t)ops, sizeof(double), cmp_double);
+        printf("%-10s %8d %10.1f %10.1f %10.1f %10.1f\n", durability_name((Durability)d), ops,
+               sum / ops, lat[ops / 2], lat[(size_t)(ops * 0.99)], lat[ops - 1]);
+    }
+
+    disk_shutdown();
+    // the snapshot and everything persist.c keeps beside it
+    static const char* SUFFIXES[] = { "", ".log", ".delta", ".corrupt" };
+    char side[DISK_PERSIST_PATH_LEN + 16];
+    for (size_t i = 0; i < sizeof(SUFFIXES) / sizeof(SUFFIXES[0]); i++) {
+        snprintf(side, sizeof(side), "%s%s", path, SUFFIXES[i]);
+        remove(side);
+    }
+    free(lat);
+    return 0;
+}
@@ -0,0 +1,63 @@
+#ifndef AIO_H
+#define AIO_H
+
+#include <stddef.h>
+#include <sys/types.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+// Asynchronous pread/pwrite/fsync queue. On Linux it drives an io_uring
+// directly through the raw syscalls; where io_uring is missing or refused
+// (old kernels, seccomp) a small thread pool runs the same requests.
+typedef enum {
+    AIO_AUTO = 0,                  // io_uring if it can be set up, else threads
+    AIO_IO_URING,
+    AIO_THREADS
+} AioBackend;
+
+// Replaces pread for reads on the thread backend (fault injection)
+typedef ssize_t (*AioReadFn)(void* ctx, int fd, void* buf, size_t len, off_t off);
+
+typedef struct {
+    void* tag;                     // as passed when queued
+    long long res;                 // bytes transferred, or -errno
+} AioCompletion;
+
+typedef struct AioQueue AioQueue;
+
+// depth caps the requests in flight. A read_fn forces the thread backend.
+// Returns NULL if the requested backend is unavailable.
+AioQueue* aio_open(unsigned depth, AioBackend backend, AioReadFn read_fn, void* read_ctx);
+void aio_close(AioQueue* q);       // waits for requests in flight
+// Waits at most timeout_ms (< 0 = no limit) for requests in flight. If some
+// never complete it returns -1 and leaves the queue allocated on purpose, so
+// they still have somewhere to land; their buffers must stay allocated too.
+int aio_close_timeout(AioQueue* q, int timeout_ms);
+AioBackend aio_backend(const AioQueue* q);
+const char* aio_backend_name(AioBackend backend);
+int aio_backend_from_name(const char* name); // -1 if unknown
+
+// Queue one request; -1 when depth requests are already in flight.
+// io_uring requests reach the kernel at the next aio_wait(); the thread
+// pool starts them straight away.
+int aio_read(AioQueue* q, int fd, void* buf, size_t len, long long off, void* tag);
+int aio_write(AioQueue* q, int fd, const void* buf, size_t len, long long off, void* tag);
+int aio_fsync(AioQueue* q, int fd, int datasync, void* tag);
+
+// Submits everything queued, then waits for at least min completions
+// (0 = only reap what is done) and stores up to max of them.
+// Returns the number stored, or -1 on error.
+int aio_wait(AioQueue* q, AioCompletion* out, int max, int min);
+// Same, but gives up once timeout_ms has passed (< 0 = no limit) and returns
+// what completed by then, possibly fewer than min. Nothing is cancelled: a
+// request still running keeps its buffer until its completion is reaped.
+int aio_wait_timeout(AioQueue* q, AioCompletion* out, int max, int min, int timeout_ms);
+int aio_inflight(const AioQueue* q);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif // AIO_H
@@ -0,0 +1,118 @@
+// Disk Management Simulator - backing image for the simulated blocks (C99)
+
+#ifndef BACKING_H
+#define BACKING_H
+
+#include <stddef.h>
+#include "disk.h"
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+#define BACKING_DEFAULT_BLOCK_SIZE 4096
+#define BACKING_MIN_BLOCK_SIZE 512
+#define BACKING_MAX_BLOCK_SIZE (1024 * 1024)
+#define BACKING_MAX_IO (1024 * 1024)   // bytes per pread/pwrite/copy call
+#define BACKING_MAGIC 0x4b424456u      // "VDBK"
+#define BACKING_SCRUB_DEFAULT_KBPS 1024
+
+// Written at the start of every block the simulator hands to a file; the
+// rest of the block is filled with a pattern derived from the same fields
+typedef struct {
+    unsigned int magic;
+    int file_id;
+    int ordinal;                   // position of the block within its file
+    unsigned int deleted;          // set by delete, cleared by undelete
+} BackingHeader;
+
+// Real I/O done on behalf of one kind of operation
+typedef struct {
+    unsigned long long calls;      // operations that touched the image
+    unsigned long long io_calls;   // pread/pwrite/copy syscalls issued
+    unsigned long long bytes_read;
+    unsigned long long bytes_written;
+    unsigned long long bytes_copied; // moved in-kernel by copy_file_range
+    unsigned long long errors;
+    double seconds;                // wall time, including the sync
+} BackingOpStats;
+
+typedef struct {
+    int running;
+    double bytes_per_sec;
+    unsigned long long passes;     // full sweeps over the checksummed blocks
+    unsigned long long blocks_verified;
+    unsigned long long mismatches; // checksum differed or the read failed
+    long long last_pass_ms;        // wall clock when the last sweep ended, 0 = none
+} BackingScrubStats;
+
+typedef struct {
+    int attached;
+    char path[DISK_PERSIST_PATH_LEN];
+    size_t block_size;
+    int blocks;
+    int sync;                      // fdatasync after every operation
+    int copy_offload;              // copy_file_range is being used for moves
+    int checksummed;               // blocks whose data has a CRC-32C on file
+    const char* checksum_impl;     // see compress_crc32c_impl()
+    BackingOpStats ops[DISK_OP_COUNT];
+    BackingScrubStats scrub;
+} BackingInfo;
+
+// Every block written with file data gets a CRC-32C of its contents in a
+// side table kept in memory; moves carry it along, delete suspends it and
+// undelete resumes it. The scrubber re-reads checksummed blocks and queues
+// the ones that no longer match for the disk to mark bad.
+
+// Creates the image at path, sized to blocks * block_size, or reuses one that
+// is a regular file of exactly that size whose first block header carries
+// BACKING_MAGIC or is all zeros. Returns -1 for a bad block size, -2 if the
+// file cannot be opened or sized, -3 if path holds something else.
+int backing_open(const char* path, size_t block_size, int blocks, int sync);
+void backing_close();
+int backing_attached();
+void backing_info(BackingInfo* out);
+void backing_reset_stats();
+
+// Operations are bracketed by begin/end; I/O in between is charged to op.
+// All of these are no-ops while no image is attached, and return -1 if
+// some of their I/O failed (the simulator's metadata stays authoritative).
+void backing_begin(DiskOp op);
+void backing_end();
+
+// Fills the given blocks with data for file_id, ordinals first_ordinal..;
+// adjacent block numbers are written with one call
+int backing_write(const int* blocks, int n, int file_id, int first_ordinal);
+// Rewrites just the headers to flag the blocks deleted (or live again)
+int backing_mark_deleted(const int* blocks, int n, int deleted);
+// Undelete in place: reads each header back and revives the block if it
+// still holds file_id's data, otherwise rewrites it. Returns the number
+// found intact, or -1 on I/O error.
+int backing_restore(const int* blocks, int n, int file_id);
+// Copies count blocks from block `from` to block `to` (to < from), with
+// copy_file_range where the kernel offers it and pread/pwrite otherwise
+int backing_move(int from, int to, int count);
+
+int backing_read_header(int block, BackingHeader* out); // -1 if unreadable
+void backing_forget();             // drop every checksum (the disk was reset)
+
+// Background scrub at bytes_per_sec, one block at a time, sweeping again
+// after each pass. backing_scrub_pass() is one synchronous sweep and
+// returns the mismatches it found.
+int backing_scrub_start(double bytes_per_sec); // -1 without an image or threads
+void backing_scrub_stop();
+int backing_scrub_pass(double bytes_per_sec);
+// Verifies just the given blocks now; returns the mismatches it queued
+int backing_verify(const int* blocks, int n);
+// Hands over the blocks found bad since the last call; each is reported once
+int backing_take_mismatches(int* blocks, int cap);
+
+// Fault injection: overwrites part of a checksummed block behind the
+// checksum's back. -1 if the block holds no checksummed data.
+int backing_corrupt(int block);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif // BACKING_H
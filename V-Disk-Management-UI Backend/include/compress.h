@@ -0,0 +1,49 @@
+#ifndef COMPRESS_H
+#define COMPRESS_H
+
+#include <stddef.h>
+#include "utils.h"
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+// Output container around the raw DEFLATE stream
+typedef enum {
+    COMPRESS_GZIP = 0, // RFC 1952, Content-Encoding: gzip
+    COMPRESS_ZLIB = 1  // RFC 1950, Content-Encoding: deflate
+} CompressFormat;
+
+#define COMPRESS_LEVEL_MIN 1
+#define COMPRESS_LEVEL_MAX 9
+#define COMPRESS_LEVEL_DEFAULT 6
+
+// DEFLATE encoder (LZ77 + fixed Huffman codes). Input is fed in pieces
+// with deflater_write() and encoded by deflater_finish(); all buffers are
+// kept between streams, so a long-lived Deflater does not allocate once
+// it has reached its high-water mark.
+typedef struct {
+    int level;      // 1 (fastest) .. 9 (smallest)
+    int* head;      // hash chain heads
+    int* prev;      // hash chain links, indexed by position in the window
+    StrBuf in;      // input of the current stream
+} Deflater;
+
+int deflater_init(Deflater* d, int level);
+void deflater_free(Deflater* d);
+void deflater_begin(Deflater* d);
+int deflater_write(Deflater* d, const void* data, size_t len);
+int deflater_finish(Deflater* d, CompressFormat fmt, StrBuf* out); // appends to out
+
+// Checksums used by the containers
+unsigned long compress_crc32(unsigned long crc, const void* data, size_t len);
+unsigned long compress_adler32(unsigned long adler, const void* data, size_t len);
+// CRC-32C for block checksums; hardware-accelerated where the CPU has it
+unsigned long compress_crc32c(unsigned long crc, const void* data, size_t len);
+const char* compress_crc32c_impl(); // "sse4.2", "armv8-crc" or "software"
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif // COMPRESS_H
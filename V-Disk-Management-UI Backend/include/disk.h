@@ -4,6 +4,7 @@
 #define DISK_H
 
 #include <stddef.h>
+#include "utils.h"
 
 #ifdef __cplusplus
 extern "C" {
@@ -12,8 +13,10 @@ extern "C" {
 // Constants
 #define DISK_MAX_BLOCKS 512
 #define DISK_MAX_LOGS 1024
-#define DISK_LOG_MSG_LEN 128
+#define DISK_LOG_MSG_LEN 128   // formatted message size (lazy, on read)
 #define DISK_PERSIST_PATH_LEN 256
+#define DISK_REGION_BLOCKS 32  // checkpoint granularity
+#define DISK_REGIONS ((DISK_MAX_BLOCKS + DISK_REGION_BLOCKS - 1) / DISK_REGION_BLOCKS)
 
 // Block states
 typedef enum {
@@ -34,6 +37,45 @@ typedef struct {
     FileStatus status;
 } FileMeta;
 
+// Logged operations (one per mutating API)
+typedef enum {
+    DISK_OP_INIT = 0,
+    DISK_OP_LOAD = 1,
+    DISK_OP_RESET = 2,
+    DISK_OP_ALLOC_CONTIGUOUS = 3,
+    DISK_OP_ALLOC_FRAGMENTED = 4,
+    DISK_OP_ALLOC_CUSTOM = 5,
+    DISK_OP_DELETE = 6,
+    DISK_OP_UNDELETE = 7,
+    DISK_OP_DEFRAGMENT = 8,
+    DISK_OP_MARK_BAD = 9,
+    DISK_OP_REPAIR = 10
+} DiskOp;
+#define DISK_OP_COUNT 11
+
+// Custom allocation strategies (recorded in log events)
+typedef enum {
+    STRATEGY_FIRST_FIT = 0,
+    STRATEGY_BEST_FIT = 1,
+    STRATEGY_WORST_FIT = 2
+} AllocStrategy;
+
+// DiskLogEvent.flags
+#define DISK_EVENT_IMAGE_FAULT 1 // mark_bad damaged image data; detection marks the blocks
+
+// Binary log event; formatted to text only when logs are requested.
+// Field meaning depends on op (see format_event in disk.c).
+typedef struct {
+    long long timestamp_ms; // wall clock, milliseconds since epoch
+    unsigned char op;       // DiskOp
+    unsigned char strategy; // AllocStrategy for DISK_OP_ALLOC_CUSTOM
+    unsigned short flags;   // DISK_EVENT_* bits
+    int file_id;            // file id, or -1
+    int size;               // requested size / block count
+    int start;              // first block, or -1
+    int count;              // secondary count (freed, marked, repaired, used)
+} DiskLogEvent;
+
 // Deleted file snapshot (for undelete_last)
 typedef struct {
     int valid;
@@ -42,6 +84,31 @@ typedef struct {
     int indices[DISK_MAX_BLOCKS];
 } DeletedSnapshot;
 
+// Log query (cursor-based pagination over the log ring).
+// Sequence numbers never go back, across resets and restarts alike. A cursor
+// past the newest event or older than the oldest retained one is answered
+// from the oldest, with "reset" set in the response.
+typedef struct {
+    int cursor;            // first sequence number to return; 0 = oldest retained
+    int limit;             // max events; <= 0 means DISK_MAX_LOGS
+    long long since_ms;    // inclusive lower timestamp bound; 0 = none
+    long long until_ms;    // exclusive upper timestamp bound; 0 = none
+    unsigned int op_mask;  // (1u << DiskOp) per accepted op; 0 = all
+    int file_id;           // only events for this file; <= 0 = any
+} DiskLogQuery;
+
+// How disk_save() reaches the file. Sync writes before returning; async
+// hands a copy to a background writer so mutations return once applied
+// in memory, and disk_flush() waits for the writer to catch up.
+typedef enum {
+    DISK_PERSIST_SYNC = 0,
+    DISK_PERSIST_ASYNC = 1
+} DiskPersistMode;
+
+// Called after every state change (allocation, delete, defrag, ...), so
+// layers above can drop anything derived from the disk state
+typedef void (*DiskMutationHook)(void* ctx);
+
 // Global disk state (singleton)
 typedef struct {
     int initialized;
@@ -50,17 +117,29 @@ typedef struct {
     int owner[DISK_MAX_BLOCKS];        // file id for used blocks, -1 otherwise
     FileMeta files[DISK_MAX_BLOCKS];   // simplistic file id registry
     int next_file_id;
-    char logs[DISK_MAX_LOGS][DISK_LOG_MSG_LEN];
+    DiskLogEvent logs[DISK_MAX_LOGS];
+    int log_first; // oldest sequence kept since the ring was last cleared
     int log_head; // ring buffer
     char persist_path[DISK_PERSIST_PATH_LEN];
     DeletedSnapshot last_deleted;
+    uint64_t seed;
+    RandState rng;                     // mark_bad and repair draw from this
 } Disk;
 
 // Lifecycle
-int disk_init(const char* persist_path);
-int disk_load();
-int disk_save();
+int disk_init(const char* persist_path); // DURABILITY_RENAME
+// A snapshot that fails validation is moved to "<path>.corrupt" and the
+// disk starts fresh
+int disk_init_ex(const char* persist_path, Durability durability);
+int disk_load();   // -1 no snapshot, -2 checksum or format error
+int disk_save();   // async mode: queues the snapshot and returns 0
 int disk_reset();
+int disk_set_persist_mode(DiskPersistMode mode); // -1 if unsupported
+int disk_flush();  // waits for queued saves; status of the latest write
+// Restarts the disk's random stream; the same seed and the same calls
+// mark and repair the same blocks. disk_init seeds from RAND_SEED if set.
+void disk_seed(uint64_t seed);
+uint64_t disk_get_seed();
 
 // Allocation APIs
 int disk_allocate_contiguous(int size, int *out_file_id);
@@ -80,6 +159,23 @@ char* disk_get_state();   // JSON string, caller frees
 char* disk_get_files();   // JSON string, caller frees
 char* disk_get_stats();   // JSON string, caller frees
 char* disk_get_logs();    // JSON string, caller frees
+void disk_log_query_init(DiskLogQuery* q);
+char* disk_query_logs(const DiskLogQuery* q); // JSON string, caller frees
+const char* disk_op_name(int op);
+
+// Streaming variants: append the same JSON to a caller-owned buffer
+// (lets the server reuse one response buffer instead of allocating)
+int disk_write_state(StrBuf* out);
+int disk_write_files(StrBuf* out);
+int disk_write_stats(StrBuf* out);
+int disk_write_logs(StrBuf* out);
+int disk_write_log_query(StrBuf* out, const DiskLogQuery* q);
+
+int disk_op_from_name(const char* name);      // -1 if unknown
+
+// Mutation hooks
+void disk_set_mutation_hook(DiskMutationHook hook, void* ctx);
+unsigned long disk_generation(); // incremented on every state change
 
 // Utility
 int disk_total_free();
@@ -88,6 +184,19 @@ int disk_total_bad();
 int disk_file_exists(int file_id);
 void disk_shutdown();
 
+// Backs the blocks with a real image file of block_size bytes per block
+// (see backing.h): allocation writes file data, delete and undelete
+// rewrite block headers and defragment moves the data. Existing files are
+// written out on attach. -1 bad block size, -2 image not usable, -3 path
+// holds something that is not an image, -4 path is the snapshot or one of
+// its .log/.delta/.corrupt siblings.
+int disk_attach_image(const char* path, size_t block_size, int sync);
+void disk_detach_image();
+// With an image attached, disk_mark_random_bad() corrupts the data of
+// random used blocks instead; blocks fail once the scrubber notices.
+// This marks the blocks it has reported bad; returns how many.
+int disk_apply_scrub();
+
 #ifdef __cplusplus
 }
 #endif
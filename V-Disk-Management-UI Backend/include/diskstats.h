@@ -0,0 +1,69 @@
+#ifndef DISKSTATS_H
+#define DISKSTATS_H
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+#define DISKSTATS_MAX_DEVICES 64
+#define DISKSTATS_SECTOR_BYTES 512 // /proc/diskstats counts 512-byte sectors
+
+// Cumulative per-device counters, as the kernel reports them
+typedef struct {
+    char name[32];
+    unsigned long long reads;          // completed read requests
+    unsigned long long sectors_read;
+    unsigned long long read_ms;        // time spent on reads
+    unsigned long long writes;
+    unsigned long long sectors_written;
+    unsigned long long write_ms;
+    unsigned long long in_flight;      // requests currently queued (not cumulative)
+    unsigned long long io_ms;          // time the device was busy
+    unsigned long long weighted_ms;    // busy time weighted by queue length
+    int whole_disk;                    // not a partition, dm/md/loop or RAM device
+} DiskCounters;
+
+// Rates over the interval between two counter readings
+typedef struct {
+    char name[32];
+    double read_iops;
+    double write_iops;
+    double read_bytes_per_sec;
+    double write_bytes_per_sec;
+    double queue_depth;                // average requests outstanding
+    double read_await_ms;              // average time per completed read
+    double write_await_ms;
+    double util_percent;               // share of the interval the device was busy
+    unsigned long long in_flight;
+    int whole_disk;
+} DiskIoRates;
+
+// Reads /proc/diskstats, or /sys/block/*/stat when it is missing.
+// Devices that have never done any I/O are skipped. Returns the number of
+// entries written, or -1 if neither source is readable.
+int diskstats_read(DiskCounters* out, int cap);
+
+// Parses text in /proc/diskstats format; returns the number of entries.
+// A row is a partition if sysfs says so or, for names sysfs does not know,
+// if it extends an earlier disk's name with a (p-prefixed) number.
+int diskstats_parse(const char* text, DiskCounters* out, int cap);
+
+// Matches devices by name across two readings taken elapsed_ms apart and
+// writes one DiskIoRates per device present in both; returns the count.
+// A counter that went backwards (device reset or wrap) counts from zero.
+int diskstats_rates(const DiskCounters* prev, int nprev, const DiskCounters* cur, int ncur,
+                    double elapsed_ms, DiskIoRates* out, int cap);
+
+// Adds up the rates of whole disks only, since partitions and stacked
+// devices repeat the I/O of the disks beneath them. Returns the disks counted.
+int diskstats_totals(const DiskIoRates* rates, int n, DiskIoRates* total);
+
+// Takes two readings window_ms apart and returns their rates, for callers
+// without a sampler; blocks for the window. -1 if counters are unreadable.
+int diskstats_measure(DiskIoRates* out, int cap, int window_ms);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif // DISKSTATS_H
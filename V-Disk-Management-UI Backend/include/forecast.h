@@ -0,0 +1,36 @@
+#ifndef FORECAST_H
+#define FORECAST_H
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+#define FORECAST_MAX_SERIES 64
+#define FORECAST_HALF_LIFE_S (6 * 3600.0) // weight of a sample halves every 6h
+#define FORECAST_MIN_SAMPLES 10
+
+typedef struct {
+    char path[256];
+    int samples;
+    long long updated_ms;          // time of the newest sample
+    double used_bytes;             // newest sample
+    double total_bytes;
+    double bytes_per_sec;          // fitted growth rate (negative = shrinking)
+    double eta_seconds;            // until full at that rate; -1 if not filling
+    double confidence;             // weighted R^2 of the fit, 0 until FORECAST_MIN_SAMPLES
+} DiskForecast;
+
+// Adds one usage sample for path in O(1): an exponentially weighted
+// least-squares line through (time, used) is kept as running sums, so the
+// history itself is never stored or rescanned
+void forecast_add(const char* path, long long t_ms, double used_bytes, double total_bytes);
+
+int forecast_get(const char* path, DiskForecast* out); // -1 if path has no samples
+int forecast_list(DiskForecast* out, int cap);         // every series; returns the count
+void forecast_reset();
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif // FORECAST_H
@@ -0,0 +1,56 @@
+#ifndef HTTP_H
+#define HTTP_H
+
+#include <stddef.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+// Limits enforced by the parser
+#define HTTP_MAX_HEADER_BYTES 8192          // request line + headers
+#define HTTP_MAX_BODY_BYTES (64 * 1024)
+#define HTTP_MAX_REQUEST_BYTES (HTTP_MAX_HEADER_BYTES + HTTP_MAX_BODY_BYTES)
+
+// Parsed request. Strings that are views (body, accept_encoding) point
+// into the caller's receive buffer and are NUL-terminated in place.
+typedef struct {
+    char method[8];
+    char path[256];
+    char query[256];
+    char protocol[16];
+    long content_length;
+    const char* body;
+    size_t body_len;
+    const char* accept_encoding; // header value, or "" when absent
+} HttpRequest;
+
+typedef enum {
+    HTTP_PARSE_REQUEST_LINE = 0,
+    HTTP_PARSE_HEADERS,
+    HTTP_PARSE_BODY,
+    HTTP_PARSE_DONE,
+    HTTP_PARSE_ERROR
+} HttpParseState;
+
+// Incremental HTTP/1.1 request parser. The caller appends received bytes
+// to one buffer (capacity HTTP_MAX_REQUEST_BYTES + 1) and calls
+// http_parse() after every read; complete lines are consumed as they
+// arrive, so requests split across TCP segments parse the same as
+// requests read in one go.
+typedef struct {
+    HttpParseState state;
+    size_t pos;          // first byte not yet consumed
+    size_t body_start;
+    int error_status;    // HTTP status to answer with in HTTP_PARSE_ERROR
+    const char* error;   // error message for the response
+} HttpParser;
+
+void http_parser_init(HttpParser* p, HttpRequest* req);
+HttpParseState http_parse(HttpParser* p, HttpRequest* req, char* buf, size_t len);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif // HTTP_H
@@ -0,0 +1,52 @@
+#ifndef JSON_H
+#define JSON_H
+
+#include <stddef.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+#define JSON_MAX_DEPTH 32
+#define JSON_MAX_THREADS 16
+#define JSON_PARALLEL_MIN_BYTES (256 * 1024) // per thread, when threads are auto
+
+typedef enum {
+    JSON_FIELD_INT = 0,    // out: int*
+    JSON_FIELD_LONG,       // out: long long*
+    JSON_FIELD_STRING,     // out: char[cap], unescaped and NUL-terminated
+    JSON_FIELD_INT_ARRAY,  // out: int[cap]; count receives the element count
+    JSON_FIELD_RAW         // out: const char**; count receives the byte length
+} JsonFieldType;
+
+// One member of the top-level object the caller wants extracted.
+// found is 1 when the key was present and its value fit the field,
+// 0 when the key was absent, -1 when it was present but unusable
+// (wrong type, out of range, string or array longer than cap).
+typedef struct {
+    const char* key;
+    JsonFieldType type;
+    void* out;
+    size_t cap;
+    size_t count;
+    int found;
+} JsonField;
+
+// Scans a JSON object once, left to right, validating it and storing
+// every listed member as it goes; members not listed are skipped without
+// being copied. Returns 0 when json is a well-formed object, -1 otherwise
+// (fields parsed before the error keep their values).
+int json_extract(const char* json, size_t len, JsonField* fields, int nfields);
+
+// Parses a raw "[int, int, ...]" span (as returned for JSON_FIELD_RAW)
+// into out. Large arrays are cut at commas into chunks parsed by worker
+// threads, each writing its own slice of out. threads = 0 picks a count
+// from the online CPUs and the input size; 1 forces a sequential parse.
+// Returns 0 on success, -1 if the span is not an int array or exceeds cap.
+int json_parse_int_array(const char* raw, size_t len, int* out, size_t cap, size_t* count, int threads);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif // JSON_H
@@ -0,0 +1,76 @@
+// Disk Management Simulator - snapshot and event log writer (C99)
+
+#ifndef PERSIST_H
+#define PERSIST_H
+
+#include "disk.h"
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+// Everything disk_save() writes, captured from the live disk so it can be
+// serialized while the disk keeps changing
+typedef struct {
+    int blocks;
+    int next_file_id;
+    BlockState state[DISK_MAX_BLOCKS];
+    int owner[DISK_MAX_BLOCKS];
+    FileMeta files[DISK_MAX_BLOCKS];
+    DiskLogEvent logs[DISK_MAX_LOGS]; // mirror of the log ring
+    int log_first;
+    int log_head;
+    unsigned log_epoch;               // bumped whenever the log is cleared
+    // Regions changed since the last checkpoint; commits that coalesce
+    // accumulate here. full asks for a complete snapshot instead.
+    unsigned char dirty[DISK_REGIONS];
+    int full;
+} DiskSnapshot;
+
+// One changed region, appended to "<path>.delta" between full snapshots
+typedef struct {
+    unsigned int magic;
+    unsigned int checkpoint;          // full snapshot this applies on top of
+    int region;
+    int blocks;
+    int next_file_id;
+    unsigned int crc32;               // of the record with this field zeroed
+    unsigned char state[DISK_REGION_BLOCKS];
+    int owner[DISK_REGION_BLOCKS];
+} DiskDeltaRecord;
+
+// Snapshot goes to path, changed regions to "<path>.delta" and the binary
+// event log to "<path>.log"; all are written with the given durability
+int persist_open(const char* path, Durability d);
+
+// Capture protocol: persist_begin() returns the pending snapshot for the
+// caller to update; persist_commit() hands it over. In sync mode commit
+// writes it before returning; in async mode the writer thread picks it up
+// and back-to-back commits collapse into one write of the latest copy.
+DiskSnapshot* persist_begin();
+int persist_commit();           // sync: write status; async: 0
+void persist_release();         // ends persist_begin() without writing, for
+                                // state that is already on disk
+
+int persist_set_mode(DiskPersistMode mode); // -1 if threads are unavailable
+DiskPersistMode persist_mode();
+int persist_flush();            // waits for committed snapshots; last write status
+unsigned long persist_write_count(); // snapshots actually written
+
+// Applies the delta records written on top of full snapshot `checkpoint`
+// to arrays holding DISK_MAX_BLOCKS entries and returns how many applied.
+// Records are CRC-checked; a torn or corrupt tail is cut off the file.
+int persist_delta_replay(unsigned checkpoint, int* blocks, int* next_file_id, int* state, int* owner);
+
+// Reads the newest events from the log file into ring[seq % DISK_MAX_LOGS]
+// for seq in [*first, *head) and makes them the already-written prefix of
+// the pending snapshot. Sequence numbers continue from the file's base record.
+int persist_log_load(DiskLogEvent* ring, int* first, int* head);
+
+void persist_close();           // drains, stops the writer, closes the log
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif // PERSIST_H
@@ -0,0 +1,78 @@
+#ifndef ROUTER_H
+#define ROUTER_H
+
+#include <stddef.h>
+#include "http.h"
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+#define ROUTER_MAX_NODES 128     // path segments across all routes
+#define ROUTER_EDGE_SLOTS 256    // hash slots for literal segments (power of 2)
+#define ROUTER_MAX_PARAMS 4
+#define ROUTER_PARAM_LEN 64
+
+typedef enum {
+    HTTP_GET = 0,
+    HTTP_POST,
+    HTTP_PUT,
+    HTTP_DELETE,
+    HTTP_METHOD_COUNT
+} HttpMethod;
+
+// Values captured by "{name}" segments of the matched pattern
+typedef struct {
+    int count;
+    const char* names[ROUTER_MAX_PARAMS];
+    char values[ROUTER_MAX_PARAMS][ROUTER_PARAM_LEN];
+} RouteParams;
+
+typedef void (*RouteHandler)(int client_fd, const HttpRequest* req, const RouteParams* params);
+
+typedef struct {
+    HttpMethod method;
+    const char* pattern; // e.g. "/file/{id}"; must outlive the router
+    RouteHandler handler;
+} Route;
+
+typedef enum {
+    ROUTE_FOUND = 0,
+    ROUTE_NOT_FOUND,
+    ROUTE_METHOD_NOT_ALLOWED
+} RouteResult;
+
+typedef struct {
+    RouteHandler handlers[HTTP_METHOD_COUNT];
+    int param_child;         // node for a "{name}" segment, -1 if none
+    const char* param_name;
+    size_t param_name_len;
+} RouterNode;
+
+typedef struct {
+    int node;                // child node, -1 = empty slot
+    int parent;
+    const char* seg;         // points into the route pattern
+    size_t seg_len;
+} RouterEdge;
+
+// Segment trie over the route table. Literal children are found through
+// one hash table keyed by (parent node, segment), so matching costs one
+// probe per path segment regardless of how many routes exist.
+typedef struct {
+    RouterNode nodes[ROUTER_MAX_NODES];
+    int node_count;
+    RouterEdge edges[ROUTER_EDGE_SLOTS];
+} Router;
+
+int http_method_from_string(const char* method); // -1 if unsupported
+int router_build(Router* r, const Route* routes, size_t count);
+RouteResult router_match(const Router* r, const char* method, const char* path,
+                         RouteHandler* out_handler, RouteParams* params);
+const char* route_param(const RouteParams* params, const char* name); // NULL if absent
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif // ROUTER_H
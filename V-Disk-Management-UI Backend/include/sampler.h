@@ -0,0 +1,49 @@
+#ifndef SAMPLER_H
+#define SAMPLER_H
+
+#include "system_disk.h"
+#include "diskstats.h"
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+#define SAMPLER_DEFAULT_INTERVAL_MS 1000
+
+// One round of filesystem stats taken by the background collector
+typedef struct {
+    unsigned long seq;                // 1 for the first sample
+    long long sampled_ms;             // wall clock when collected
+    int root_status;                  // get_system_disk_info() result
+    SystemDiskInfo root;
+    int mount_count;                  // get_system_mounts() result
+    SystemMountInfo mounts[SYSTEM_MAX_MOUNTS];
+    // Block device rates since the previous sample: -1 when counters are
+    // unavailable, 0 on the first sample
+    int io_count;
+    double io_interval_ms;
+    DiskIoRates io[DISKSTATS_MAX_DEVICES];
+} SystemSample;
+
+// Starts a thread collecting a sample every interval_ms; -1 if threads
+// are unavailable or it is already running. Every sample also feeds the
+// per-mount usage forecast (forecast.h).
+int sampler_start(int interval_ms);
+void sampler_stop();
+
+// Simulated disk figures recorded into the time series (timeseries.h)
+// with every sample, alongside the filesystem and block device metrics.
+// Called by the thread that owns the simulated disk whenever it changes.
+void sampler_set_sim_stats(int used, int free_blocks, int bad, double fragmentation_percent);
+
+// Newest published sample, or NULL before the first one (or when the
+// sampler is not running). Never blocks: collector and reader swap
+// buffers with one atomic exchange. Meant for a single reader thread; the
+// pointer stays valid until that thread calls sampler_latest() again.
+const SystemSample* sampler_latest();
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif // SAMPLER_H
@@ -0,0 +1,80 @@
+#ifndef SCAN_H
+#define SCAN_H
+
+#include <stddef.h>
+#include <sys/types.h>
+#include "aio.h"
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+#define SCAN_SECTOR_BYTES 512
+#define SCAN_DEFAULT_CHUNK (1024 * 1024)
+#define SCAN_DEFAULT_INFLIGHT 4
+#define SCAN_MAX_INFLIGHT 16
+#define SCAN_DEFAULT_TIMEOUT_MS 2000
+#define SCAN_MAX_RANGES 256
+
+// Reads len bytes at off like pread(); a hook lets tests inject faults
+typedef AioReadFn ScanReadFn;
+
+typedef struct {
+    size_t chunk_bytes;            // per read, rounded up to whole sectors
+    int inflight;                  // reads kept in flight
+    double max_bytes_per_sec;      // throttle; 0 = unlimited
+    int timeout_ms;                // a read slower than this counts as failed;
+                                   // one still out after it is not waited for
+    int direct;                    // try O_DIRECT, falling back if refused
+    AioBackend backend;            // how the reads are queued
+    ScanReadFn read_fn;            // NULL = pread
+    void* read_ctx;
+} ScanOptions;
+
+// A run of consecutive unreadable sectors, in SCAN_SECTOR_BYTES units
+typedef struct {
+    unsigned long long first_sector;
+    unsigned long long count;
+} BadRange;
+
+typedef struct {
+    int running;
+    int status;                    // 0 ok, -1 could not open/read, -2 cancelled
+    unsigned long long bytes_total;
+    unsigned long long bytes_scanned;
+    unsigned long long bad_sectors;
+    unsigned long long failed_reads; // chunk reads that needed bisecting
+    unsigned long long slow_reads;   // of those, the ones that timed out
+    int direct_io;                 // 1 if O_DIRECT was in effect
+    unsigned sector_bytes;         // logical block size failures are narrowed to
+    AioBackend io_backend;         // backend the sweep actually ran on
+    double elapsed_s;
+    int range_count;
+    int ranges_truncated;          // more than SCAN_MAX_RANGES ranges
+    BadRange ranges[SCAN_MAX_RANGES]; // sorted, adjacent sectors merged
+} ScanResult;
+
+void scan_options_init(ScanOptions* opt);
+
+// Reads the whole device or image in chunk_bytes pieces, keeping
+// `inflight` reads queued on an AioQueue (io_uring unless a read_fn is set
+// or the kernel refuses it). A chunk that fails or times out is bisected
+// down to the device's logical block size through the same O_DIRECT
+// descriptor, and the blocks that still fail are recorded as bad ranges. Blocks until
+// done; returns out->status.
+int scan_device(const char* path, const ScanOptions* opt, ScanResult* out);
+
+// The same scan on a background thread, one at a time: scan_start()
+// returns -1 if one is already running, scan_status() copies its progress
+// (or the last result), scan_cancel() stops it once the reads in flight
+// have completed or overrun timeout_ms.
+int scan_start(const char* path, const ScanOptions* opt);
+int scan_status(ScanResult* out, char* path, size_t path_len); // -1 if none yet
+void scan_cancel();
+long long scan_last_bad_sectors(); // from the last finished scan, -1 if none
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif // SCAN_H
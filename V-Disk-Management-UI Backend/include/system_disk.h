@@ -19,12 +19,51 @@ typedef struct {
     char path[256];                  // Path to the disk
 } SystemDiskInfo;
 
+#define SYSTEM_MAX_MOUNTS 64
+#define SYSTEM_MOUNT_TIMEOUT_MS 500
+
+// One mounted filesystem; info.path holds the mount point
+typedef struct {
+    SystemDiskInfo info;
+    char device[128];
+    char fstype[32];
+    int status;                      // 0 ok, -1 statvfs failed, -2 timed out
+} SystemMountInfo;
+
 // Get system disk information
 int get_system_disk_info(SystemDiskInfo* info);
 
-// Create a file on the actual disk
+// Lists mounted filesystems from /proc/self/mountinfo, skipping pseudo
+// filesystems that report no blocks. statvfs runs for all mounts at once;
+// one that has not answered within timeout_ms (e.g. a hung network mount)
+// is returned with status -2 and its thread is left to finish on its own.
+// A mount whose probe another call started is waited on, not probed again;
+// it only reports -2 straight away once that probe outlived its own call.
+// Returns the number of entries written, or -1 if the mount table cannot
+// be read. Without /proc the root filesystem is the only entry.
+int get_system_mounts(SystemMountInfo* out, int cap, int timeout_ms);
+
+// How create_file_on_disk_ex() reserves space for the new file
+typedef enum {
+    PREALLOC_SPARSE = 0,  // set the size only; blocks are allocated on first write
+    PREALLOC_ALLOCATE,    // posix_fallocate: blocks reserved, reads return zeros
+    PREALLOC_KEEP_SIZE,   // blocks reserved beyond a zero file size (Linux)
+    PREALLOC_ZERO_RANGE,  // FALLOC_FL_ZERO_RANGE, else as PREALLOC_ALLOCATE (Linux)
+    PREALLOC_WRITE_FILL   // zeros written through large aligned buffers
+} PreallocMode;
+
+#define PREALLOC_FILL_CHUNK (1024 * 1024)
+
+const char* prealloc_mode_name(PreallocMode mode);
+int prealloc_mode_from_name(const char* name); // -1 if unknown
+
+// Create a file on the actual disk (PREALLOC_ALLOCATE)
 int create_file_on_disk(const char* filename, size_t size);
 
+// Returns 0 on success, -2 when the filesystem is out of space and -1 on
+// any other error; a file that could not be fully reserved is removed
+int create_file_on_disk_ex(const char* filename, size_t size, PreallocMode mode);
+
 // Delete a file from the actual disk
 int delete_file_from_disk(const char* filename);
 
@@ -0,0 +1,57 @@
+#ifndef TIMESERIES_H
+#define TIMESERIES_H
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+typedef enum {
+    TS_SYS_USED_PERCENT = 0,   // root filesystem
+    TS_SYS_FREE_BYTES,
+    TS_IO_READ_BYTES,          // per second, summed over block devices
+    TS_IO_WRITE_BYTES,
+    TS_IO_IOPS,
+    TS_SIM_USED_BLOCKS,        // simulated disk
+    TS_SIM_FREE_BLOCKS,
+    TS_SIM_BAD_BLOCKS,
+    TS_SIM_FRAGMENTATION,
+    TS_METRIC_COUNT
+} TsMetric;
+
+// Every sample lands in all three rings; each keeps min/max/sum per bucket
+typedef enum {
+    TS_RES_1S = 0,             // last 10 minutes
+    TS_RES_1M,                 // last 24 hours
+    TS_RES_1H,                 // last 31 days
+    TS_RES_COUNT
+} TsResolution;
+
+typedef struct {
+    long long start_ms;        // bucket start, aligned to the resolution
+    int count;                 // samples in the bucket
+    double min;
+    double max;
+    double avg;
+} TsPoint;
+
+// O(1): folds value into its bucket at every resolution. A late sample
+// still counts as long as the ring keeps its bucket.
+void ts_record(TsMetric metric, long long now_ms, double value);
+
+// Buckets of one resolution whose start lies in [from_ms, to_ms], oldest
+// first; empty buckets are skipped. Returns the number written to out.
+int ts_query(TsMetric metric, TsResolution res, long long from_ms, long long to_ms, TsPoint* out, int cap);
+
+int ts_capacity(TsResolution res);          // buckets kept
+long long ts_resolution_ms(TsResolution res);
+const char* ts_metric_name(TsMetric metric);
+int ts_metric_from_name(const char* name);  // -1 if unknown
+const char* ts_resolution_name(TsResolution res);
+int ts_resolution_from_name(const char* name); // -1 if unknown
+void ts_reset();
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif // TIMESERIES_H
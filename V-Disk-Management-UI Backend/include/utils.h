@@ -2,6 +2,8 @@
 #define UTILS_H
 
 #include <stddef.h>
+#include <stdio.h>
+#include <stdint.h>
 
 // Simple string builder
 typedef struct {
@@ -15,21 +17,63 @@ int sb_append(StrBuf* sb, const char* s);
 int sb_append_n(StrBuf* sb, const char* s, size_t n);
 int sb_appendf(StrBuf* sb, const char* fmt, ...);
 char* sb_take(StrBuf* sb); // returns buffer and resets sb
+int sb_reserve(StrBuf* sb, size_t extra); // room for extra bytes + NUL
+void sb_reset(StrBuf* sb);  // empties sb, keeps capacity for reuse
+void sb_free(StrBuf* sb);
+
+// Fixed-size bump allocator; reset frees everything at once
+typedef struct {
+    char* base;
+    size_t used;
+    size_t cap;
+} Arena;
+
+int arena_init(Arena* a, size_t cap);
+void* arena_alloc(Arena* a, size_t n); // 16-byte aligned, NULL when exhausted
+void arena_reset(Arena* a);
+void arena_free(Arena* a);
 
 // File IO
 int file_exists(const char* path);
 int read_text_file(const char* path, StrBuf* out);
 int write_text_file_atomic(const char* path, const char* content);
+int write_binary_file_atomic(const char* path, const void* data, size_t len);
+
+// How far a write is pushed towards stable storage before returning
+typedef enum {
+    DURABILITY_NONE = 0,   // overwrite in place; a crash can tear the file
+    DURABILITY_RENAME,     // temp file + rename: atomic, but may be lost on power failure
+    DURABILITY_FDATASYNC,  // + fdatasync of the file before the rename
+    DURABILITY_FSYNC       // + fsync of the file and of its directory after the rename
+} Durability;
 
-// Parsing helpers (very naive JSON-like parsing)
-int parse_json_int(const char* json, const char* key, int* out_value);
-int parse_json_string(const char* json, const char* key, char* out, size_t out_len);
+int write_file_durable(const char* path, const void* data, size_t len, Durability d);
+int sync_stream(FILE* f, Durability d); // fflush, then fdatasync/fsync per d
+int sync_parent_dir(const char* path);  // fsync the directory holding path
+int same_file(const char* a, const char* b); // 1 if both name one file, or one entry still to be created
+const char* durability_name(Durability d);
+int durability_from_name(const char* name); // -1 if unknown
+
+// URL query helpers: "a=1&b=two" (no percent-decoding)
+int parse_query_long(const char* query, const char* key, long long* out_value);
+int parse_query_string(const char* query, const char* key, char* out, size_t out_len);
 
 // Trim
 void trim_whitespace(char* s);
 
-// Random helpers
-void utils_srand();
-int utils_rand_range(int min_inclusive, int max_inclusive);
+// Time
+long long utils_now_ms(); // wall clock, milliseconds since epoch
+
+// Random helpers: xoshiro256** streams whose state the caller owns (one per
+// disk or per thread), so nothing is shared and a seed replays a run
+typedef struct {
+    uint64_t s[4];
+} RandState;
+
+void utils_rand_seed(RandState* r, uint64_t seed); // splitmix64 expansion
+uint64_t utils_rand_next(RandState* r);
+uint32_t utils_rand_below(RandState* r, uint32_t bound); // [0, bound), unbiased
+int utils_rand_range(RandState* r, int min_inclusive, int max_inclusive);
+uint64_t utils_seed_from_env(const char* name); // the variable if set, else time and pid
 
 #endif // UTILS_H
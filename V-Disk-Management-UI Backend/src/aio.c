@@ -0,0 +1,468 @@
+#ifdef __linux__
+#define _GNU_SOURCE // syscall()
+#endif
+#define _POSIX_C_SOURCE 200809L
+#include "aio.h"
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#ifndef _WIN32
+#include <pthread.h>
+#include <unistd.h>
+#include <stdint.h>
+#include <time.h>
+#include <poll.h>
+#endif
+#ifdef __linux__
+#include <linux/io_uring.h>
+#include <sys/syscall.h>
+#include <sys/mman.h>
+#endif
+
+#define AIO_MAX_THREADS 16
+
+static const char* BACKEND_NAMES[] = { "auto", "io_uring", "threads" };
+
+const char* aio_backend_name(AioBackend backend) {
+    if (backend < AIO_AUTO || backend > AIO_THREADS) return "unknown";
+    return BACKEND_NAMES[backend];
+}
+
+int aio_backend_from_name(const char* name) {
+    if (!name) return -1;
+    for (int i = AIO_AUTO; i <= AIO_THREADS; i++) {
+        if (strcmp(name, BACKEND_NAMES[i]) == 0) return i;
+    }
+    return -1;
+}
+
+#ifdef _WIN32
+AioQueue* aio_open(unsigned depth, AioBackend backend, AioReadFn read_fn, void* read_ctx) { return NULL; }
+void aio_close(AioQueue* q) {}
+AioBackend aio_backend(const AioQueue* q) { return AIO_THREADS; }
+int aio_read(AioQueue* q, int fd, void* buf, size_t len, long long off, void* tag) { return -1; }
+int aio_write(AioQueue* q, int fd, const void* buf, size_t len, long long off, void* tag) { return -1; }
+int aio_fsync(AioQueue* q, int fd, int datasync, void* tag) { return -1; }
+int aio_wait(AioQueue* q, AioCompletion* out, int max, int min) { return -1; }
+int aio_wait_timeout(AioQueue* q, AioCompletion* out, int max, int min, int timeout_ms) { return -1; }
+int aio_close_timeout(AioQueue* q, int timeout_ms) { return 0; }
+int aio_inflight(const AioQueue* q) { return 0; }
+#else
+typedef enum { OP_READ = 0, OP_WRITE, OP_FSYNC, OP_FDATASYNC } AioOp;
+
+typedef struct {
+    AioOp op;
+    int fd;
+    void* buf;
+    size_t len;
+    long long off;
+    void* tag;
+} AioRequest;
+
+struct AioQueue {
+    AioBackend backend;
+    unsigned depth;
+    int inflight;                  // queued or running, not yet reaped
+#ifdef __linux__
+    // io_uring: the shared rings, mapped from the kernel
+    int ring_fd;
+    void* sq_ring;
+    size_t sq_ring_size;
+    void* cq_ring;
+    size_t cq_ring_size;
+    struct io_uring_sqe* sqes;
+    size_t sqes_size;
+    unsigned *sq_head, *sq_tail, *sq_mask, *sq_array;
+    unsigned *cq_head, *cq_tail, *cq_mask;
+    struct io_uring_cqe* cqes;
+    unsigned to_submit;
+    int ext_arg;                   // io_uring_enter takes a wait timeout (5.11)
+#endif
+    // thread pool: requests and completions in rings of depth entries
+    AioReadFn read_fn;
+    void* read_ctx;
+    pthread_mutex_t lock;
+    pthread_cond_t work_cv;
+    pthread_cond_t done_cv;
+    AioRequest* pending;
+    unsigned pending_head, pending_count;
+    AioCompletion* done;
+    unsigned done_head, done_count;
+    pthread_t threads[AIO_MAX_THREADS];
+    int nthreads;
+    int stopping;
+};
+
+static long long now_ns() {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (long long)ts.tv_sec * 1000000000LL + ts.tv_nsec;
+}
+
+// ---- thread pool ----
+
+static long long run_request(AioQueue* q, const AioRequest* r) {
+    ssize_t n;
+    switch (r->op) {
+        case OP_READ:
+            n = q->read_fn ? q->read_fn(q->read_ctx, r->fd, r->buf, r->len, (off_t)r->off)
+                           : pread(r->fd, r->buf, r->len, (off_t)r->off);
+            break;
+        case OP_WRITE:
+            n = pwrite(r->fd, r->buf, r->len, (off_t)r->off);
+            break;
+        case OP_FDATASYNC:
+            n = fdatasync(r->fd);
+            break;
+        default:
+            n = fsync(r->fd);
+            break;
+    }
+    return n < 0 ? -(long long)errno : (long long)n;
+}
+
+static void* pool_worker(void* arg) {
+    AioQueue* q = (AioQueue*)arg;
+    pthread_mutex_lock(&q->lock);
+    for (;;) {
+        while (!q->stopping && q->pending_count == 0) pthread_cond_wait(&q->work_cv, &q->lock);
+        if (q->pending_count == 0) break;
+        AioRequest r = q->pending[q->pending_head];
+        q->pending_head = (q->pending_head + 1) % q->depth;
+        q->pending_count--;
+        pthread_mutex_unlock(&q->lock);
+        long long res = run_request(q, &r);
+        pthread_mutex_lock(&q->lock);
+        AioCompletion* c = &q->done[(q->done_head + q->done_count) % q->depth];
+        c->tag = r.tag;
+        c->res = res;
+        q->done_count++;
+        pthread_cond_signal(&q->done_cv);
+    }
+    pthread_mutex_unlock(&q->lock);
+    return NULL;
+}
+
+static int pool_open(AioQueue* q) {
+    q->pending = (AioRequest*)calloc(q->depth, sizeof(AioRequest));
+    q->done = (AioCompletion*)calloc(q->depth, sizeof(AioCompletion));
+    if (!q->pending || !q->done) return -1;
+    pthread_mutex_init(&q->lock, NULL);
+    pthread_cond_init(&q->work_cv, NULL);
+    // done_cv is waited on with deadlines, which must not jump with the wall clock
+    pthread_condattr_t attr;
+    pthread_condattr_init(&attr);
+    pthread_condattr_setclock(&attr, CLOCK_MONOTONIC);
+    pthread_cond_init(&q->done_cv, &attr);
+    pthread_condattr_destroy(&attr);
+    int want = q->depth < AIO_MAX_THREADS ? (int)q->depth : AIO_MAX_THREADS;
+    for (int i = 0; i < want; i++) {
+        if (pthread_create(&q->threads[q->nthreads], NULL, pool_worker, q) == 0) q->nthreads++;
+    }
+    return q->nthreads > 0 ? 0 : -1;
+}
+
+static void pool_close(AioQueue* q) {
+    if (q->nthreads > 0) {
+        pthread_mutex_lock(&q->lock);
+        q->stopping = 1;
+        pthread_cond_broadcast(&q->work_cv);
+        pthread_mutex_unlock(&q->lock);
+        for (int i = 0; i < q->nthreads; i++) pthread_join(q->threads[i], NULL);
+    }
+    if (q->pending && q->done) {
+        pthread_cond_destroy(&q->done_cv);
+        pthread_cond_destroy(&q->work_cv);
+        pthread_mutex_destroy(&q->lock);
+    }
+    free(q->pending);
+    free(q->done);
+}
+
+static int pool_push(AioQueue* q, const AioRequest* r) {
+    pthread_mutex_lock(&q->lock);
+    q->pending[(q->pending_head + q->pending_count) % q->depth] = *r;
+    q->pending_count++;
+    pthread_cond_signal(&q->work_cv);
+    pthread_mutex_unlock(&q->lock);
+    return 0;
+}
+
+static int pool_wait(AioQueue* q, AioCompletion* out, int max, int min, long long deadline_ns) {
+    struct timespec until = { (time_t)(deadline_ns / 1000000000LL), (long)(deadline_ns % 1000000000LL) };
+    pthread_mutex_lock(&q->lock);
+    while ((int)q->done_count < min) {
+        if (deadline_ns < 0) pthread_cond_wait(&q->done_cv, &q->lock);
+        else if (pthread_cond_timedwait(&q->done_cv, &q->lock, &until) == ETIMEDOUT) break;
+    }
+    int n = 0;
+    while (n < max && q->done_count > 0) {
+        out[n++] = q->done[q->done_head];
+        q->done_head = (q->done_head + 1) % q->depth;
+        q->done_count--;
+    }
+    pthread_mutex_unlock(&q->lock);
+    return n;
+}
+
+// ---- io_uring ----
+
+#ifdef __linux__
+static int ring_enter(AioQueue* q, unsigned submit, unsigned min, unsigned flags) {
+    return (int)syscall(__NR_io_uring_enter, q->ring_fd, submit, min, flags, NULL, 0);
+}
+
+// Submits what is queued and waits up to left_ns for min completions;
+// fails with ETIME when the time runs out first. Kernels without the
+// timeout argument submit first and poll the ring fd instead.
+static int ring_enter_timeout(AioQueue* q, unsigned min, long long left_ns) {
+#ifdef IORING_ENTER_EXT_ARG
+    if (q->ext_arg) {
+        struct __kernel_timespec ts = { left_ns / 1000000000LL, left_ns % 1000000000LL };
+        struct io_uring_getevents_arg arg;
+        memset(&arg, 0, sizeof(arg));
+        arg.ts = (unsigned long long)(uintptr_t)&ts;
+        return (int)syscall(__NR_io_uring_enter, q->ring_fd, q->to_submit, min,
+                            IORING_ENTER_GETEVENTS | IORING_ENTER_EXT_ARG, &arg, sizeof(arg));
+    }
+#endif
+    int submitted = 0;
+    if (q->to_submit > 0 && (submitted = ring_enter(q, q->to_submit, 0, 0)) < 0) return -1;
+    struct pollfd p = { q->ring_fd, POLLIN, 0 };
+    int r = poll(&p, 1, (int)((left_ns + 999999) / 1000000));
+    if (r < 0) return -1;
+    if (r == 0 && submitted == 0) {
+        errno = ETIME;
+        return -1;
+    }
+    return submitted;
+}
+
+static int ring_open(AioQueue* q) {
+    struct io_uring_params p;
+    memset(&p, 0, sizeof(p));
+    q->ring_fd = (int)syscall(__NR_io_uring_setup, q->depth, &p);
+    if (q->ring_fd < 0) return -1;
+    // IORING_OP_READ/WRITE arrived together with fast poll (5.7)
+    if (!(p.features & IORING_FEAT_SINGLE_MMAP) || !(p.features & IORING_FEAT_FAST_POLL)) {
+        close(q->ring_fd);
+        return -1;
+    }
+#ifdef IORING_FEAT_EXT_ARG
+    q->ext_arg = (p.features & IORING_FEAT_EXT_ARG) != 0;
+#endif
+    q->sq_ring_size = p.sq_off.array + p.sq_entries * sizeof(unsigned);
+    q->cq_ring_size = p.cq_off.cqes + p.cq_entries * sizeof(struct io_uring_cqe);
+    if (q->cq_ring_size > q->sq_ring_size) q->sq_ring_size = q->cq_ring_size;
+    q->sq_ring = mmap(NULL, q->sq_ring_size, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE,
+                      q->ring_fd, IORING_OFF_SQ_RING);
+    q->sqes_size = p.sq_entries * sizeof(struct io_uring_sqe);
+    q->sqes = (struct io_uring_sqe*)mmap(NULL, q->sqes_size, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE,
+                                         q->ring_fd, IORING_OFF_SQES);
+    if (q->sq_ring == MAP_FAILED || q->sqes == MAP_FAILED) {
+        if (q->sq_ring != MAP_FAILED) munmap(q->sq_ring, q->sq_ring_size);
+        if (q->sqes != MAP_FAILED) munmap(q->sqes, q->sqes_size);
+        close(q->ring_fd);
+        return -1;
+    }
+    q->cq_ring = q->sq_ring; // one mapping holds both rings
+    char* sq = (char*)q->sq_ring;
+    q->sq_head = (unsigned*)(sq + p.sq_off.head);
+    q->sq_tail = (unsigned*)(sq + p.sq_off.tail);
+    q->sq_mask = (unsigned*)(sq + p.sq_off.ring_mask);
+    q->sq_array = (unsigned*)(sq + p.sq_off.array);
+    q->cq_head = (unsigned*)(sq + p.cq_off.head);
+    q->cq_tail = (unsigned*)(sq + p.cq_off.tail);
+    q->cq_mask = (unsigned*)(sq + p.cq_off.ring_mask);
+    q->cqes = (struct io_uring_cqe*)(sq + p.cq_off.cqes);
+    return 0;
+}
+
+static void ring_close(AioQueue* q) {
+    munmap(q->sqes, q->sqes_size);
+    munmap(q->sq_ring, q->sq_ring_size);
+    close(q->ring_fd);
+}
+
+static int ring_push(AioQueue* q, const AioRequest* r) {
+    unsigned tail = *q->sq_tail;
+    unsigned idx = tail & *q->sq_mask;
+    struct io_uring_sqe* sqe = &q->sqes[idx];
+    memset(sqe, 0, sizeof(*sqe));
+    sqe->fd = r->fd;
+    sqe->user_data = (unsigned long long)(uintptr_t)r->tag;
+    switch (r->op) {
+        case OP_READ:
+        case OP_WRITE:
+            sqe->opcode = r->op == OP_READ ? IORING_OP_READ : IORING_OP_WRITE;
+            sqe->addr = (unsigned long long)(uintptr_t)r->buf;
+            sqe->len = (unsigned)r->len;
+            sqe->off = (unsigned long long)r->off;
+            break;
+        default:
+            sqe->opcode = IORING_OP_FSYNC;
+            sqe->fsync_flags = r->op == OP_FDATASYNC ? IORING_FSYNC_DATASYNC : 0;
+            break;
+    }
+    q->sq_array[idx] = idx;
+    // the kernel must see the filled entry before the new tail
+    __atomic_store_n(q->sq_tail, tail + 1, __ATOMIC_RELEASE);
+    q->to_submit++;
+    return 0;
+}
+
+static int ring_reap(AioQueue* q, AioCompletion* out, int max) {
+    unsigned head = *q->cq_head;
+    unsigned tail = __atomic_load_n(q->cq_tail, __ATOMIC_ACQUIRE);
+    int n = 0;
+    while (head != tail && n < max) {
+        const struct io_uring_cqe* cqe = &q->cqes[head & *q->cq_mask];
+        out[n].tag = (void*)(uintptr_t)cqe->user_data;
+        out[n].res = cqe->res;
+        n++;
+        head++;
+    }
+    __atomic_store_n(q->cq_head, head, __ATOMIC_RELEASE);
+    return n;
+}
+
+static int ring_wait(AioQueue* q, AioCompletion* out, int max, int min, long long deadline_ns) {
+    int n = ring_reap(q, out, max);
+    while (q->to_submit > 0 || n < min) {
+        unsigned want = n < min ? (unsigned)(min - n) : 0;
+        long long left = deadline_ns < 0 ? -1 : deadline_ns - now_ns();
+        if (want && deadline_ns >= 0 && left <= 0) {
+            if (q->to_submit == 0) break;
+            want = 0; // out of time: only submit
+        }
+        int r = want && left > 0 ? ring_enter_timeout(q, want, left)
+                                 : ring_enter(q, q->to_submit, want, want ? IORING_ENTER_GETEVENTS : 0);
+        if (r < 0) {
+            if (errno == ETIME) {
+                n += ring_reap(q, out + n, max - n);
+                break;
+            }
+            if (errno == EINTR || errno == EAGAIN || errno == EBUSY) continue;
+            return n > 0 ? n : -1;
+        }
+        q->to_submit -= (unsigned)r <= q->to_submit ? (unsigned)r : q->to_submit;
+        n += ring_reap(q, out + n, max - n);
+    }
+    return n;
+}
+#endif
+
+// ---- public API ----
+
+AioQueue* aio_open(unsigned depth, AioBackend backend, AioReadFn read_fn, void* read_ctx) {
+    if (depth == 0 || depth > 4096) return NULL;
+    if (read_fn) {
+        if (backend == AIO_IO_URING) return NULL;
+        backend = AIO_THREADS;
+    }
+    AioQueue* q = (AioQueue*)calloc(1, sizeof(AioQueue));
+    if (!q) return NULL;
+    q->depth = depth;
+    q->read_fn = read_fn;
+    q->read_ctx = read_ctx;
+#ifdef __linux__
+    if (backend != AIO_THREADS) {
+        if (ring_open(q) == 0) {
+            q->backend = AIO_IO_URING;
+            return q;
+        }
+        if (backend == AIO_IO_URING) {
+            free(q);
+            return NULL;
+        }
+    }
+#else
+    if (backend == AIO_IO_URING) {
+        free(q);
+        return NULL;
+    }
+#endif
+    q->backend = AIO_THREADS;
+    if (pool_open(q) != 0) {
+        pool_close(q);
+        free(q);
+        return NULL;
+    }
+    return q;
+}
+
+AioBackend aio_backend(const AioQueue* q) {
+    return q->backend;
+}
+
+int aio_inflight(const AioQueue* q) {
+    return q->inflight;
+}
+
+static int push(AioQueue* q, const AioRequest* r) {
+    if (!q || q->inflight >= (int)q->depth) return -1;
+    q->inflight++;
+#ifdef __linux__
+    if (q->backend == AIO_IO_URING) return ring_push(q, r);
+#endif
+    return pool_push(q, r);
+}
+
+int aio_read(AioQueue* q, int fd, void* buf, size_t len, long long off, void* tag) {
+    AioRequest r = { OP_READ, fd, buf, len, off, tag };
+    return push(q, &r);
+}
+
+int aio_write(AioQueue* q, int fd, const void* buf, size_t len, long long off, void* tag) {
+    AioRequest r = { OP_WRITE, fd, (void*)buf, len, off, tag };
+    return push(q, &r);
+}
+
+int aio_fsync(AioQueue* q, int fd, int datasync, void* tag) {
+    AioRequest r = { datasync ? OP_FDATASYNC : OP_FSYNC, fd, NULL, 0, 0, tag };
+    return push(q, &r);
+}
+
+int aio_wait_timeout(AioQueue* q, AioCompletion* out, int max, int min, int timeout_ms) {
+    if (!q || !out || max <= 0) return -1;
+    if (min > q->inflight) min = q->inflight;
+    if (min > max) min = max;
+    long long deadline = timeout_ms < 0 ? -1 : now_ns() + (long long)timeout_ms * 1000000LL;
+    int n;
+#ifdef __linux__
+    if (q->backend == AIO_IO_URING) n = ring_wait(q, out, max, min, deadline);
+    else
+#endif
+    n = pool_wait(q, out, max, min, deadline);
+    if (n > 0) q->inflight -= n;
+    return n;
+}
+
+int aio_wait(AioQueue* q, AioCompletion* out, int max, int min) {
+    return aio_wait_timeout(q, out, max, min, -1);
+}
+
+int aio_close_timeout(AioQueue* q, int timeout_ms) {
+    if (!q) return 0;
+    // nothing may still point into caller buffers once we return
+    long long deadline = timeout_ms < 0 ? -1 : now_ns() + (long long)timeout_ms * 1000000LL;
+    AioCompletion sink[16];
+    while (q->inflight > 0) {
+        int left = deadline < 0 ? -1 : (int)((deadline - now_ns()) / 1000000LL);
+        if (deadline >= 0 && left <= 0) return -1;
+        int n = aio_wait_timeout(q, sink, 16, 1, left);
+        if (n < 0 || (n == 0 && deadline < 0)) break;
+    }
+#ifdef __linux__
+    if (q->backend == AIO_IO_URING) ring_close(q);
+    else
+#endif
+    pool_close(q);
+    free(q);
+    return 0;
+}
+
+void aio_close(AioQueue* q) {
+    aio_close_timeout(q, -1);
+}
+#endif
@@ -0,0 +1,497 @@
+#ifdef __linux__
+#define _GNU_SOURCE // copy_file_range
+#endif
+#define _POSIX_C_SOURCE 200809L
+#include "../include/backing.h"
+#include "../include/compress.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stddef.h>
+#include <errno.h>
+#ifndef _WIN32
+#include <pthread.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <time.h>
+#include <sys/stat.h>
+#endif
+
+#ifdef _WIN32
+#define LOCK()
+#define UNLOCK()
+#else
+static pthread_mutex_t lock = PTHREAD_MUTEX_INITIALIZER;
+#define LOCK() pthread_mutex_lock(&lock)
+#define UNLOCK() pthread_mutex_unlock(&lock)
+#endif
+
+// Checksum side table, one entry per block
+typedef struct {
+    unsigned int crc;              // CRC-32C of the whole block as written
+    unsigned char known;           // crc describes data written by us
+    unsigned char live;            // the data belongs to a live file: scrub it
+    unsigned char flagged;         // reported bad, not checked again
+} BlockSum;
+
+// lock guards sums, the mismatch queue, B.scrub and the scrubber flags.
+// The I/O entry points below run on the request thread and hold it while
+// they change blocks, so the scrubber never reads a block mid-update.
+static BackingInfo B;
+static BlockSum sums[DISK_MAX_BLOCKS];
+static int mismatched[DISK_MAX_BLOCKS];
+static int mismatch_count = 0;     // also read without the lock as a hint
+static int fd = -1;
+static char* io_buf = NULL;        // BACKING_MAX_IO bytes, request thread only
+static char* scrub_buf = NULL;     // one block, under lock
+static int cur_op = -1;            // operation being charged, -1 outside begin/end
+static int touched = 0;            // cur_op did I/O
+static double cur_t0 = 0;
+
+int backing_attached() {
+    return B.attached;
+}
+
+void backing_info(BackingInfo* out) {
+    LOCK();
+    *out = B;
+    out->checksummed = 0;
+    for (int i = 0; i < B.blocks; i++) out->checksummed += sums[i].live;
+    UNLOCK();
+    out->checksum_impl = compress_crc32c_impl();
+}
+
+void backing_reset_stats() {
+    LOCK();
+    memset(B.ops, 0, sizeof(B.ops));
+    B.scrub.passes = 0;
+    B.scrub.blocks_verified = 0;
+    B.scrub.mismatches = 0;
+    UNLOCK();
+}
+
+int backing_take_mismatches(int* blocks, int cap) {
+    if (__atomic_load_n(&mismatch_count, __ATOMIC_RELAXED) == 0) return 0;
+    LOCK();
+    int n = mismatch_count < cap ? mismatch_count : cap;
+    memcpy(blocks, mismatched, sizeof(int) * (size_t)n);
+    memmove(mismatched, mismatched + n, sizeof(int) * (size_t)(mismatch_count - n));
+    __atomic_store_n(&mismatch_count, mismatch_count - n, __ATOMIC_RELAXED);
+    UNLOCK();
+    return n;
+}
+
+void backing_forget() {
+    LOCK();
+    memset(sums, 0, sizeof(sums));
+    mismatch_count = 0;
+    UNLOCK();
+}
+
+#ifdef _WIN32
+int backing_open(const char* path, size_t block_size, int blocks, int sync) { return -2; }
+void backing_close() {}
+void backing_begin(DiskOp op) {}
+void backing_end() {}
+int backing_write(const int* blocks, int n, int file_id, int first_ordinal) { return 0; }
+int backing_mark_deleted(const int* blocks, int n, int deleted) { return 0; }
+int backing_restore(const int* blocks, int n, int file_id) { return 0; }
+int backing_move(int from, int to, int count) { return 0; }
+int backing_read_header(int block, BackingHeader* out) { return -1; }
+int backing_scrub_start(double bytes_per_sec) { return -1; }
+void backing_scrub_stop() {}
+int backing_scrub_pass(double bytes_per_sec) { return 0; }
+int backing_verify(const int* blocks, int n) { return 0; }
+int backing_corrupt(int block) { return -1; }
+#else
+static double now_s() {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (double)ts.tv_sec + (double)ts.tv_nsec / 1e9;
+}
+
+static BackingOpStats* stats() {
+    touched = 1;
+    return &B.ops[cur_op >= 0 ? cur_op : DISK_OP_INIT];
+}
+
+static off_t block_off(int block) {
+    return (off_t)block * (off_t)B.block_size;
+}
+
+static int write_all(const void* buf, size_t len, off_t off) {
+    const char* p = (const char*)buf;
+    BackingOpStats* st = stats();
+    while (len > 0) {
+        ssize_t w = pwrite(fd, p, len, off);
+        st->io_calls++;
+        if (w < 0 && errno == EINTR) continue;
+        if (w <= 0) {
+            st->errors++;
+            return -1;
+        }
+        st->bytes_written += (unsigned long long)w;
+        p += w;
+        off += w;
+        len -= (size_t)w;
+    }
+    return 0;
+}
+
+static int read_all(void* buf, size_t len, off_t off) {
+    char* p = (char*)buf;
+    BackingOpStats* st = stats();
+    while (len > 0) {
+        ssize_t r = pread(fd, p, len, off);
+        st->io_calls++;
+        if (r < 0 && errno == EINTR) continue;
+        if (r <= 0) {
+            st->errors++;
+            return -1;
+        }
+        st->bytes_read += (unsigned long long)r;
+        p += r;
+        off += r;
+        len -= (size_t)r;
+    }
+    return 0;
+}
+
+// An existing file is only reused when it is a regular file of exactly the
+// image's size whose first block is either ours or has never been written
+static int existing_image_ok(off_t size) {
+    struct stat st;
+    if (fstat(fd, &st) != 0 || !S_ISREG(st.st_mode) || st.st_size != size) return 0;
+    unsigned char h[sizeof(BackingHeader)];
+    ssize_t r = pread(fd, h, sizeof(h), 0);
+    if (r != (ssize_t)sizeof(h)) return 0;
+    BackingHeader first;
+    memcpy(&first, h, sizeof(first));
+    if (first.magic == BACKING_MAGIC) return 1;
+    for (size_t i = 0; i < sizeof(h); i++) {
+        if (h[i]) return 0;
+    }
+    return 1;
+}
+
+int backing_open(const char* path, size_t block_size, int blocks, int sync) {
+    if (block_size < BACKING_MIN_BLOCK_SIZE || block_size > BACKING_MAX_BLOCK_SIZE ||
+        block_size % BACKING_MIN_BLOCK_SIZE != 0 || blocks <= 0) return -1;
+    if (!path || strlen(path) >= sizeof(B.path) || blocks > DISK_MAX_BLOCKS) return -2;
+    backing_close();
+    off_t size = (off_t)block_size * blocks;
+    int created = 1;
+    fd = open(path, O_RDWR | O_CREAT | O_EXCL, 0644);
+    if (fd < 0 && errno == EEXIST) {
+        created = 0;
+        fd = open(path, O_RDWR | O_NOFOLLOW);
+        if (fd >= 0 && !existing_image_ok(size)) {
+            close(fd);
+            fd = -1;
+            return -3;
+        }
+    }
+    if (fd < 0) return -2;
+    io_buf = (char*)malloc(BACKING_MAX_IO);
+    scrub_buf = (char*)malloc(block_size);
+    if (!io_buf || !scrub_buf || (created && ftruncate(fd, size) != 0)) {
+        backing_close();
+        if (created) unlink(path);
+        return -2;
+    }
+    LOCK();
+    memset(&B, 0, sizeof(B));
+    memset(sums, 0, sizeof(sums));
+    mismatch_count = 0;
+    strcpy(B.path, path);
+    B.block_size = block_size;
+    B.blocks = blocks;
+    B.sync = sync != 0;
+#ifdef __linux__
+    B.copy_offload = 1;
+#endif
+    B.attached = 1;
+    UNLOCK();
+    return 0;
+}
+
+void backing_close() {
+    backing_scrub_stop();
+    LOCK();
+    if (fd >= 0) close(fd);
+    fd = -1;
+    free(io_buf);
+    free(scrub_buf);
+    io_buf = NULL;
+    scrub_buf = NULL;
+    B.attached = 0;
+    UNLOCK();
+}
+
+void backing_begin(DiskOp op) {
+    if (!B.attached) return;
+    cur_op = (int)op;
+    touched = 0;
+    cur_t0 = now_s();
+}
+
+void backing_end() {
+    if (!B.attached || cur_op < 0) return;
+    if (touched) {
+        BackingOpStats* st = &B.ops[cur_op];
+        if (B.sync && fdatasync(fd) != 0) st->errors++;
+        st->calls++;
+        st->seconds += now_s() - cur_t0;
+    }
+    cur_op = -1;
+}
+
+static void fill_block(char* dst, int file_id, int ordinal) {
+    BackingHeader h = { BACKING_MAGIC, file_id, ordinal, 0 };
+    memcpy(dst, &h, sizeof(h));
+    memset(dst + sizeof(h), (file_id * 131 + ordinal) & 0xff, B.block_size - sizeof(h));
+}
+
+int backing_write(const int* blocks, int n, int file_id, int first_ordinal) {
+    if (!B.attached) return 0;
+    int per_call = (int)(BACKING_MAX_IO / B.block_size);
+    int rc = 0;
+    for (int i = 0; i < n;) {
+        // extend the run while block numbers stay consecutive
+        int run = 1;
+        while (i + run < n && run < per_call && blocks[i + run] == blocks[i] + run) run++;
+        LOCK();
+        for (int k = 0; k < run; k++) {
+            char* blk = io_buf + (size_t)k * B.block_size;
+            fill_block(blk, file_id, first_ordinal + i + k);
+            BlockSum* e = &sums[blocks[i + k]];
+            e->crc = (unsigned int)compress_crc32c(0, blk, B.block_size);
+            e->known = 1;
+            e->live = 1;
+            e->flagged = 0;
+        }
+        if (write_all(io_buf, (size_t)run * B.block_size, block_off(blocks[i])) != 0) rc = -1;
+        UNLOCK();
+        i += run;
+    }
+    return rc;
+}
+
+int backing_mark_deleted(const int* blocks, int n, int deleted) {
+    if (!B.attached) return 0;
+    unsigned int flag = deleted ? 1u : 0u;
+    int rc = 0;
+    LOCK();
+    for (int i = 0; i < n; i++) {
+        off_t at = block_off(blocks[i]) + (off_t)offsetof(BackingHeader, deleted);
+        if (write_all(&flag, sizeof(flag), at) != 0) rc = -1;
+        // the checksum covers the live form of the block, deleted == 0
+        BlockSum* e = &sums[blocks[i]];
+        e->live = !deleted && e->known && !e->flagged;
+    }
+    UNLOCK();
+    return rc;
+}
+
+int backing_read_header(int block, BackingHeader* out) {
+    if (!B.attached || block < 0 || block >= B.blocks) return -1;
+    return read_all(out, sizeof(*out), block_off(block));
+}
+
+int backing_restore(const int* blocks, int n, int file_id) {
+    if (!B.attached) return 0;
+    int intact = 0, rc = 0;
+    for (int i = 0; i < n; i++) {
+        BackingHeader h;
+        if (backing_read_header(blocks[i], &h) == 0 && h.magic == BACKING_MAGIC &&
+            h.file_id == file_id && h.ordinal == i && h.deleted) {
+            if (backing_mark_deleted(&blocks[i], 1, 0) != 0) rc = -1;
+            intact++;
+        } else if (backing_write(&blocks[i], 1, file_id, i) != 0) {
+            rc = -1; // reused since the delete: the data is gone, write it again
+        }
+    }
+    return rc != 0 ? -1 : intact;
+}
+
+// Moves len bytes inside the image; dst < src and the caller keeps len at
+// most src - dst so the ranges never overlap
+static int copy_range(off_t src, off_t dst, size_t len) {
+#ifdef __linux__
+    while (B.copy_offload && len > 0) {
+        loff_t in = src, out = dst;
+        ssize_t c = copy_file_range(fd, &in, fd, &out, len, 0);
+        BackingOpStats* st = stats();
+        st->io_calls++;
+        if (c < 0 && errno == EINTR) continue;
+        if (c <= 0) {
+            if (c < 0 && errno != ENOSYS && errno != EXDEV && errno != EINVAL && errno != EOPNOTSUPP) {
+                st->errors++;
+                return -1;
+            }
+            B.copy_offload = 0; // not supported here: copy through memory from now on
+            break;
+        }
+        st->bytes_copied += (unsigned long long)c;
+        src += c;
+        dst += c;
+        len -= (size_t)c;
+    }
+#endif
+    if (len == 0) return 0;
+    if (read_all(io_buf, len, src) != 0) return -1;
+    return write_all(io_buf, len, dst);
+}
+
+int backing_move(int from, int to, int count) {
+    if (!B.attached || count <= 0 || from == to) return 0;
+    int limit = (int)(BACKING_MAX_IO / B.block_size);
+    if (from - to < limit) limit = from - to;
+    int rc = 0;
+    LOCK();
+    for (int done = 0; done < count;) {
+        int c = count - done < limit ? count - done : limit;
+        if (copy_range(block_off(from + done), block_off(to + done), (size_t)c * B.block_size) != 0) rc = -1;
+        for (int k = done; k < done + c; k++) {
+            sums[to + k] = sums[from + k];
+            memset(&sums[from + k], 0, sizeof(BlockSum));
+        }
+        done += c;
+    }
+    UNLOCK();
+    return rc;
+}
+
+// Reads block i back and checks it against its checksum; lock held.
+// Returns 0 if there was nothing to check, 1 if it matched, -1 if not.
+static int verify_block(int i) {
+    BlockSum* e = &sums[i];
+    if (!e->live || e->flagged) return 0;
+    size_t got = 0;
+    while (got < B.block_size) {
+        ssize_t r = pread(fd, scrub_buf + got, B.block_size - got, block_off(i) + (off_t)got);
+        if (r < 0 && errno == EINTR) continue;
+        if (r <= 0) break;
+        got += (size_t)r;
+    }
+    B.scrub.blocks_verified++;
+    if (got == B.block_size && compress_crc32c(0, scrub_buf, B.block_size) == e->crc) return 1;
+    e->flagged = 1;
+    e->live = 0;
+    B.scrub.mismatches++;
+    if (mismatch_count < DISK_MAX_BLOCKS) {
+        mismatched[mismatch_count] = i;
+        __atomic_store_n(&mismatch_count, mismatch_count + 1, __ATOMIC_RELAXED);
+    }
+    return -1;
+}
+
+static void sleep_s(double s) {
+    if (s <= 0) return;
+    struct timespec ts = { (time_t)s, (long)((s - (double)(time_t)s) * 1e9) };
+    nanosleep(&ts, NULL);
+}
+
+int backing_scrub_pass(double bytes_per_sec) {
+    if (!B.attached) return 0;
+    int found = 0;
+    for (int i = 0; i < B.blocks; i++) {
+        LOCK();
+        int v = verify_block(i);
+        UNLOCK();
+        if (v < 0) found++;
+        if (v != 0 && bytes_per_sec > 0) sleep_s((double)B.block_size / bytes_per_sec);
+    }
+    LOCK();
+    B.scrub.passes++;
+    B.scrub.last_pass_ms = utils_now_ms();
+    UNLOCK();
+    return found;
+}
+
+int backing_verify(const int* blocks, int n) {
+    if (!B.attached) return 0;
+    int found = 0;
+    LOCK();
+    for (int k = 0; k < n; k++) {
+        if (blocks[k] >= 0 && blocks[k] < B.blocks && verify_block(blocks[k]) < 0) found++;
+    }
+    UNLOCK();
+    return found;
+}
+
+static pthread_t scrub_thread;
+static pthread_cond_t scrub_cv = PTHREAD_COND_INITIALIZER;
+static int scrub_stop = 0;
+
+// Sweeps block after block, pacing each read to the rate; a sweep that
+// found nothing to check waits a second before the next one
+static void* scrub_main(void* arg) {
+    int cursor = 0, checked = 0;
+    LOCK();
+    while (!scrub_stop) {
+        int v = verify_block(cursor);
+        if (v != 0) checked++;
+        double wait = v != 0 ? (double)B.block_size / B.scrub.bytes_per_sec : 0;
+        if (++cursor >= B.blocks) {
+            cursor = 0;
+            B.scrub.passes++;
+            B.scrub.last_pass_ms = utils_now_ms();
+            if (checked == 0) wait = 1.0;
+            checked = 0;
+        }
+        if (wait <= 0) continue;
+        struct timespec deadline;
+        clock_gettime(CLOCK_REALTIME, &deadline);
+        deadline.tv_sec += (time_t)wait;
+        deadline.tv_nsec += (long)((wait - (double)(time_t)wait) * 1e9);
+        if (deadline.tv_nsec >= 1000000000L) { deadline.tv_sec++; deadline.tv_nsec -= 1000000000L; }
+        while (!scrub_stop) {
+            if (pthread_cond_timedwait(&scrub_cv, &lock, &deadline) == ETIMEDOUT) break;
+        }
+    }
+    UNLOCK();
+    return NULL;
+}
+
+int backing_scrub_start(double bytes_per_sec) {
+    if (!B.attached || bytes_per_sec <= 0) return -1;
+    backing_scrub_stop();
+    LOCK();
+    scrub_stop = 0;
+    B.scrub.bytes_per_sec = bytes_per_sec;
+    B.scrub.running = pthread_create(&scrub_thread, NULL, scrub_main, NULL) == 0;
+    int ok = B.scrub.running;
+    UNLOCK();
+    return ok ? 0 : -1;
+}
+
+void backing_scrub_stop() {
+    LOCK();
+    int running = B.scrub.running;
+    scrub_stop = 1;
+    pthread_cond_signal(&scrub_cv);
+    UNLOCK();
+    if (!running) return;
+    pthread_join(scrub_thread, NULL);
+    LOCK();
+    B.scrub.running = 0;
+    UNLOCK();
+}
+
+int backing_corrupt(int block) {
+    if (!B.attached || block < 0 || block >= B.blocks) return -1;
+    LOCK();
+    int rc = -1;
+    if (sums[block].live) {
+        // flip a run of bytes past the header, as a media error would
+        size_t len = B.block_size / 8;
+        off_t at = block_off(block) + (off_t)(B.block_size / 2);
+        rc = read_all(io_buf, len, at);
+        for (size_t k = 0; rc == 0 && k < len; k++) io_buf[k] = (char)~io_buf[k];
+        if (rc == 0) rc = write_all(io_buf, len, at);
+    }
+    UNLOCK();
+    return rc;
+}
+#endif
@@ -0,0 +1,410 @@
+#define _POSIX_C_SOURCE 200809L
+#include "compress.h"
+#include <stdlib.h>
+#include <string.h>
+#include <stdint.h>
+
+#define WSIZE 32768
+#define WMASK (WSIZE - 1)
+#define HASH_BITS 15
+#define HASH_SIZE (1 << HASH_BITS)
+#define MIN_MATCH 3
+#define MAX_MATCH 258
+
+// Fixed Huffman tables (RFC 1951, 3.2.6), stored bit-reversed because the
+// stream is written LSB first
+static uint16_t lit_code[288];
+static uint8_t lit_bits[288];
+static uint8_t dist_code_rev[30];
+static uint8_t len_index[MAX_MATCH + 1];  // match length -> length code index
+static uint8_t dist_index[512];           // see dist_code()
+static uint32_t crc_table[256];
+static int tables_ready = 0;
+
+static const uint16_t LEN_BASE[29] = {
+    3, 4, 5, 6, 7, 8, 9, 10, 11, 13, 15, 17, 19, 23, 27, 31,
+    35, 43, 51, 59, 67, 83, 99, 115, 131, 163, 195, 227, 258
+};
+static const uint8_t LEN_EXTRA[29] = {
+    0, 0, 0, 0, 0, 0, 0, 0, 1, 1, 1, 1, 2, 2, 2, 2,
+    3, 3, 3, 3, 4, 4, 4, 4, 5, 5, 5, 5, 0
+};
+static const uint16_t DIST_BASE[30] = {
+    1, 2, 3, 4, 5, 7, 9, 13, 17, 25, 33, 49, 65, 97, 129, 193,
+    257, 385, 513, 769, 1025, 1537, 2049, 3073, 4097, 6145, 8193, 12289, 16385, 24577
+};
+static const uint8_t DIST_EXTRA[30] = {
+    0, 0, 0, 0, 1, 1, 2, 2, 3, 3, 4, 4, 5, 5, 6, 6,
+    7, 7, 8, 8, 9, 9, 10, 10, 11, 11, 12, 12, 13, 13
+};
+
+// Per level: max hash chain length and "good enough" match length
+static const int CHAIN_LIMIT[10] = { 0, 4, 8, 16, 32, 64, 128, 256, 1024, 4096 };
+static const int NICE_LENGTH[10] = { 0, 8, 16, 32, 64, 128, 128, 258, 258, 258 };
+
+static unsigned reverse_bits(unsigned v, int n) {
+    unsigned r = 0;
+    for (int i = 0; i < n; i++) { r = (r << 1) | (v & 1); v >>= 1; }
+    return r;
+}
+
+static void init_tables() {
+    if (tables_ready) return;
+    for (int s = 0; s < 288; s++) {
+        unsigned code; int bits;
+        if (s < 144)      { code = 0x30 + s;          bits = 8; }
+        else if (s < 256) { code = 0x190 + (s - 144); bits = 9; }
+        else if (s < 280) { code = s - 256;           bits = 7; }
+        else              { code = 0xC0 + (s - 280);  bits = 8; }
+        lit_code[s] = (uint16_t)reverse_bits(code, bits);
+        lit_bits[s] = (uint8_t)bits;
+    }
+    for (int c = 0; c < 30; c++) dist_code_rev[c] = (uint8_t)reverse_bits((unsigned)c, 5);
+    for (int i = 0, l = MIN_MATCH; l <= MAX_MATCH; l++) {
+        while (i + 1 < 29 && LEN_BASE[i + 1] <= l) i++;
+        len_index[l] = (uint8_t)i;
+    }
+    // distances 1..256 indexed directly by (dist - 1), larger ones by
+    // 256 + ((dist - 1) >> 7), as in zlib
+    for (int c = 0; c < 30; c++) {
+        for (int d = DIST_BASE[c]; d < DIST_BASE[c] + (1 << DIST_EXTRA[c]) && d <= 32768; d++) {
+            if (d <= 256) dist_index[d - 1] = (uint8_t)c;
+            else dist_index[256 + ((d - 1) >> 7)] = (uint8_t)c;
+        }
+    }
+    for (uint32_t n = 0; n < 256; n++) {
+        uint32_t c = n;
+        for (int k = 0; k < 8; k++) c = (c & 1) ? 0xEDB88320u ^ (c >> 1) : c >> 1;
+        crc_table[n] = c;
+    }
+    tables_ready = 1;
+}
+
+static int dist_code(int dist) {
+    return dist <= 256 ? dist_index[dist - 1] : dist_index[256 + ((dist - 1) >> 7)];
+}
+
+unsigned long compress_crc32(unsigned long crc, const void* data, size_t len) {
+    init_tables();
+    const unsigned char* p = (const unsigned char*)data;
+    uint32_t c = (uint32_t)crc ^ 0xFFFFFFFFu;
+    for (size_t i = 0; i < len; i++) c = crc_table[(c ^ p[i]) & 0xFF] ^ (c >> 8);
+    return (unsigned long)(c ^ 0xFFFFFFFFu);
+}
+
+// CRC-32C (Castagnoli, reflected 0x82F63B78): SSE4.2 and ARMv8 have an
+// instruction for it. The software table is a constant so that any thread
+// may call this without setup.
+static const uint32_t CRC32C_TABLE[256] = {
+    0x00000000u, 0xf26b8303u, 0xe13b70f7u, 0x1350f3f4u, 0xc79a971fu, 0x35f1141cu,
+    0x26a1e7e8u, 0xd4ca64ebu, 0x8ad958cfu, 0x78b2dbccu, 0x6be22838u, 0x9989ab3bu,
+    0x4d43cfd0u, 0xbf284cd3u, 0xac78bf27u, 0x5e133c24u, 0x105ec76fu, 0xe235446cu,
+    0xf165b798u, 0x030e349bu, 0xd7c45070u, 0x25afd373u, 0x36ff2087u, 0xc494a384u,
+    0x9a879fa0u, 0x68ec1ca3u, 0x7bbcef57u, 0x89d76c54u, 0x5d1d08bfu, 0xaf768bbcu,
+    0xbc267848u, 0x4e4dfb4bu, 0x20bd8edeu, 0xd2d60dddu, 0xc186fe29u, 0x33ed7d2au,
+    0xe72719c1u, 0x154c9ac2u, 0x061c6936u, 0xf477ea35u, 0xaa64d611u, 0x580f5512u,
+    0x4b5fa6e6u, 0xb93425e5u, 0x6dfe410eu, 0x9f95c20du, 0x8cc531f9u, 0x7eaeb2fau,
+    0x30e349b1u, 0xc288cab2u, 0xd1d83946u, 0x23b3ba45u, 0xf779deaeu, 0x05125dadu,
+    0x1642ae59u, 0xe4292d5au, 0xba3a117eu, 0x4851927du, 0x5b016189u, 0xa96ae28au,
+    0x7da08661u, 0x8fcb0562u, 0x9c9bf696u, 0x6ef07595u, 0x417b1dbcu, 0xb3109ebfu,
+    0xa0406d4bu, 0x522bee48u, 0x86e18aa3u, 0x748a09a0u, 0x67dafa54u, 0x95b17957u,
+    0xcba24573u, 0x39c9c670u, 0x2a993584u, 0xd8f2b687u, 0x0c38d26cu, 0xfe53516fu,
+    0xed03a29bu, 0x1f682198u, 0x5125dad3u, 0xa34e59d0u, 0xb01eaa24u, 0x42752927u,
+    0x96bf4dccu, 0x64d4cecfu, 0x77843d3bu, 0x85efbe38u, 0xdbfc821cu, 0x2997011fu,
+    0x3ac7f2ebu, 0xc8ac71e8u, 0x1c661503u, 0xee0d9600u, 0xfd5d65f4u, 0x0f36e6f7u,
+    0x61c69362u, 0x93ad1061u, 0x80fde395u, 0x72966096u, 0xa65c047du, 0x5437877eu,
+    0x4767748au, 0xb50cf789u, 0xeb1fcbadu, 0x197448aeu, 0x0a24bb5au, 0xf84f3859u,
+    0x2c855cb2u, 0xdeeedfb1u, 0xcdbe2c45u, 0x3fd5af46u, 0x7198540du, 0x83f3d70eu,
+    0x90a324fau, 0x62c8a7f9u, 0xb602c312u, 0x44694011u, 0x5739b3e5u, 0xa55230e6u,
+    0xfb410cc2u, 0x092a8fc1u, 0x1a7a7c35u, 0xe811ff36u, 0x3cdb9bddu, 0xceb018deu,
+    0xdde0eb2au, 0x2f8b6829u, 0x82f63b78u, 0x709db87bu, 0x63cd4b8fu, 0x91a6c88cu,
+    0x456cac67u, 0xb7072f64u, 0xa457dc90u, 0x563c5f93u, 0x082f63b7u, 0xfa44e0b4u,
+    0xe9141340u, 0x1b7f9043u, 0xcfb5f4a8u, 0x3dde77abu, 0x2e8e845fu, 0xdce5075cu,
+    0x92a8fc17u, 0x60c37f14u, 0x73938ce0u, 0x81f80fe3u, 0x55326b08u, 0xa759e80bu,
+    0xb4091bffu, 0x466298fcu, 0x1871a4d8u, 0xea1a27dbu, 0xf94ad42fu, 0x0b21572cu,
+    0xdfeb33c7u, 0x2d80b0c4u, 0x3ed04330u, 0xccbbc033u, 0xa24bb5a6u, 0x502036a5u,
+    0x4370c551u, 0xb11b4652u, 0x65d122b9u, 0x97baa1bau, 0x84ea524eu, 0x7681d14du,
+    0x2892ed69u, 0xdaf96e6au, 0xc9a99d9eu, 0x3bc21e9du, 0xef087a76u, 0x1d63f975u,
+    0x0e330a81u, 0xfc588982u, 0xb21572c9u, 0x407ef1cau, 0x532e023eu, 0xa145813du,
+    0x758fe5d6u, 0x87e466d5u, 0x94b49521u, 0x66df1622u, 0x38cc2a06u, 0xcaa7a905u,
+    0xd9f75af1u, 0x2b9cd9f2u, 0xff56bd19u, 0x0d3d3e1au, 0x1e6dcdeeu, 0xec064eedu,
+    0xc38d26c4u, 0x31e6a5c7u, 0x22b65633u, 0xd0ddd530u, 0x0417b1dbu, 0xf67c32d8u,
+    0xe52cc12cu, 0x1747422fu, 0x49547e0bu, 0xbb3ffd08u, 0xa86f0efcu, 0x5a048dffu,
+    0x8ecee914u, 0x7ca56a17u, 0x6ff599e3u, 0x9d9e1ae0u, 0xd3d3e1abu, 0x21b862a8u,
+    0x32e8915cu, 0xc083125fu, 0x144976b4u, 0xe622f5b7u, 0xf5720643u, 0x07198540u,
+    0x590ab964u, 0xab613a67u, 0xb831c993u, 0x4a5a4a90u, 0x9e902e7bu, 0x6cfbad78u,
+    0x7fab5e8cu, 0x8dc0dd8fu, 0xe330a81au, 0x115b2b19u, 0x020bd8edu, 0xf0605beeu,
+    0x24aa3f05u, 0xd6c1bc06u, 0xc5914ff2u, 0x37faccf1u, 0x69e9f0d5u, 0x9b8273d6u,
+    0x88d28022u, 0x7ab90321u, 0xae7367cau, 0x5c18e4c9u, 0x4f48173du, 0xbd23943eu,
+    0xf36e6f75u, 0x0105ec76u, 0x12551f82u, 0xe03e9c81u, 0x34f4f86au, 0xc69f7b69u,
+    0xd5cf889du, 0x27a40b9eu, 0x79b737bau, 0x8bdcb4b9u, 0x988c474du, 0x6ae7c44eu,
+    0xbe2da0a5u, 0x4c4623a6u, 0x5f16d052u, 0xad7d5351u
+};
+
+static uint32_t crc32c_soft(uint32_t c, const unsigned char* p, size_t len) {
+    while (len--) c = CRC32C_TABLE[(c ^ *p++) & 0xFF] ^ (c >> 8);
+    return c;
+}
+
+#if defined(__x86_64__) && defined(__GNUC__)
+#define CRC32C_HW "sse4.2"
+__attribute__((target("sse4.2")))
+static uint32_t crc32c_hw(uint32_t c, const unsigned char* p, size_t len) {
+    uint64_t c64 = c;
+    for (; len >= 8; p += 8, len -= 8) {
+        uint64_t v;
+        memcpy(&v, p, 8);
+        c64 = __builtin_ia32_crc32di(c64, v);
+    }
+    c = (uint32_t)c64;
+    while (len--) c = __builtin_ia32_crc32qi(c, *p++);
+    return c;
+}
+
+static int crc32c_hw_ok() {
+    return __builtin_cpu_supports("sse4.2");
+}
+#elif defined(__aarch64__) && defined(__ARM_FEATURE_CRC32)
+#include <arm_acle.h>
+#define CRC32C_HW "armv8-crc"
+static uint32_t crc32c_hw(uint32_t c, const unsigned char* p, size_t len) {
+    for (; len >= 8; p += 8, len -= 8) {
+        uint64_t v;
+        memcpy(&v, p, 8);
+        c = __crc32cd(c, v);
+    }
+    while (len--) c = __crc32cb(c, *p++);
+    return c;
+}
+
+static int crc32c_hw_ok() {
+    return 1;
+}
+#endif
+
+unsigned long compress_crc32c(unsigned long crc, const void* data, size_t len) {
+    const unsigned char* p = (const unsigned char*)data;
+    uint32_t c = (uint32_t)crc ^ 0xFFFFFFFFu;
+#ifdef CRC32C_HW
+    if (crc32c_hw_ok()) return (unsigned long)(crc32c_hw(c, p, len) ^ 0xFFFFFFFFu);
+#endif
+    return (unsigned long)(crc32c_soft(c, p, len) ^ 0xFFFFFFFFu);
+}
+
+const char* compress_crc32c_impl() {
+#ifdef CRC32C_HW
+    if (crc32c_hw_ok()) return CRC32C_HW;
+#endif
+    return "software";
+}
+
+unsigned long compress_adler32(unsigned long adler, const void* data, size_t len) {
+    const unsigned char* p = (const unsigned char*)data;
+    uint32_t a = (uint32_t)(adler & 0xFFFF), b = (uint32_t)((adler >> 16) & 0xFFFF);
+    while (len > 0) {
+        // 5552 is the largest run that cannot overflow 32 bits
+        size_t n = len < 5552 ? len : 5552;
+        len -= n;
+        while (n--) { a += *p++; b += a; }
+        a %= 65521;
+        b %= 65521;
+    }
+    return ((unsigned long)b << 16) | a;
+}
+
+// LSB-first bit writer over pre-reserved StrBuf space
+typedef struct {
+    unsigned char* p;
+    uint64_t bits;
+    int nbits;
+} BitWriter;
+
+static void put_bits(BitWriter* w, uint32_t value, int n) {
+    w->bits |= (uint64_t)value << w->nbits;
+    w->nbits += n;
+    while (w->nbits >= 8) {
+        *w->p++ = (unsigned char)w->bits;
+        w->bits >>= 8;
+        w->nbits -= 8;
+    }
+}
+
+static void put_literal(BitWriter* w, unsigned char c) {
+    put_bits(w, lit_code[c], lit_bits[c]);
+}
+
+static void put_match(BitWriter* w, int len, int dist) {
+    int li = len_index[len];
+    int sym = 257 + li;
+    put_bits(w, lit_code[sym], lit_bits[sym]);
+    if (LEN_EXTRA[li]) put_bits(w, (uint32_t)(len - LEN_BASE[li]), LEN_EXTRA[li]);
+    int dc = dist_code(dist);
+    put_bits(w, dist_code_rev[dc], 5);
+    if (DIST_EXTRA[dc]) put_bits(w, (uint32_t)(dist - DIST_BASE[dc]), DIST_EXTRA[dc]);
+}
+
+static uint32_t hash3(const unsigned char* p) {
+    uint32_t v = (uint32_t)p[0] | ((uint32_t)p[1] << 8) | ((uint32_t)p[2] << 16);
+    return (v * 2654435761u) >> (32 - HASH_BITS);
+}
+
+// Insert pos into the hash chains and return the longest earlier match
+static int longest_match(Deflater* d, const unsigned char* in, size_t len, size_t pos, int* out_dist) {
+    if (pos + MIN_MATCH > len) return 0;
+    uint32_t h = hash3(in + pos);
+    int cand = d->head[h];
+    d->prev[pos & WMASK] = cand;
+    d->head[h] = (int)pos;
+
+    int max_len = (int)(len - pos < MAX_MATCH ? len - pos : MAX_MATCH);
+    int nice = NICE_LENGTH[d->level] < max_len ? NICE_LENGTH[d->level] : max_len;
+    int chain = CHAIN_LIMIT[d->level];
+    int best = 0;
+    const unsigned char* cur = in + pos;
+    while (cand >= 0 && (int)pos - cand <= WSIZE && chain-- > 0) {
+        const unsigned char* m = in + cand;
+        if (m[best] == cur[best] && m[0] == cur[0] && m[1] == cur[1]) {
+            int l = 2;
+            while (l < max_len && m[l] == cur[l]) l++;
+            if (l > best) {
+                best = l;
+                *out_dist = (int)pos - cand;
+                if (l >= nice) break;
+            }
+        }
+        int next = d->prev[cand & WMASK];
+        if (next >= cand) break; // slot reused by a newer position
+        cand = next;
+    }
+    return best >= MIN_MATCH ? best : 0;
+}
+
+static void insert_hash(Deflater* d, const unsigned char* in, size_t len, size_t pos) {
+    if (pos + MIN_MATCH > len) return;
+    uint32_t h = hash3(in + pos);
+    d->prev[pos & WMASK] = d->head[h];
+    d->head[h] = (int)pos;
+}
+
+// Encode in[0..len) as a single final fixed-Huffman block
+static void deflate_block(Deflater* d, const unsigned char* in, size_t len, BitWriter* w) {
+    memset(d->head, 0xFF, sizeof(int) * HASH_SIZE);
+    put_bits(w, 1, 1); // BFINAL
+    put_bits(w, 1, 2); // BTYPE = 01, fixed Huffman
+
+    int lazy = d->level >= 4;
+    int insert_all = d->level >= 2;
+    size_t pos = 0;
+    int prev_len = 0, prev_dist = 0;
+    while (pos < len) {
+        int dist = 0;
+        int mlen = longest_match(d, in, len, pos, &dist);
+        if (lazy && prev_len) {
+            if (mlen > prev_len) {
+                // the match one byte later is better: emit the skipped byte
+                put_literal(w, in[pos - 1]);
+                prev_len = mlen;
+                prev_dist = dist;
+                pos++;
+                continue;
+            }
+            put_match(w, prev_len, prev_dist);
+            size_t end = pos - 1 + (size_t)prev_len;
+            for (size_t p = pos + 1; p < end; p++) insert_hash(d, in, len, p);
+            pos = end;
+            prev_len = 0;
+            continue;
+        }
+        if (mlen == 0) {
+            put_literal(w, in[pos]);
+            pos++;
+        } else if (lazy) {
+            prev_len = mlen;
+            prev_dist = dist;
+            pos++;
+        } else {
+            put_match(w, mlen, dist);
+            if (insert_all) {
+                for (size_t p = pos + 1; p < pos + (size_t)mlen; p++) insert_hash(d, in, len, p);
+            }
+            pos += (size_t)mlen;
+        }
+    }
+    if (prev_len) put_match(w, prev_len, prev_dist);
+    put_bits(w, lit_code[256], lit_bits[256]); // end of block
+    if (w->nbits > 0) put_bits(w, 0, 8 - w->nbits);
+}
+
+int deflater_init(Deflater* d, int level) {
+    if (!d) return -1;
+    init_tables();
+    if (level < COMPRESS_LEVEL_MIN) level = COMPRESS_LEVEL_MIN;
+    if (level > COMPRESS_LEVEL_MAX) level = COMPRESS_LEVEL_MAX;
+    d->level = level;
+    d->head = (int*)malloc(sizeof(int) * HASH_SIZE);
+    d->prev = (int*)malloc(sizeof(int) * WSIZE);
+    if (!d->head || !d->prev || sb_init(&d->in, 4096) != 0) {
+        free(d->head);
+        free(d->prev);
+        d->head = d->prev = NULL;
+        return -1;
+    }
+    return 0;
+}
+
+void deflater_free(Deflater* d) {
+    if (!d) return;
+    free(d->head);
+    free(d->prev);
+    d->head = d->prev = NULL;
+    sb_free(&d->in);
+}
+
+void deflater_begin(Deflater* d) {
+    sb_reset(&d->in);
+}
+
+int deflater_write(Deflater* d, const void* data, size_t len) {
+    return sb_append_n(&d->in, (const char*)data, len);
+}
+
+static void put_le32(unsigned char* p, unsigned long v) {
+    p[0] = (unsigned char)v; p[1] = (unsigned char)(v >> 8);
+    p[2] = (unsigned char)(v >> 16); p[3] = (unsigned char)(v >> 24);
+}
+
+int deflater_finish(Deflater* d, CompressFormat fmt, StrBuf* out) {
+    if (!d || !d->head || !out) return -1;
+    const unsigned char* in = (const unsigned char*)d->in.buf;
+    size_t len = d->in.len;
+    // fixed Huffman never exceeds 9 bits per literal
+    if (sb_reserve(out, len + len / 8 + 64) != 0) return -1;
+
+    unsigned char* start = (unsigned char*)out->buf + out->len;
+    unsigned char* p = start;
+    if (fmt == COMPRESS_GZIP) {
+        static const unsigned char GZIP_HEADER[10] = { 0x1f, 0x8b, 8, 0, 0, 0, 0, 0, 0, 0xff };
+        memcpy(p, GZIP_HEADER, sizeof(GZIP_HEADER));
+        p += sizeof(GZIP_HEADER);
+    } else {
+        *p++ = 0x78;
+        *p++ = d->level <= 1 ? 0x01 : (d->level >= 8 ? 0xDA : 0x9C);
+    }
+
+    BitWriter w = { p, 0, 0 };
+    deflate_block(d, in, len, &w);
+    p = w.p;
+
+    if (fmt == COMPRESS_GZIP) {
+        put_le32(p, compress_crc32(0, in, len));
+        put_le32(p + 4, (unsigned long)(len & 0xFFFFFFFFu));
+        p += 8;
+    } else {
+        unsigned long a = compress_adler32(1, in, len);
+        *p++ = (unsigned char)(a >> 24); *p++ = (unsigned char)(a >> 16);
+        *p++ = (unsigned char)(a >> 8);  *p++ = (unsigned char)a;
+    }
+    out->len += (size_t)(p - start);
+    out->buf[out->len] = '\0';
+    return 0;
+}
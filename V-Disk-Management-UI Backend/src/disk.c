@@ -1,23 +1,172 @@
 #define _POSIX_C_SOURCE 200809L
 #include "../include/disk.h"
 #include "../include/utils.h"
+#include "../include/json.h"
+#include "../include/persist.h"
+#include "../include/compress.h"
+#include "../include/backing.h"
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
-#include <stdarg.h>
 static Disk G;
 
+// Append-only binary event log next to the snapshot ("<persist_path>.log"),
+// written by persist.c from the copy of the ring each disk_save() captures
+static unsigned log_epoch = 0; // bumped when the ring is cleared
+
+// Regions of DISK_REGION_BLOCKS blocks changed since the last disk_save();
+// checkpoints write only these. dirty_all forces a full snapshot.
+static unsigned char region_dirty[DISK_REGIONS];
+static int dirty_all = 1;
+
+// Indexes over the log ring. Each event links to the previous event with
+// the same op / file id by sequence number (-1 = none); chains are only
+// followed while the sequence is still inside the ring.
+static int log_prev_op[DISK_MAX_LOGS];
+static int log_prev_file[DISK_MAX_LOGS];
+static int log_last_op[DISK_OP_COUNT];
+static int log_last_file[DISK_MAX_BLOCKS];
+static long long log_last_ts = 0; // timestamps are kept non-decreasing
+
+static const char* OP_NAMES[DISK_OP_COUNT] = {
+    "disk_init", "disk_load", "disk_reset",
+    "allocate_contiguous", "allocate_fragmented", "allocate_custom",
+    "delete", "undelete_last", "defragment", "mark_bad", "repair"
+};
+
+static void log_index_reset() {
+    for (int i = 0; i < DISK_OP_COUNT; i++) log_last_op[i] = -1;
+    for (int i = 0; i < DISK_MAX_BLOCKS; i++) log_last_file[i] = -1;
+    log_last_ts = 0;
+}
+
+static void log_index_add(int seq) {
+    int idx = seq % DISK_MAX_LOGS;
+    const DiskLogEvent* e = &G.logs[idx];
+    log_prev_op[idx] = log_last_op[e->op];
+    log_last_op[e->op] = seq;
+    if (e->file_id > 0 && e->file_id < DISK_MAX_BLOCKS) {
+        log_prev_file[idx] = log_last_file[e->file_id];
+        log_last_file[e->file_id] = seq;
+    } else {
+        log_prev_file[idx] = -1;
+    }
+    if (e->timestamp_ms > log_last_ts) log_last_ts = e->timestamp_ms;
+}
+
+static DiskMutationHook mutation_hook = NULL;
+static void* mutation_hook_ctx = NULL;
+static unsigned long generation = 0;
+
 // Internal helpers
-static void logf(const char* fmt, ...) {
-    va_list ap;
-    va_start(ap, fmt);
-    char line[DISK_LOG_MSG_LEN];
-    vsnprintf(line, sizeof(line), fmt, ap);
-    va_end(ap);
-    int idx = G.log_head % DISK_MAX_LOGS;
-    strncpy(G.logs[idx], line, DISK_LOG_MSG_LEN - 1);
-    G.logs[idx][DISK_LOG_MSG_LEN - 1] = '\0';
+static void notify_mutation() {
+    generation++;
+    if (mutation_hook) mutation_hook(mutation_hook_ctx);
+}
+
+// Every state change records exactly one event, so this is also where
+// mutation hooks fire; the record is complete before they do
+static void log_event_ex(DiskOp op, int file_id, int size, int start, int count,
+                         AllocStrategy strategy, unsigned short flags) {
+    DiskLogEvent* e = &G.logs[G.log_head % DISK_MAX_LOGS];
+    long long now = utils_now_ms();
+    e->timestamp_ms = now < log_last_ts ? log_last_ts : now;
+    e->op = (unsigned char)op;
+    e->strategy = (unsigned char)strategy;
+    e->flags = flags;
+    e->file_id = file_id;
+    e->size = size;
+    e->start = start;
+    e->count = count;
+    log_index_add(G.log_head);
     G.log_head++;
+    notify_mutation();
+}
+
+static void log_event(DiskOp op, int file_id, int size, int start, int count) {
+    log_event_ex(op, file_id, size, start, count, STRATEGY_FIRST_FIT, 0);
+}
+
+static AllocStrategy parse_strategy(const char* strategy) {
+    if (strategy && strcmp(strategy, "best-fit") == 0) return STRATEGY_BEST_FIT;
+    if (strategy && strcmp(strategy, "worst-fit") == 0) return STRATEGY_WORST_FIT;
+    return STRATEGY_FIRST_FIT;
+}
+
+static const char* strategy_name(int strategy) {
+    switch (strategy) {
+        case STRATEGY_BEST_FIT: return "best-fit";
+        case STRATEGY_WORST_FIT: return "worst-fit";
+        default: return "first-fit";
+    }
+}
+
+static int format_event(const DiskLogEvent* e, char* out, size_t out_len) {
+    switch (e->op) {
+        case DISK_OP_INIT:
+            // the persist path can change after the fact, so events do not name it
+            return snprintf(out, out_len, "disk_init: blocks=%d", e->size);
+        case DISK_OP_LOAD:
+            return snprintf(out, out_len, "disk_load: loaded snapshot");
+        case DISK_OP_RESET:
+            return snprintf(out, out_len, "disk_reset: disk reinitialized");
+        case DISK_OP_ALLOC_CONTIGUOUS:
+            return snprintf(out, out_len, "allocate_contiguous: id=%d size=%d start=%d", e->file_id, e->size, e->start);
+        case DISK_OP_ALLOC_FRAGMENTED:
+            return snprintf(out, out_len, "allocate_fragmented: id=%d size=%d", e->file_id, e->size);
+        case DISK_OP_ALLOC_CUSTOM:
+            return snprintf(out, out_len, "allocate_custom: id=%d size=%d strategy=%s start=%d",
+                            e->file_id, e->size, strategy_name(e->strategy), e->start);
+        case DISK_OP_DELETE:
+            if (e->count == 0) return snprintf(out, out_len, "delete: id=%d (no blocks)", e->file_id);
+            return snprintf(out, out_len, "delete: id=%d freed=%d blocks", e->file_id, e->count);
+        case DISK_OP_UNDELETE:
+            return snprintf(out, out_len, "undelete_last: id=%d restored=%d blocks", e->file_id, e->count);
+        case DISK_OP_DEFRAGMENT:
+            return snprintf(out, out_len, "defragment: compacted used blocks to front (used=%d)", e->count);
+        case DISK_OP_MARK_BAD:
+            if (e->flags & DISK_EVENT_IMAGE_FAULT)
+                return snprintf(out, out_len, "mark_bad: requested=%d corrupted=%d in image", e->size, e->count);
+            return snprintf(out, out_len, "mark_bad: requested=%d marked=%d", e->size, e->count);
+        case DISK_OP_REPAIR:
+            return snprintf(out, out_len, "repair: repaired=%d bad->free", e->count);
+        default:
+            return snprintf(out, out_len, "unknown: op=%d", (int)e->op);
+    }
+}
+
+const char* disk_op_name(int op) {
+    if (op < 0 || op >= DISK_OP_COUNT) return "unknown";
+    return OP_NAMES[op];
+}
+
+int disk_op_from_name(const char* name) {
+    if (!name) return -1;
+    for (int i = 0; i < DISK_OP_COUNT; i++) {
+        if (strcmp(name, OP_NAMES[i]) == 0) return i;
+    }
+    return -1;
+}
+
+// Drop the on-disk log (used when the in-memory ring is cleared); the
+// writer starts the file over with the next snapshot
+static void log_truncate() {
+    log_epoch++;
+}
+
+// Load the newest events from the log file into the ring
+static int log_load() {
+    log_index_reset();
+    int r = persist_log_load(G.logs, &G.log_first, &G.log_head);
+    for (int seq = G.log_first; seq < G.log_head; seq++) log_index_add(seq);
+    return r;
+}
+
+// All block changes after load go through here so checkpoints see them
+static void set_block(int i, BlockState state, int owner) {
+    G.state[i] = state;
+    G.owner[i] = owner;
+    region_dirty[i / DISK_REGION_BLOCKS] = 1;
 }
 
 static void clear_disk() {
@@ -31,7 +180,9 @@ static void clear_disk() {
         G.files[i].status = FILE_UNUSED;
     }
     G.next_file_id = 1;
-    G.log_head = 0;
+    dirty_all = 1;
+    G.log_first = G.log_head; // sequence numbers keep counting
+    log_index_reset();
     G.last_deleted.valid = 0;
 }
 
@@ -40,66 +191,111 @@ static void ensure_initialized() {
         memset(&G, 0, sizeof(G));
         clear_disk();
         strncpy(G.persist_path, "disk_state.json", sizeof(G.persist_path)-1);
+        G.seed = utils_seed_from_env("RAND_SEED");
+        utils_rand_seed(&G.rng, G.seed);
         G.initialized = 1;
     }
 }
 
 int disk_init(const char* persist_path) {
+    return disk_init_ex(persist_path, DURABILITY_RENAME);
+}
+
+int disk_init_ex(const char* persist_path, Durability durability) {
     ensure_initialized();
     if (persist_path && strlen(persist_path) < sizeof(G.persist_path)) {
         strncpy(G.persist_path, persist_path, sizeof(G.persist_path)-1);
     }
-    utils_srand();
+    persist_open(G.persist_path, durability);
     // Try load existing
-    if (disk_load() != 0) {
+    int r = disk_load();
+    if (r == -2) {
+        // keep the damaged snapshot for inspection instead of overwriting it
+        char bad[DISK_PERSIST_PATH_LEN + 16];
+        snprintf(bad, sizeof(bad), "%s.corrupt", G.persist_path);
+        if (rename(G.persist_path, bad) == 0)
+            fprintf(stderr, "disk: snapshot '%s' failed validation, moved to '%s'\n", G.persist_path, bad);
+        else
+            fprintf(stderr, "disk: snapshot '%s' failed validation\n", G.persist_path);
+    }
+    if (r != 0) {
         // fresh disk
         clear_disk();
+        log_truncate();
     }
-    logf("disk_init: blocks=%d persist='%s'", G.blocks, G.persist_path);
+    log_event(DISK_OP_INIT, -1, G.blocks, -1, 0);
     return 0;
 }
 
 int disk_save() {
     ensure_initialized();
-    StrBuf sb;
-    if (sb_init(&sb, 4096) != 0) return -1;
-    sb_append(&sb, "{\n");
-    sb_appendf(&sb, "  \"blocks\": %d,\n", G.blocks);
-    sb_append(&sb, "  \"state\": [");
-    for (int i = 0; i < G.blocks; i++) {
-        sb_appendf(&sb, "%d", (int)G.state[i]);
-        if (i + 1 < G.blocks) sb_append(&sb, ",");
+    DiskSnapshot* snap = persist_begin();
+    snap->blocks = G.blocks;
+    snap->next_file_id = G.next_file_id;
+    // the snapshot mirrors G, so only changed regions need copying
+    for (int r = 0; r < DISK_REGIONS; r++) {
+        if (!dirty_all && !region_dirty[r]) continue;
+        int first = r * DISK_REGION_BLOCKS;
+        int n = DISK_MAX_BLOCKS - first < DISK_REGION_BLOCKS ? DISK_MAX_BLOCKS - first : DISK_REGION_BLOCKS;
+        memcpy(&snap->state[first], &G.state[first], sizeof(G.state[0]) * (size_t)n);
+        memcpy(&snap->owner[first], &G.owner[first], sizeof(G.owner[0]) * (size_t)n);
+        snap->dirty[r] = 1;
+        region_dirty[r] = 0;
     }
-    sb_append(&sb, "],\n  \"owner\": [");
-    for (int i = 0; i < G.blocks; i++) {
-        sb_appendf(&sb, "%d", G.owner[i]);
-        if (i + 1 < G.blocks) sb_append(&sb, ",");
+    if (dirty_all) snap->full = 1;
+    dirty_all = 0;
+    memcpy(snap->files, G.files, sizeof(G.files));
+    // copy only events the mirror has not seen; a reset restarts it
+    if (snap->log_epoch != log_epoch) {
+        snap->log_epoch = log_epoch;
+        snap->log_head = G.log_first;
     }
-    sb_append(&sb, "],\n  \"files\": [");
-    int first = 1;
-    for (int i = 0; i < DISK_MAX_BLOCKS; i++) {
-        if (G.files[i].status != FILE_UNUSED) {
-            if (!first) sb_append(&sb, ",");
-            first = 0;
-            sb_appendf(&sb, "{\"id\":%d,\"status\":%d}", G.files[i].id, (int)G.files[i].status);
-        }
-    }
-    sb_append(&sb, "],\n  \"next_file_id\": ");
-    sb_appendf(&sb, "%d,\n", G.next_file_id);
-    sb_append(&sb, "  \"logs\": [");
-    int count = G.log_head < DISK_MAX_LOGS ? G.log_head : DISK_MAX_LOGS;
-    for (int i = 0; i < count; i++) {
-        int idx = (G.log_head - count + i);
-        if (idx < 0) idx = 0;
-        idx = idx % DISK_MAX_LOGS;
-        sb_appendf(&sb, "\"%s\"", G.logs[idx]);
-        if (i + 1 < count) sb_append(&sb, ",");
+    snap->log_first = G.log_first;
+    int from = snap->log_head;
+    if (G.log_head - from > DISK_MAX_LOGS) from = G.log_head - DISK_MAX_LOGS;
+    for (int seq = from; seq < G.log_head; seq++) {
+        snap->logs[seq % DISK_MAX_LOGS] = G.logs[seq % DISK_MAX_LOGS];
     }
-    sb_append(&sb, "]\n}\n");
-    char* content = sb_take(&sb);
-    int r = write_text_file_atomic(G.persist_path, content);
-    free(content);
-    return r;
+    snap->log_head = G.log_head;
+    return persist_commit();
+}
+
+void disk_seed(uint64_t seed) {
+    ensure_initialized();
+    G.seed = seed;
+    utils_rand_seed(&G.rng, seed);
+}
+
+uint64_t disk_get_seed() {
+    ensure_initialized();
+    return G.seed;
+}
+
+int disk_set_persist_mode(DiskPersistMode mode) {
+    return persist_set_mode(mode);
+}
+
+int disk_flush() {
+    return persist_flush();
+}
+
+// Snapshots written by persist.c open with a fixed-width line holding the
+// CRC-32 of everything after it. Files without that line predate it and
+// are accepted as they are.
+#define SNAPSHOT_CRC_PREFIX "{ \"crc32\": \""
+#define SNAPSHOT_CRC_LINE 23
+
+static int snapshot_crc_ok(const char* buf, size_t len) {
+    size_t plen = sizeof(SNAPSHOT_CRC_PREFIX) - 1;
+    if (len < plen || memcmp(buf, SNAPSHOT_CRC_PREFIX, plen) != 0) return 1;
+    if (len < SNAPSHOT_CRC_LINE || memcmp(buf + plen + 8, "\",\n", 3) != 0) return 0;
+    char hex[9];
+    memcpy(hex, buf + plen, 8);
+    hex[8] = '\0';
+    char* end = NULL;
+    unsigned long want = strtoul(hex, &end, 16);
+    if (*end != '\0') return 0;
+    return compress_crc32(0, buf + SNAPSHOT_CRC_LINE, len - SNAPSHOT_CRC_LINE) == want;
 }
 
 int disk_load() {
@@ -107,51 +303,47 @@ int disk_load() {
     if (!file_exists(G.persist_path)) return -1;
     StrBuf in;
     if (read_text_file(G.persist_path, &in) != 0) return -1;
-    // Very naive: assumes same format as save(); no full JSON parsing
-    // Reset then load arrays by scanning tokens
+    if (!snapshot_crc_ok(in.buf, in.len)) {
+        free(in.buf);
+        return -2;
+    }
+    // One pass locates the members; the two block arrays are then parsed
+    // in place, split across threads when they are large enough to pay off.
+    // The "files" array is rebuilt from owner.
+    int blocks = 0, nfid = 0, checkpoint = 0;
+    const char* state_raw = NULL;
+    const char* owner_raw = NULL;
+    int state[DISK_MAX_BLOCKS], owner[DISK_MAX_BLOCKS];
+    size_t nstate = 0, nowner = 0;
+    JsonField fields[] = {
+        { "blocks", JSON_FIELD_INT, &blocks, 0, 0, 0 },
+        { "state", JSON_FIELD_RAW, &state_raw, 0, 0, 0 },
+        { "owner", JSON_FIELD_RAW, &owner_raw, 0, 0, 0 },
+        { "next_file_id", JSON_FIELD_INT, &nfid, 0, 0, 0 },
+        { "checkpoint", JSON_FIELD_INT, &checkpoint, 0, 0, 0 },
+    };
+    int r = json_extract(in.buf, in.len, fields, 5);
+    if (r == 0 && fields[1].found == 1 &&
+        json_parse_int_array(state_raw, fields[1].count, state, DISK_MAX_BLOCKS, &nstate, 0) != 0) r = -1;
+    if (r == 0 && fields[2].found == 1 &&
+        json_parse_int_array(owner_raw, fields[2].count, owner, DISK_MAX_BLOCKS, &nowner, 0) != 0) r = -1;
+    free(in.buf);
+    if (r != 0) return -2;
+
+    // bring the full snapshot up to date with the regions checkpointed since
+    for (size_t i = nstate; i < DISK_MAX_BLOCKS; i++) state[i] = BLOCK_FREE;
+    for (size_t i = nowner; i < DISK_MAX_BLOCKS; i++) owner[i] = -1;
+    if (fields[0].found != 1) blocks = 0;
+    if (fields[3].found != 1) nfid = 0;
+    persist_delta_replay((unsigned)checkpoint, &blocks, &nfid, state, owner);
+
     clear_disk();
-    int blocks = 0;
-    parse_json_int(in.buf, "blocks", &blocks);
     if (blocks > 0 && blocks <= DISK_MAX_BLOCKS) G.blocks = blocks;
-
-    // Parse state array
-    const char* ps = strstr(in.buf, "\"state\"");
-    if (ps) {
-        ps = strchr(ps, '[');
-        const char* pe = strchr(ps, ']');
-        if (ps && pe && pe > ps) {
-            int idx = 0;
-            const char* p = ps + 1;
-            while (p < pe && idx < G.blocks) {
-                while (*p == ' ' || *p == ',') p++;
-                if (p >= pe) break;
-                int val = (int)strtol(p, (char**)&p, 10);
-                if (val < 0 || val > 2) val = 0;
-                G.state[idx++] = (BlockState)val;
-                while (*p != ',' && p < pe && *p != ']') p++;
-            }
-        }
-    }
-    // Parse owner array
-    const char* po = strstr(in.buf, "\"owner\"");
-    if (po) {
-        po = strchr(po, '[');
-        const char* pe = strchr(po, ']');
-        if (po && pe && pe > po) {
-            int idx = 0;
-            const char* p = po + 1;
-            while (p < pe && idx < G.blocks) {
-                while (*p == ' ' || *p == ',') p++;
-                if (p >= pe) break;
-                int val = (int)strtol(p, (char**)&p, 10);
-                G.owner[idx++] = val;
-                while (*p != ',' && p < pe && *p != ']') p++;
-            }
-        }
+    for (int i = 0; i < G.blocks; i++) {
+        G.state[i] = state[i] >= BLOCK_FREE && state[i] <= BLOCK_BAD ? (BlockState)state[i] : BLOCK_FREE;
+        G.owner[i] = owner[i];
     }
-    // Parse next_file_id
-    int nfid = 0;
-    if (parse_json_int(in.buf, "next_file_id", &nfid) == 0 && nfid > 0) {
+    if (nfid > 0) {
         G.next_file_id = nfid;
     } else {
         // fallback: derive from max owner
@@ -171,15 +363,30 @@ int disk_load() {
             }
         }
     }
-    free(in.buf);
-    logf("disk_load: loaded from '%s'", G.persist_path);
+    // what was just read is already on disk: seed the writer's mirror with
+    // it so the next checkpoint is a delta rather than a full rewrite
+    DiskSnapshot* snap = persist_begin();
+    snap->blocks = G.blocks;
+    snap->next_file_id = G.next_file_id;
+    memcpy(snap->state, G.state, sizeof(G.state));
+    memcpy(snap->owner, G.owner, sizeof(G.owner));
+    memcpy(snap->files, G.files, sizeof(G.files));
+    memset(snap->dirty, 0, sizeof(snap->dirty));
+    snap->full = 0;
+    persist_release();
+    memset(region_dirty, 0, sizeof(region_dirty));
+    dirty_all = 0;
+    log_load();
+    log_event(DISK_OP_LOAD, -1, G.blocks, -1, 0);
     return 0;
 }
 
 int disk_reset() {
     ensure_initialized();
     clear_disk();
-    logf("disk_reset: disk reinitialized");
+    backing_forget();
+    log_truncate();
+    log_event(DISK_OP_RESET, -1, G.blocks, -1, 0);
     return disk_save();
 }
 
@@ -216,6 +423,16 @@ static int register_file(int id) {
     return 0;
 }
 
+// Writes the data of a freshly allocated run into the backing image
+static void write_run(DiskOp op, int start, int size, int fid) {
+    if (!backing_attached()) return;
+    int indices[DISK_MAX_BLOCKS];
+    for (int k = 0; k < size; k++) indices[k] = start + k;
+    backing_begin(op);
+    backing_write(indices, size, fid, 0);
+    backing_end();
+}
+
 int disk_allocate_contiguous(int size, int *out_file_id) {
     ensure_initialized();
     if (size <= 0 || size > G.blocks) return -1;
@@ -230,11 +447,11 @@ int disk_allocate_contiguous(int size, int *out_file_id) {
                 int fid = G.next_file_id++;
                 register_file(fid);
                 for (int j = start; j < start + size; j++) {
-                    G.state[j] = BLOCK_USED;
-                    G.owner[j] = fid;
+                    set_block(j, BLOCK_USED, fid);
                 }
+                write_run(DISK_OP_ALLOC_CONTIGUOUS, start, size, fid);
                 if (out_file_id) *out_file_id = fid;
-                logf("allocate_contiguous: id=%d size=%d start=%d", fid, size, start);
+                log_event(DISK_OP_ALLOC_CONTIGUOUS, fid, size, start, size);
                 disk_save();
                 return 0;
             }
@@ -251,16 +468,19 @@ int disk_allocate_fragmented(int size, int *out_file_id) {
     if (disk_total_free() < size) return -2;
     int fid = G.next_file_id++;
     register_file(fid);
+    int indices[DISK_MAX_BLOCKS];
     int allocated = 0;
     for (int i = 0; i < G.blocks && allocated < size; i++) {
         if (G.state[i] == BLOCK_FREE) {
-            G.state[i] = BLOCK_USED;
-            G.owner[i] = fid;
-            allocated++;
+            set_block(i, BLOCK_USED, fid);
+            indices[allocated++] = i;
         }
     }
+    backing_begin(DISK_OP_ALLOC_FRAGMENTED);
+    backing_write(indices, allocated, fid, 0);
+    backing_end();
     if (out_file_id) *out_file_id = fid;
-    logf("allocate_fragmented: id=%d size=%d", fid, size);
+    log_event(DISK_OP_ALLOC_FRAGMENTED, fid, size, -1, allocated);
     disk_save();
     return 0;
 }
@@ -288,15 +508,16 @@ int disk_allocate_custom(int size, const char *strategy, int *out_file_id) {
     int lens[DISK_MAX_BLOCKS];
     int hcount = find_holes(starts, lens, DISK_MAX_BLOCKS);
     if (hcount == 0) return -2;
+    AllocStrategy strat = parse_strategy(strategy);
     int choice = -1;
-    if (strategy && strcmp(strategy, "best-fit") == 0) {
+    if (strat == STRATEGY_BEST_FIT) {
         int best_len = 999999;
         for (int i = 0; i < hcount; i++) {
             if (lens[i] >= size && lens[i] < best_len) {
                 best_len = lens[i]; choice = i;
             }
         }
-    } else if (strategy && strcmp(strategy, "worst-fit") == 0) {
+    } else if (strat == STRATEGY_WORST_FIT) {
         int worst_len = -1;
         for (int i = 0; i < hcount; i++) {
             if (lens[i] >= size && lens[i] > worst_len) {
@@ -313,11 +534,11 @@ int disk_allocate_custom(int size, const char *strategy, int *out_file_id) {
     int fid = G.next_file_id++;
     register_file(fid);
     for (int j = start; j < start + size; j++) {
-        G.state[j] = BLOCK_USED;
-        G.owner[j] = fid;
+        set_block(j, BLOCK_USED, fid);
     }
+    write_run(DISK_OP_ALLOC_CUSTOM, start, size, fid);
     if (out_file_id) *out_file_id = fid;
-    logf("allocate_custom: id=%d size=%d strategy=%s start=%d", fid, size, strategy?strategy:"first-fit", start);
+    log_event_ex(DISK_OP_ALLOC_CUSTOM, fid, size, start, size, strat, 0);
     disk_save();
     return 0;
 }
@@ -335,15 +556,18 @@ int disk_logical_delete(int file_id) {
     }
     if (cnt == 0) {
         G.files[file_id].status = FILE_DELETED;
-        logf("delete: id=%d (no blocks)", file_id);
+        log_event(DISK_OP_DELETE, file_id, 0, -1, 0);
         disk_save();
         return 0;
     }
     // free them
     for (int k = 0; k < cnt; k++) {
-        G.state[indices[k]] = BLOCK_FREE;
-        G.owner[indices[k]] = -1;
+        set_block(indices[k], BLOCK_FREE, -1);
     }
+    // the data stays where it was, flagged, so undelete can find it
+    backing_begin(DISK_OP_DELETE);
+    backing_mark_deleted(indices, cnt, 1);
+    backing_end();
     // mark file deleted
     G.files[file_id].status = FILE_DELETED;
     // record last_deleted
@@ -351,7 +575,7 @@ int disk_logical_delete(int file_id) {
     G.last_deleted.file_id = file_id;
     G.last_deleted.count = cnt;
     for (int k = 0; k < cnt; k++) G.last_deleted.indices[k] = indices[k];
-    logf("delete: id=%d freed=%d blocks", file_id, cnt);
+    log_event(DISK_OP_DELETE, file_id, cnt, indices[0], cnt);
     disk_save();
     return 0;
 }
@@ -370,24 +594,29 @@ int disk_undelete_last() {
     if (can_restore_same) {
         for (int k = 0; k < cnt; k++) {
             int idx = G.last_deleted.indices[k];
-            G.state[idx] = BLOCK_USED;
-            G.owner[idx] = fid;
+            set_block(idx, BLOCK_USED, fid);
         }
+        backing_begin(DISK_OP_UNDELETE);
+        backing_restore(G.last_deleted.indices, cnt, fid);
+        backing_end();
     } else {
         // fall back to fragmented allocation
         if (disk_total_free() < cnt) return -2;
+        int indices[DISK_MAX_BLOCKS];
         int allocated = 0;
         for (int i = 0; i < G.blocks && allocated < cnt; i++) {
             if (G.state[i] == BLOCK_FREE) {
-                G.state[i] = BLOCK_USED;
-                G.owner[i] = fid;
-                allocated++;
+                set_block(i, BLOCK_USED, fid);
+                indices[allocated++] = i;
             }
         }
+        backing_begin(DISK_OP_UNDELETE);
+        backing_write(indices, allocated, fid, 0);
+        backing_end();
     }
     G.files[fid].status = FILE_ACTIVE;
     G.last_deleted.valid = 0;
-    logf("undelete_last: id=%d restored=%d blocks", fid, cnt);
+    log_event(DISK_OP_UNDELETE, fid, cnt, -1, cnt);
     disk_save();
     return 0;
 }
@@ -395,41 +624,95 @@ int disk_undelete_last() {
 int disk_defragment() {
     ensure_initialized();
     int write_idx = 0;
+    // moves into the image are batched into runs of adjacent blocks
+    int run_from = -1, run_to = -1, run_len = 0;
+    backing_begin(DISK_OP_DEFRAGMENT);
     for (int read_idx = 0; read_idx < G.blocks; read_idx++) {
         if (G.state[read_idx] == BLOCK_USED) {
             if (write_idx != read_idx) {
                 // move block owner to write_idx
-                G.state[write_idx] = BLOCK_USED;
-                G.owner[write_idx] = G.owner[read_idx];
-                G.state[read_idx] = BLOCK_FREE;
-                G.owner[read_idx] = -1;
+                set_block(write_idx, BLOCK_USED, G.owner[read_idx]);
+                set_block(read_idx, BLOCK_FREE, -1);
+                if (run_len > 0 && read_idx == run_from + run_len && write_idx == run_to + run_len) {
+                    run_len++;
+                } else {
+                    backing_move(run_from, run_to, run_len);
+                    run_from = read_idx;
+                    run_to = write_idx;
+                    run_len = 1;
+                }
             }
             write_idx++;
         }
     }
-    logf("defragment: compacted used blocks to front (used=%d)", write_idx);
+    backing_move(run_from, run_to, run_len);
+    backing_end();
+    log_event(DISK_OP_DEFRAGMENT, -1, G.blocks, 0, write_idx);
     disk_save();
     return 0;
 }
 
+// The one way blocks turn bad, whether picked at random or found by the
+// scrubber: each goes to BLOCK_BAD without an owner, under one log event
+static void mark_blocks_bad(const int* indices, int n, int requested) {
+    for (int k = 0; k < n; k++) set_block(indices[k], BLOCK_BAD, -1);
+    log_event(DISK_OP_MARK_BAD, -1, requested, -1, n);
+    disk_save();
+}
+
 int disk_mark_random_bad(int count) {
     ensure_initialized();
     if (count <= 0) return -1;
-    utils_srand();
+    unsigned char picked[DISK_MAX_BLOCKS] = {0};
+    int indices[DISK_MAX_BLOCKS] = {0};
     int marked = 0;
+    if (backing_attached()) {
+        // real data behind the blocks: damage it and let detection make the
+        // transition to BLOCK_BAD, right away unless the scrubber will
+        for (int tries = 0; tries < G.blocks * 4 && marked < count; tries++) {
+            int idx = utils_rand_range(&G.rng, 0, G.blocks - 1);
+            if (G.state[idx] == BLOCK_USED && !picked[idx] && backing_corrupt(idx) == 0) {
+                picked[idx] = 1;
+                indices[marked++] = idx;
+            }
+        }
+        if (marked == 0) return -2;
+        log_event_ex(DISK_OP_MARK_BAD, -1, count, -1, marked, STRATEGY_FIRST_FIT, DISK_EVENT_IMAGE_FAULT);
+        disk_save();
+        BackingInfo info;
+        backing_info(&info);
+        if (!info.scrub.running) {
+            backing_verify(indices, marked);
+            disk_apply_scrub();
+        }
+        return 0;
+    }
     for (int tries = 0; tries < G.blocks * 4 && marked < count; tries++) {
-        int idx = utils_rand_range(0, G.blocks - 1);
-        if (G.state[idx] == BLOCK_FREE) {
-            G.state[idx] = BLOCK_BAD;
-            G.owner[idx] = -1;
-            marked++;
+        int idx = utils_rand_range(&G.rng, 0, G.blocks - 1);
+        if (G.state[idx] == BLOCK_FREE && !picked[idx]) {
+            picked[idx] = 1;
+            indices[marked++] = idx;
         }
     }
-    logf("mark_bad: requested=%d marked=%d", count, marked);
-    disk_save();
+    mark_blocks_bad(indices, marked, count);
     return marked > 0 ? 0 : -2;
 }
 
+int disk_apply_scrub() {
+    int found[DISK_MAX_BLOCKS];
+    int n = backing_take_mismatches(found, DISK_MAX_BLOCKS);
+    if (n == 0) return 0;
+    ensure_initialized();
+    // a block may have been freed or reused since it was read
+    int indices[DISK_MAX_BLOCKS];
+    int marked = 0;
+    for (int k = 0; k < n; k++) {
+        if (found[k] < G.blocks && G.state[found[k]] == BLOCK_USED) indices[marked++] = found[k];
+    }
+    if (marked > 0) mark_blocks_bad(indices, marked, n);
+    return marked;
+}
+
 int disk_repair() {
     ensure_initialized();
     // Simple repair: convert some BAD to FREE
@@ -437,13 +720,13 @@ int disk_repair() {
     for (int i = 0; i < G.blocks; i++) {
         if (G.state[i] == BLOCK_BAD) {
             // 50% chance to repair
-            if (utils_rand_range(0, 1) == 1) {
-                G.state[i] = BLOCK_FREE;
+            if (utils_rand_below(&G.rng, 2) == 1) {
+                set_block(i, BLOCK_FREE, G.owner[i]);
                 repaired++;
             }
         }
     }
-    logf("repair: repaired=%d bad->free", repaired);
+    log_event(DISK_OP_REPAIR, -1, 0, -1, repaired);
     disk_save();
     return 0;
 }
@@ -481,33 +764,35 @@ double disk_fragmentation_percent() {
     return (100.0 * (double)frag) / (double)total;
 }
 
-char* disk_get_state() {
+int disk_write_state(StrBuf* out) {
     ensure_initialized();
-    StrBuf sb;
-    if (sb_init(&sb, 4096) != 0) return NULL;
-    sb_append(&sb, "{ \"blocks\": [");
+    if (!out || !out->buf) return -1;
+    sb_append(out, "{ \"blocks\": [");
     for (int i = 0; i < G.blocks; i++) {
-        sb_appendf(&sb, "{\"index\":%d,\"state\":\"%s\",\"fileId\":%s}",
-                   i,
-                   (G.state[i] == BLOCK_FREE ? "free" : (G.state[i] == BLOCK_USED ? "used" : "bad")),
-                   (G.owner[i] > 0 && G.state[i] == BLOCK_USED) ? "" : "null");
         if (G.owner[i] > 0 && G.state[i] == BLOCK_USED) {
-            // overwrite the last "fileId": part properly
-            sb.len -= 5; // remove "null}"
-            sb.buf[sb.len] = '\0';
-            sb_appendf(&sb, "%d}", G.owner[i]);
+            sb_appendf(out, "{\"index\":%d,\"state\":\"used\",\"fileId\":%d}", i, G.owner[i]);
+        } else {
+            sb_appendf(out, "{\"index\":%d,\"state\":\"%s\",\"fileId\":null}",
+                       i,
+                       (G.state[i] == BLOCK_FREE ? "free" : (G.state[i] == BLOCK_USED ? "used" : "bad")));
         }
-        if (i + 1 < G.blocks) sb_append(&sb, ",");
+        if (i + 1 < G.blocks) sb_append(out, ",");
     }
-    sb_append(&sb, "] }");
+    sb_append(out, "] }");
+    return 0;
+}
+
+char* disk_get_state() {
+    StrBuf sb;
+    if (sb_init(&sb, 32768) != 0) return NULL;
+    if (disk_write_state(&sb) != 0) { sb_free(&sb); return NULL; }
     return sb_take(&sb);
 }
 
-char* disk_get_files() {
+int disk_write_files(StrBuf* out) {
     ensure_initialized();
-    StrBuf sb;
-    if (sb_init(&sb, 2048) != 0) return NULL;
-    sb_append(&sb, "{ \"files\": [");
+    if (!out || !out->buf) return -1;
+    sb_append(out, "{ \"files\": [");
     int first = 1;
     for (int fid = 1; fid < DISK_MAX_BLOCKS; fid++) {
         if (G.files[fid].status != FILE_UNUSED) {
@@ -516,49 +801,201 @@ char* disk_get_files() {
             for (int i = 0; i < G.blocks; i++) {
                 if (G.owner[i] == fid && G.state[i] == BLOCK_USED) size++;
             }
-            if (!first) sb_append(&sb, ",");
+            if (!first) sb_append(out, ",");
             first = 0;
-            sb_appendf(&sb, "{\"id\":%d,\"status\":\"%s\",\"size\":%d}",
+            sb_appendf(out, "{\"id\":%d,\"status\":\"%s\",\"size\":%d}",
                        fid,
                        (G.files[fid].status == FILE_ACTIVE ? "active" : "deleted"),
                        size);
         }
     }
-    sb_append(&sb, "] }");
+    sb_append(out, "] }");
+    return 0;
+}
+
+char* disk_get_files() {
+    StrBuf sb;
+    if (sb_init(&sb, 2048) != 0) return NULL;
+    if (disk_write_files(&sb) != 0) { sb_free(&sb); return NULL; }
     return sb_take(&sb);
 }
 
-char* disk_get_stats() {
+int disk_write_stats(StrBuf* out) {
     ensure_initialized();
-    StrBuf sb;
-    if (sb_init(&sb, 512) != 0) return NULL;
+    if (!out || !out->buf) return -1;
     int total = G.blocks;
     int used = disk_total_used();
     int freeb = disk_total_free();
     int bad = disk_total_bad();
     double fragp = disk_fragmentation_percent();
-    sb_appendf(&sb, "{ \"total\": %d, \"used\": %d, \"free\": %d, \"bad\": %d, \"fragmentationPercent\": %.2f }",
+    sb_appendf(out, "{ \"total\": %d, \"used\": %d, \"free\": %d, \"bad\": %d, \"fragmentationPercent\": %.2f }",
                total, used, freeb, bad, fragp);
+    return 0;
+}
+
+char* disk_get_stats() {
+    StrBuf sb;
+    if (sb_init(&sb, 512) != 0) return NULL;
+    if (disk_write_stats(&sb) != 0) { sb_free(&sb); return NULL; }
     return sb_take(&sb);
 }
 
-char* disk_get_logs() {
+int disk_write_logs(StrBuf* out) {
     ensure_initialized();
-    StrBuf sb;
-    if (sb_init(&sb, 2048) != 0) return NULL;
-    sb_append(&sb, "{ \"logs\": [");
-    int count = G.log_head < DISK_MAX_LOGS ? G.log_head : DISK_MAX_LOGS;
+    if (!out || !out->buf) return -1;
+    sb_append(out, "{ \"logs\": [");
+    int count = G.log_head - G.log_first < DISK_MAX_LOGS ? G.log_head - G.log_first : DISK_MAX_LOGS;
+    char line[DISK_LOG_MSG_LEN];
     for (int i = 0; i < count; i++) {
         int idx = (G.log_head - count + i);
         if (idx < 0) idx = 0;
         idx = idx % DISK_MAX_LOGS;
-        sb_appendf(&sb, "\"%s\"", G.logs[idx]);
-        if (i + 1 < count) sb_append(&sb, ",");
+        format_event(&G.logs[idx], line, sizeof(line));
+        sb_appendf(out, "\"%s\"", line);
+        if (i + 1 < count) sb_append(out, ",");
     }
-    sb_append(&sb, "] }");
+    sb_append(out, "] }");
+    return 0;
+}
+
+char* disk_get_logs() {
+    StrBuf sb;
+    if (sb_init(&sb, 2048) != 0) return NULL;
+    if (disk_write_logs(&sb) != 0) { sb_free(&sb); return NULL; }
+    return sb_take(&sb);
+}
+
+void disk_set_mutation_hook(DiskMutationHook hook, void* ctx) {
+    mutation_hook = hook;
+    mutation_hook_ctx = ctx;
+}
+
+unsigned long disk_generation() {
+    return generation;
+}
+
+void disk_log_query_init(DiskLogQuery* q) {
+    if (!q) return;
+    memset(q, 0, sizeof(*q));
+    q->file_id = -1;
+}
+
+// First sequence in [lo, hi) whose timestamp is >= ts (timestamps are sorted)
+static int log_lower_bound(int lo, int hi, long long ts) {
+    while (lo < hi) {
+        int mid = lo + (hi - lo) / 2;
+        if (G.logs[mid % DISK_MAX_LOGS].timestamp_ms < ts) lo = mid + 1;
+        else hi = mid;
+    }
+    return lo;
+}
+
+int disk_write_log_query(StrBuf* out, const DiskLogQuery* q) {
+    ensure_initialized();
+    if (!out || !out->buf) return -1;
+    DiskLogQuery def;
+    if (!q) { disk_log_query_init(&def); q = &def; }
+    int oldest = G.log_head - G.log_first < DISK_MAX_LOGS ? G.log_first : G.log_head - DISK_MAX_LOGS;
+    // a cursor from the future (another disk) or one whose events are gone
+    // is answered from the oldest event, flagged so the client can resync
+    int reset = q->cursor > G.log_head || (q->cursor > 0 && q->cursor < oldest);
+    int lo = reset || q->cursor < oldest ? oldest : q->cursor;
+    int hi = G.log_head;
+    if (q->since_ms > 0) lo = log_lower_bound(lo, hi, q->since_ms);
+    if (q->until_ms > 0) hi = log_lower_bound(lo, hi, q->until_ms);
+    int limit = (q->limit <= 0 || q->limit > DISK_MAX_LOGS) ? DISK_MAX_LOGS : q->limit;
+    unsigned int mask = q->op_mask ? q->op_mask : ~0u;
+
+    // Collect matching sequence numbers in ascending order
+    int picked[DISK_MAX_LOGS];
+    int n = 0;
+    int single_op = -1;
+    for (int op = 0; op < DISK_OP_COUNT; op++) {
+        if (q->op_mask == (1u << op)) single_op = op;
+    }
+    if ((q->file_id > 0 && q->file_id < DISK_MAX_BLOCKS) || single_op >= 0) {
+        // walk the index chain newest -> oldest, then reverse
+        int by_file = q->file_id > 0 && q->file_id < DISK_MAX_BLOCKS;
+        int seq = by_file ? log_last_file[q->file_id] : log_last_op[single_op];
+        while (seq >= lo) {
+            int idx = seq % DISK_MAX_LOGS;
+            if (seq < hi && (mask & (1u << G.logs[idx].op))) picked[n++] = seq;
+            seq = by_file ? log_prev_file[idx] : log_prev_op[idx];
+        }
+        for (int i = 0; i < n / 2; i++) {
+            int t = picked[i]; picked[i] = picked[n - 1 - i]; picked[n - 1 - i] = t;
+        }
+    } else if (q->file_id <= 0) {
+        for (int seq = lo; seq < hi; seq++) {
+            if (mask & (1u << G.logs[seq % DISK_MAX_LOGS].op)) picked[n++] = seq;
+        }
+    }
+
+    int has_more = n > limit;
+    if (has_more) n = limit;
+    int next_cursor = has_more ? picked[n - 1] + 1 : (hi > lo ? hi : lo);
+
+    sb_append(out, "{ \"logs\": [");
+    char line[DISK_LOG_MSG_LEN];
+    for (int i = 0; i < n; i++) {
+        const DiskLogEvent* e = &G.logs[picked[i] % DISK_MAX_LOGS];
+        format_event(e, line, sizeof(line));
+        if (i > 0) sb_append(out, ",");
+        sb_appendf(out, "{\"seq\":%d,\"timestamp\":%lld,\"op\":\"%s\",\"fileId\":",
+                   picked[i], e->timestamp_ms, disk_op_name(e->op));
+        if (e->file_id > 0) sb_appendf(out, "%d", e->file_id);
+        else sb_append(out, "null");
+        sb_appendf(out, ",\"message\":\"%s\"}", line);
+    }
+    sb_appendf(out, "], \"nextCursor\": %d, \"oldest\": %d, \"head\": %d, \"hasMore\": %d, \"reset\": %d }",
+               next_cursor, oldest, G.log_head, has_more, reset);
+    return 0;
+}
+
+char* disk_query_logs(const DiskLogQuery* q) {
+    StrBuf sb;
+    if (sb_init(&sb, 4096) != 0) return NULL;
+    if (disk_write_log_query(&sb, q) != 0) { sb_free(&sb); return NULL; }
     return sb_take(&sb);
 }
 
+// The snapshot and the files persist.c keeps beside it
+static int is_state_file(const char* path) {
+    static const char* SUFFIXES[] = { "", ".log", ".delta", ".corrupt" };
+    char p[DISK_PERSIST_PATH_LEN + 16];
+    for (size_t i = 0; i < sizeof(SUFFIXES) / sizeof(SUFFIXES[0]); i++) {
+        snprintf(p, sizeof(p), "%s%s", G.persist_path, SUFFIXES[i]);
+        if (same_file(path, p)) return 1;
+    }
+    return 0;
+}
+
+int disk_attach_image(const char* path, size_t block_size, int sync) {
+    ensure_initialized();
+    if (path && is_state_file(path)) return -4;
+    int r = backing_open(path, block_size, G.blocks, sync);
+    if (r != 0) return r;
+    // give the image the data of every file the disk already holds
+    int indices[DISK_MAX_BLOCKS];
+    backing_begin(DISK_OP_INIT);
+    for (int fid = 1; fid < DISK_MAX_BLOCKS; fid++) {
+        if (G.files[fid].status != FILE_ACTIVE) continue;
+        int n = 0;
+        for (int i = 0; i < G.blocks; i++) {
+            if (G.owner[i] == fid && G.state[i] == BLOCK_USED) indices[n++] = i;
+        }
+        backing_write(indices, n, fid, 0);
+    }
+    backing_end();
+    return 0;
+}
+
+void disk_detach_image() {
+    backing_close();
+}
+
 void disk_shutdown() {
     disk_save();
+    persist_close();
+    backing_close();
 }
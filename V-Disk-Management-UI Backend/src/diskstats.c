@@ -0,0 +1,205 @@
+#define _POSIX_C_SOURCE 200809L
+#include "diskstats.h"
+#include "utils.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#ifndef _WIN32
+#include <dirent.h>
+#include <time.h>
+#include <unistd.h>
+#endif
+
+// Field order shared by /proc/diskstats (after major, minor and name) and
+// /sys/block/<dev>/stat: reads, reads merged, sectors read, read ms,
+// writes, writes merged, sectors written, write ms, in flight, io ms,
+// weighted io ms. Newer kernels append discard and flush fields.
+static int parse_fields(const char* p, DiskCounters* c) {
+    unsigned long long v[11];
+    int n = sscanf(p, "%llu %llu %llu %llu %llu %llu %llu %llu %llu %llu %llu",
+                   &v[0], &v[1], &v[2], &v[3], &v[4], &v[5], &v[6], &v[7], &v[8], &v[9], &v[10]);
+    if (n != 11) return -1;
+    c->reads = v[0];
+    c->sectors_read = v[2];
+    c->read_ms = v[3];
+    c->writes = v[4];
+    c->sectors_written = v[6];
+    c->write_ms = v[7];
+    c->in_flight = v[8];
+    c->io_ms = v[9];
+    c->weighted_ms = v[10];
+    return 0;
+}
+
+static int idle_device(const DiskCounters* c) {
+    return c->reads == 0 && c->writes == 0 && c->in_flight == 0;
+}
+
+// Device mapper, software RAID, loop and RAM-backed devices
+static int virtual_device(const char* name) {
+    static const char* PREFIXES[] = { "dm-", "md", "loop", "ram", "zram" };
+    for (size_t i = 0; i < sizeof(PREFIXES) / sizeof(PREFIXES[0]); i++) {
+        if (strncmp(name, PREFIXES[i], strlen(PREFIXES[i])) == 0) return 1;
+    }
+    return 0;
+}
+
+// disks[0..n) are rows already parsed; partitions are listed after their disk
+static int partition_device(const char* name, const DiskCounters* disks, int n) {
+#ifndef _WIN32
+    char path[96];
+    snprintf(path, sizeof(path), "/sys/class/block/%s", name);
+    if (access(path, F_OK) == 0) {
+        snprintf(path, sizeof(path), "/sys/class/block/%s/partition", name);
+        return access(path, F_OK) == 0;
+    }
+#endif
+    for (int i = 0; i < n; i++) {
+        size_t len = strlen(disks[i].name);
+        if (!disks[i].whole_disk || strncmp(name, disks[i].name, len) != 0) continue;
+        const char* p = name + len;
+        if (*p == 'p') p++;
+        if (*p < '0' || *p > '9') continue;
+        while (*p >= '0' && *p <= '9') p++;
+        if (*p == '\0') return 1;
+    }
+    return 0;
+}
+
+int diskstats_parse(const char* text, DiskCounters* out, int cap) {
+    if (!text || !out) return 0;
+    int n = 0;
+    const char* line = text;
+    while (*line && n < cap) {
+        const char* eol = strchr(line, '\n');
+        unsigned major, minor;
+        char name[32];
+        int used = 0;
+        DiskCounters* c = &out[n];
+        memset(c, 0, sizeof(*c));
+        if (sscanf(line, "%u %u %31s %n", &major, &minor, name, &used) == 3 && used > 0 &&
+            parse_fields(line + used, c) == 0 && !idle_device(c)) {
+            memcpy(c->name, name, sizeof(c->name));
+            c->whole_disk = !virtual_device(name) && !partition_device(name, out, n);
+            n++;
+        }
+        if (!eol) break;
+        line = eol + 1;
+    }
+    return n;
+}
+
+#ifdef _WIN32
+int diskstats_read(DiskCounters* out, int cap) {
+    return -1;
+}
+
+int diskstats_measure(DiskIoRates* out, int cap, int window_ms) {
+    return -1;
+}
+#else
+// Same counters from sysfs, one small file per device
+static int read_sys_block(DiskCounters* out, int cap) {
+    DIR* dir = opendir("/sys/block");
+    if (!dir) return -1;
+    int n = 0;
+    struct dirent* e;
+    while (n < cap && (e = readdir(dir)) != NULL) {
+        if (e->d_name[0] == '.' || strlen(e->d_name) >= sizeof(out[n].name)) continue;
+        char path[300];
+        snprintf(path, sizeof(path), "/sys/block/%s/stat", e->d_name);
+        StrBuf sb;
+        if (read_text_file(path, &sb) != 0) continue;
+        DiskCounters* c = &out[n];
+        memset(c, 0, sizeof(*c));
+        if (parse_fields(sb.buf, c) == 0 && !idle_device(c)) {
+            strcpy(c->name, e->d_name);
+            c->whole_disk = !virtual_device(c->name); // /sys/block lists no partitions
+            n++;
+        }
+        free(sb.buf);
+    }
+    closedir(dir);
+    return n;
+}
+
+int diskstats_read(DiskCounters* out, int cap) {
+    if (!out || cap <= 0) return -1;
+    StrBuf sb;
+    if (read_text_file("/proc/diskstats", &sb) != 0) return read_sys_block(out, cap);
+    int n = diskstats_parse(sb.buf, out, cap);
+    free(sb.buf);
+    return n;
+}
+
+int diskstats_measure(DiskIoRates* out, int cap, int window_ms) {
+    static DiskCounters before[DISKSTATS_MAX_DEVICES], after[DISKSTATS_MAX_DEVICES];
+    struct timespec t0, t1;
+    clock_gettime(CLOCK_MONOTONIC, &t0);
+    int n0 = diskstats_read(before, DISKSTATS_MAX_DEVICES);
+    if (n0 < 0) return -1;
+    struct timespec nap = { window_ms / 1000, (long)(window_ms % 1000) * 1000000L };
+    nanosleep(&nap, NULL);
+    clock_gettime(CLOCK_MONOTONIC, &t1);
+    int n1 = diskstats_read(after, DISKSTATS_MAX_DEVICES);
+    if (n1 < 0) return -1;
+    double elapsed = (double)(t1.tv_sec - t0.tv_sec) * 1000.0 + (double)(t1.tv_nsec - t0.tv_nsec) / 1e6;
+    return diskstats_rates(before, n0, after, n1, elapsed, out, cap);
+}
+#endif
+
+static unsigned long long delta(unsigned long long prev, unsigned long long cur) {
+    return cur >= prev ? cur - prev : cur;
+}
+
+int diskstats_rates(const DiskCounters* prev, int nprev, const DiskCounters* cur, int ncur,
+                    double elapsed_ms, DiskIoRates* out, int cap) {
+    if (elapsed_ms <= 0) return 0;
+    double secs = elapsed_ms / 1000.0;
+    int n = 0;
+    for (int i = 0; i < ncur && n < cap; i++) {
+        // device lists rarely change, so the same index usually matches
+        const DiskCounters* p = NULL;
+        if (i < nprev && strcmp(prev[i].name, cur[i].name) == 0) p = &prev[i];
+        for (int j = 0; !p && j < nprev; j++) {
+            if (strcmp(prev[j].name, cur[i].name) == 0) p = &prev[j];
+        }
+        if (!p) continue;
+        const DiskCounters* c = &cur[i];
+        unsigned long long reads = delta(p->reads, c->reads);
+        unsigned long long writes = delta(p->writes, c->writes);
+        DiskIoRates* r = &out[n++];
+        memcpy(r->name, c->name, sizeof(r->name));
+        r->read_iops = (double)reads / secs;
+        r->write_iops = (double)writes / secs;
+        r->read_bytes_per_sec = (double)delta(p->sectors_read, c->sectors_read) * DISKSTATS_SECTOR_BYTES / secs;
+        r->write_bytes_per_sec = (double)delta(p->sectors_written, c->sectors_written) * DISKSTATS_SECTOR_BYTES / secs;
+        r->queue_depth = (double)delta(p->weighted_ms, c->weighted_ms) / elapsed_ms;
+        r->read_await_ms = reads ? (double)delta(p->read_ms, c->read_ms) / (double)reads : 0.0;
+        r->write_await_ms = writes ? (double)delta(p->write_ms, c->write_ms) / (double)writes : 0.0;
+        r->util_percent = (double)delta(p->io_ms, c->io_ms) / elapsed_ms * 100.0;
+        if (r->util_percent > 100.0) r->util_percent = 100.0;
+        r->in_flight = c->in_flight;
+        r->whole_disk = c->whole_disk;
+    }
+    return n;
+}
+
+int diskstats_totals(const DiskIoRates* rates, int n, DiskIoRates* total) {
+    memset(total, 0, sizeof(*total));
+    snprintf(total->name, sizeof(total->name), "total");
+    total->whole_disk = 1;
+    int disks = 0;
+    for (int i = 0; i < n; i++) {
+        const DiskIoRates* r = &rates[i];
+        if (!r->whole_disk) continue;
+        total->read_iops += r->read_iops;
+        total->write_iops += r->write_iops;
+        total->read_bytes_per_sec += r->read_bytes_per_sec;
+        total->write_bytes_per_sec += r->write_bytes_per_sec;
+        total->queue_depth += r->queue_depth;
+        total->in_flight += r->in_flight;
+        disks++;
+    }
+    return disks;
+}
@@ -0,0 +1,133 @@
+#define _POSIX_C_SOURCE 200809L
+#include "forecast.h"
+#include <string.h>
+#include <math.h>
+#ifndef _WIN32
+#include <pthread.h>
+#endif
+
+// Weighted sums for the regression of y = used - y0 on x = seconds since
+// t0. Offsetting by the first sample keeps the squares small enough that
+// the variance terms do not cancel out in double precision.
+typedef struct {
+    char path[256];
+    int samples;
+    long long t0_ms;
+    double y0;
+    long long last_ms;
+    double last_used;
+    double total;
+    double sw, sx, sy, sxx, sxy, syy;
+} Series;
+
+static Series series[FORECAST_MAX_SERIES];
+static int series_count = 0;
+
+#ifndef _WIN32
+static pthread_mutex_t lock = PTHREAD_MUTEX_INITIALIZER;
+#define LOCK() pthread_mutex_lock(&lock)
+#define UNLOCK() pthread_mutex_unlock(&lock)
+#else
+#define LOCK() do {} while (0)
+#define UNLOCK() do {} while (0)
+#endif
+
+static Series* find(const char* path) {
+    for (int i = 0; i < series_count; i++) {
+        if (strcmp(series[i].path, path) == 0) return &series[i];
+    }
+    return NULL;
+}
+
+void forecast_add(const char* path, long long t_ms, double used_bytes, double total_bytes) {
+    if (!path || strlen(path) >= sizeof(series[0].path)) return;
+    LOCK();
+    Series* s = find(path);
+    if (!s) {
+        if (series_count == FORECAST_MAX_SERIES) { UNLOCK(); return; }
+        s = &series[series_count++];
+        memset(s, 0, sizeof(*s));
+        strcpy(s->path, path);
+        s->t0_ms = t_ms;
+        s->y0 = used_bytes;
+        s->last_ms = t_ms;
+    }
+    // age the old sums by the time since the previous sample
+    double dt = (double)(t_ms - s->last_ms) / 1000.0;
+    if (dt > 0) {
+        double decay = pow(0.5, dt / FORECAST_HALF_LIFE_S);
+        s->sw *= decay;
+        s->sx *= decay;
+        s->sy *= decay;
+        s->sxx *= decay;
+        s->sxy *= decay;
+        s->syy *= decay;
+    }
+    double x = (double)(t_ms - s->t0_ms) / 1000.0;
+    double y = used_bytes - s->y0;
+    s->sw += 1.0;
+    s->sx += x;
+    s->sy += y;
+    s->sxx += x * x;
+    s->sxy += x * y;
+    s->syy += y * y;
+    s->samples++;
+    if (t_ms > s->last_ms) s->last_ms = t_ms;
+    s->last_used = used_bytes;
+    s->total = total_bytes;
+    UNLOCK();
+}
+
+static void evaluate(const Series* s, DiskForecast* out) {
+    memset(out, 0, sizeof(*out));
+    strcpy(out->path, s->path);
+    out->samples = s->samples;
+    out->updated_ms = s->last_ms;
+    out->used_bytes = s->last_used;
+    out->total_bytes = s->total;
+    out->eta_seconds = -1;
+
+    double sxx = s->sxx - s->sx * s->sx / s->sw; // weighted spread of x
+    if (s->samples < 2 || sxx <= 0) return;
+    double sxy = s->sxy - s->sx * s->sy / s->sw;
+    double syy = s->syy - s->sy * s->sy / s->sw;
+    double slope = sxy / sxx;
+    out->bytes_per_sec = slope;
+    if (s->samples >= FORECAST_MIN_SAMPLES) {
+        // share of the usage variance the line explains; a flat series is
+        // perfectly predictable
+        double r2 = syy > 0 ? (sxy * sxy) / (sxx * syy) : 1.0;
+        out->confidence = r2 > 1.0 ? 1.0 : r2;
+    }
+    if (slope > 0) {
+        // project from the fitted value now rather than the raw last sample
+        double x_now = (double)(s->last_ms - s->t0_ms) / 1000.0;
+        double fitted = s->y0 + s->sy / s->sw + slope * (x_now - s->sx / s->sw);
+        double left = s->total - fitted;
+        out->eta_seconds = left > 0 ? left / slope : 0;
+    }
+}
+
+int forecast_get(const char* path, DiskForecast* out) {
+    if (!path || !out) return -1;
+    LOCK();
+    const Series* s = find(path);
+    if (s) evaluate(s, out);
+    UNLOCK();
+    return s ? 0 : -1;
+}
+
+int forecast_list(DiskForecast* out, int cap) {
+    if (!out) return 0;
+    LOCK();
+    int n = series_count < cap ? series_count : cap;
+    for (int i = 0; i < n; i++) evaluate(&series[i], &out[i]);
+    UNLOCK();
+    return n;
+}
+
+void forecast_reset() {
+    LOCK();
+    series_count = 0;
+    UNLOCK();
+}
@@ -0,0 +1,138 @@
+#define _POSIX_C_SOURCE 200809L
+#include "http.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+// cross platform block
+#ifdef _WIN32
+#define strncasecmp _strnicmp
+#else
+#include <strings.h>
+#endif
+// end cross platform block
+
+static HttpParseState fail(HttpParser* p, int status, const char* msg) {
+    p->state = HTTP_PARSE_ERROR;
+    p->error_status = status;
+    p->error = msg;
+    return p->state;
+}
+
+void http_parser_init(HttpParser* p, HttpRequest* req) {
+    memset(p, 0, sizeof(*p));
+    p->state = HTTP_PARSE_REQUEST_LINE;
+    memset(req, 0, sizeof(*req));
+    req->content_length = -1;
+    req->accept_encoding = "";
+}
+
+// Copy [s, s+n) into a fixed field; -1 if it does not fit
+static int copy_field(char* dst, size_t cap, const char* s, size_t n) {
+    if (n == 0 || n >= cap) return -1;
+    memcpy(dst, s, n);
+    dst[n] = '\0';
+    return 0;
+}
+
+static HttpParseState parse_request_line(HttpParser* p, HttpRequest* req, char* line, size_t n) {
+    char* sp1 = (char*)memchr(line, ' ', n);
+    if (!sp1) return fail(p, 400, "Malformed request line");
+    char* target = sp1 + 1;
+    char* sp2 = (char*)memchr(target, ' ', n - (size_t)(target - line));
+    if (!sp2) return fail(p, 400, "Malformed request line");
+    char* version = sp2 + 1;
+    size_t version_len = n - (size_t)(version - line);
+
+    if (copy_field(req->method, sizeof(req->method), line, (size_t)(sp1 - line)) != 0) {
+        return fail(p, 400, "Unsupported method");
+    }
+    if (copy_field(req->protocol, sizeof(req->protocol), version, version_len) != 0 ||
+        strncmp(req->protocol, "HTTP/1.", 7) != 0) {
+        return fail(p, 400, "Unsupported protocol");
+    }
+    size_t target_len = (size_t)(sp2 - target);
+    char* qs = (char*)memchr(target, '?', target_len);
+    size_t path_len = qs ? (size_t)(qs - target) : target_len;
+    if (copy_field(req->path, sizeof(req->path), target, path_len) != 0 || req->path[0] != '/') {
+        return fail(p, 400, "Invalid request target");
+    }
+    req->query[0] = '\0';
+    if (qs && target_len - path_len > 1) {
+        if (copy_field(req->query, sizeof(req->query), qs + 1, target_len - path_len - 1) != 0) {
+            return fail(p, 400, "Query string too long");
+        }
+    }
+    p->state = HTTP_PARSE_HEADERS;
+    return p->state;
+}
+
+static HttpParseState parse_header(HttpParser* p, HttpRequest* req, char* line, size_t n) {
+    char* colon = (char*)memchr(line, ':', n);
+    if (!colon || colon == line) return fail(p, 400, "Malformed header");
+    size_t name_len = (size_t)(colon - line);
+    char* v = colon + 1;
+    char* end = line + n;
+    while (v < end && (*v == ' ' || *v == '\t')) v++;
+    while (end > v && (end[-1] == ' ' || end[-1] == '\t')) end--;
+    *end = '\0';
+
+    if (name_len == 14 && strncasecmp(line, "Content-Length", 14) == 0) {
+        if (v == end) return fail(p, 400, "Invalid Content-Length");
+        long value = 0;
+        for (char* c = v; c < end; c++) {
+            if (*c < '0' || *c > '9') return fail(p, 400, "Invalid Content-Length");
+            if (value > HTTP_MAX_BODY_BYTES) return fail(p, 413, "Request body too large");
+            value = value * 10 + (*c - '0');
+        }
+        if (req->content_length >= 0 && req->content_length != value) {
+            return fail(p, 400, "Conflicting Content-Length");
+        }
+        if (value > HTTP_MAX_BODY_BYTES) return fail(p, 413, "Request body too large");
+        req->content_length = value;
+    } else if (name_len == 17 && strncasecmp(line, "Transfer-Encoding", 17) == 0) {
+        return fail(p, 501, "Transfer-Encoding is not supported");
+    } else if (name_len == 15 && strncasecmp(line, "Accept-Encoding", 15) == 0) {
+        req->accept_encoding = v;
+    }
+    return p->state;
+}
+
+HttpParseState http_parse(HttpParser* p, HttpRequest* req, char* buf, size_t len) {
+    while (p->state == HTTP_PARSE_REQUEST_LINE || p->state == HTTP_PARSE_HEADERS) {
+        char* line = buf + p->pos;
+        char* nl = (char*)memchr(line, '\n', len - p->pos);
+        if (!nl) {
+            if (len > HTTP_MAX_HEADER_BYTES) return fail(p, 431, "Request headers too large");
+            return p->state; // need more bytes
+        }
+        size_t n = (size_t)(nl - line);
+        p->pos += n + 1;
+        if (p->pos > HTTP_MAX_HEADER_BYTES) return fail(p, 431, "Request headers too large");
+        if (n > 0 && line[n - 1] == '\r') n--;
+        line[n] = '\0';
+
+        if (p->state == HTTP_PARSE_REQUEST_LINE) {
+            if (n == 0) continue; // tolerate blank lines before the request
+            parse_request_line(p, req, line, n);
+        } else if (n == 0) {
+            if (req->content_length < 0) req->content_length = 0;
+            p->body_start = p->pos;
+            p->state = HTTP_PARSE_BODY;
+        } else {
+            parse_header(p, req, line, n);
+        }
+    }
+
+    if (p->state == HTTP_PARSE_BODY) {
+        size_t need = (size_t)req->content_length;
+        if (len - p->body_start < need) return p->state; // need more bytes
+        // body is a view into the buffer; terminate it for string helpers
+        buf[p->body_start + need] = '\0';
+        req->body = buf + p->body_start;
+        req->body_len = need;
+        p->pos = p->body_start + need;
+        p->state = HTTP_PARSE_DONE;
+    }
+    return p->state;
+}
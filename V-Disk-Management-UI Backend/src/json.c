@@ -0,0 +1,478 @@
+#define _POSIX_C_SOURCE 200809L
+#include "json.h"
+#include <string.h>
+#include <limits.h>
+#ifndef _WIN32
+#include <pthread.h>
+#include <unistd.h>
+#endif
+
+// Byte classes for the structural scan. Strings are skipped in runs of
+// plain bytes so the hot loop is one table load and compare per byte.
+enum { C_PLAIN = 0, C_WS = 1, C_STR = 2 };
+
+static const unsigned char CLASS[256] = {
+    [0x00] = C_STR, [0x01] = C_STR, [0x02] = C_STR, [0x03] = C_STR,
+    [0x04] = C_STR, [0x05] = C_STR, [0x06] = C_STR, [0x07] = C_STR,
+    [0x08] = C_STR, [0x09] = C_WS,  [0x0A] = C_WS,  [0x0B] = C_STR,
+    [0x0C] = C_STR, [0x0D] = C_WS,  [0x0E] = C_STR, [0x0F] = C_STR,
+    [0x10] = C_STR, [0x11] = C_STR, [0x12] = C_STR, [0x13] = C_STR,
+    [0x14] = C_STR, [0x15] = C_STR, [0x16] = C_STR, [0x17] = C_STR,
+    [0x18] = C_STR, [0x19] = C_STR, [0x1A] = C_STR, [0x1B] = C_STR,
+    [0x1C] = C_STR, [0x1D] = C_STR, [0x1E] = C_STR, [0x1F] = C_STR,
+    [' '] = C_WS, ['"'] = C_STR, ['\\'] = C_STR
+};
+
+typedef struct {
+    const char* p;
+    const char* end;
+} Scanner;
+
+static void skip_ws(Scanner* s) {
+    while (s->p < s->end && CLASS[(unsigned char)*s->p] == C_WS) s->p++;
+}
+
+static int hex_value(char c) {
+    if (c >= '0' && c <= '9') return c - '0';
+    if (c >= 'a' && c <= 'f') return c - 'a' + 10;
+    if (c >= 'A' && c <= 'F') return c - 'A' + 10;
+    return -1;
+}
+
+static long read_hex4(const char* p) {
+    long v = 0;
+    for (int i = 0; i < 4; i++) {
+        int h = hex_value(p[i]);
+        if (h < 0) return -1;
+        v = (v << 4) | h;
+    }
+    return v;
+}
+
+// Scans a string whose opening quote is at s->p. On success s->p is past
+// the closing quote and [*raw, *raw + *raw_len) holds the escaped body.
+static int scan_string(Scanner* s, const char** raw, size_t* raw_len, int* escaped) {
+    const char* p = s->p + 1;
+    *escaped = 0;
+    for (;;) {
+        while (p < s->end && CLASS[(unsigned char)*p] != C_STR) p++;
+        if (p >= s->end) return -1;
+        if (*p == '"') break;
+        if (*p != '\\') return -1; // raw control character
+        *escaped = 1;
+        if (p + 1 >= s->end) return -1;
+        switch (p[1]) {
+            case '"': case '\\': case '/': case 'b': case 'f': case 'n': case 'r': case 't':
+                p += 2;
+                break;
+            case 'u':
+                if (s->end - p < 6 || read_hex4(p + 2) < 0) return -1;
+                p += 6;
+                break;
+            default:
+                return -1;
+        }
+    }
+    *raw = s->p + 1;
+    *raw_len = (size_t)(p - *raw);
+    s->p = p + 1;
+    return 0;
+}
+
+static size_t put_utf8(char* dst, unsigned long cp) {
+    if (cp < 0x80) { dst[0] = (char)cp; return 1; }
+    if (cp < 0x800) {
+        dst[0] = (char)(0xC0 | (cp >> 6));
+        dst[1] = (char)(0x80 | (cp & 0x3F));
+        return 2;
+    }
+    if (cp < 0x10000) {
+        dst[0] = (char)(0xE0 | (cp >> 12));
+        dst[1] = (char)(0x80 | ((cp >> 6) & 0x3F));
+        dst[2] = (char)(0x80 | (cp & 0x3F));
+        return 3;
+    }
+    dst[0] = (char)(0xF0 | (cp >> 18));
+    dst[1] = (char)(0x80 | ((cp >> 12) & 0x3F));
+    dst[2] = (char)(0x80 | ((cp >> 6) & 0x3F));
+    dst[3] = (char)(0x80 | (cp & 0x3F));
+    return 4;
+}
+
+// Decodes an already validated string body; -1 if it does not fit in cap
+static int unescape(const char* raw, size_t n, int escaped, char* out, size_t cap) {
+    if (cap == 0) return -1;
+    if (!escaped) {
+        if (n >= cap) return -1;
+        memcpy(out, raw, n);
+        out[n] = '\0';
+        return 0;
+    }
+    size_t o = 0;
+    const char* end = raw + n;
+    for (const char* p = raw; p < end;) {
+        char tmp[4];
+        size_t w = 1;
+        if (*p != '\\') {
+            tmp[0] = *p++;
+        } else {
+            char e = p[1];
+            p += 2;
+            switch (e) {
+                case 'b': tmp[0] = '\b'; break;
+                case 'f': tmp[0] = '\f'; break;
+                case 'n': tmp[0] = '\n'; break;
+                case 'r': tmp[0] = '\r'; break;
+                case 't': tmp[0] = '\t'; break;
+                case 'u': {
+                    unsigned long cp = (unsigned long)read_hex4(p);
+                    p += 4;
+                    // join a surrogate pair; a lone surrogate becomes U+FFFD
+                    if (cp >= 0xD800 && cp <= 0xDBFF && end - p >= 6 && p[0] == '\\' && p[1] == 'u') {
+                        long lo = read_hex4(p + 2);
+                        if (lo >= 0xDC00 && lo <= 0xDFFF) {
+                            cp = 0x10000 + ((cp - 0xD800) << 10) + ((unsigned long)lo - 0xDC00);
+                            p += 6;
+                        }
+                    }
+                    if (cp >= 0xD800 && cp <= 0xDFFF) cp = 0xFFFD;
+                    w = put_utf8(tmp, cp);
+                    break;
+                }
+                default: tmp[0] = e; break; // " \ /
+            }
+        }
+        if (o + w >= cap) return -1;
+        memcpy(out + o, tmp, w);
+        o += w;
+    }
+    out[o] = '\0';
+    return 0;
+}
+
+// Scans a number at s->p. *is_int is set when it has no fraction or
+// exponent and fits in a long long, in which case *value holds it.
+static int scan_number(Scanner* s, long long* value, int* is_int) {
+    const char* p = s->p;
+    int neg = 0;
+    unsigned long long mag = 0;
+    int overflow = 0;
+    if (p < s->end && *p == '-') { neg = 1; p++; }
+    if (p >= s->end || *p < '0' || *p > '9') return -1;
+    if (*p == '0') {
+        p++;
+    } else {
+        while (p < s->end && *p >= '0' && *p <= '9') {
+            unsigned d = (unsigned)(*p++ - '0');
+            if (mag > (ULLONG_MAX - d) / 10) overflow = 1;
+            else mag = mag * 10 + d;
+        }
+    }
+    *is_int = 1;
+    if (p < s->end && *p == '.') {
+        p++;
+        if (p >= s->end || *p < '0' || *p > '9') return -1;
+        while (p < s->end && *p >= '0' && *p <= '9') p++;
+        *is_int = 0;
+    }
+    if (p < s->end && (*p == 'e' || *p == 'E')) {
+        p++;
+        if (p < s->end && (*p == '+' || *p == '-')) p++;
+        if (p >= s->end || *p < '0' || *p > '9') return -1;
+        while (p < s->end && *p >= '0' && *p <= '9') p++;
+        *is_int = 0;
+    }
+    if (overflow || mag > (unsigned long long)LLONG_MAX + (unsigned long long)neg) *is_int = 0;
+    if (*is_int) *value = neg ? (long long)(0 - mag) : (long long)mag;
+    s->p = p;
+    return 0;
+}
+
+static int scan_literal(Scanner* s, const char* word) {
+    size_t n = strlen(word);
+    if ((size_t)(s->end - s->p) < n || memcmp(s->p, word, n) != 0) return -1;
+    s->p += n;
+    return 0;
+}
+
+static int parse_value(Scanner* s, int depth, JsonField* f);
+
+static int parse_array(Scanner* s, int depth, JsonField* f) {
+    int store = f && f->type == JSON_FIELD_INT_ARRAY;
+    int* out = store ? (int*)f->out : NULL;
+    size_t count = 0;
+    int ok = store;
+    s->p++; // '['
+    skip_ws(s);
+    if (s->p < s->end && *s->p == ']') {
+        s->p++;
+    } else {
+        for (;;) {
+            skip_ws(s);
+            if (s->p >= s->end) return -1;
+            char c = *s->p;
+            if (ok && (c == '-' || (c >= '0' && c <= '9'))) {
+                long long v = 0;
+                int is_int = 0;
+                if (scan_number(s, &v, &is_int) != 0) return -1;
+                if (!is_int || v < INT_MIN || v > INT_MAX || count >= f->cap) ok = 0;
+                else out[count++] = (int)v;
+            } else {
+                ok = 0;
+                if (parse_value(s, depth + 1, NULL) != 0) return -1;
+            }
+            skip_ws(s);
+            if (s->p >= s->end) return -1;
+            if (*s->p == ',') { s->p++; continue; }
+            if (*s->p == ']') { s->p++; break; }
+            return -1;
+        }
+    }
+    if (f) {
+        f->found = ok ? 1 : -1;
+        f->count = ok ? count : 0;
+    }
+    return 0;
+}
+
+static int match_key(const char* raw, size_t n, int escaped, const char* key) {
+    if (!escaped) return strlen(key) == n && memcmp(raw, key, n) == 0;
+    char buf[128];
+    return unescape(raw, n, 1, buf, sizeof(buf)) == 0 && strcmp(buf, key) == 0;
+}
+
+// Parses one object; when fields is non-NULL its members are matched
+// against them (only used for the top level).
+static int parse_object(Scanner* s, int depth, JsonField* fields, int nfields) {
+    s->p++; // '{'
+    skip_ws(s);
+    if (s->p < s->end && *s->p == '}') { s->p++; return 0; }
+    for (;;) {
+        skip_ws(s);
+        if (s->p >= s->end || *s->p != '"') return -1;
+        const char* key;
+        size_t key_len;
+        int escaped;
+        if (scan_string(s, &key, &key_len, &escaped) != 0) return -1;
+        skip_ws(s);
+        if (s->p >= s->end || *s->p != ':') return -1;
+        s->p++;
+        skip_ws(s);
+
+        JsonField* f = NULL;
+        for (int i = 0; i < nfields; i++) {
+            if (match_key(key, key_len, escaped, fields[i].key)) { f = &fields[i]; break; }
+        }
+        if (parse_value(s, depth + 1, f) != 0) return -1;
+
+        skip_ws(s);
+        if (s->p >= s->end) return -1;
+        if (*s->p == ',') { s->p++; continue; }
+        if (*s->p == '}') { s->p++; return 0; }
+        return -1;
+    }
+}
+
+// Skips a container by tracking nesting and strings only; scalars inside
+// are left for whoever parses the span later
+static int skip_container(Scanner* s) {
+    int depth = 0;
+    while (s->p < s->end) {
+        char c = *s->p;
+        if (c == '"') {
+            const char* raw;
+            size_t n;
+            int escaped;
+            if (scan_string(s, &raw, &n, &escaped) != 0) return -1;
+            continue;
+        }
+        s->p++;
+        if (c == '[' || c == '{') {
+            if (++depth > JSON_MAX_DEPTH) return -1;
+        } else if (c == ']' || c == '}') {
+            if (--depth == 0) return 0;
+        }
+    }
+    return -1;
+}
+
+static int parse_value(Scanner* s, int depth, JsonField* f) {
+    if (depth > JSON_MAX_DEPTH || s->p >= s->end) return -1;
+    char c = *s->p;
+    if (f && f->type == JSON_FIELD_RAW) {
+        const char* start = s->p;
+        int r = (c == '[' || c == '{') ? skip_container(s) : parse_value(s, depth, NULL);
+        if (r != 0) return -1;
+        *(const char**)f->out = start;
+        f->count = (size_t)(s->p - start);
+        f->found = 1;
+        return 0;
+    }
+    if (c == '{') {
+        if (f) f->found = -1;
+        return parse_object(s, depth, NULL, 0);
+    }
+    if (c == '[') return parse_array(s, depth, f);
+    if (c == '"') {
+        const char* raw;
+        size_t n;
+        int escaped;
+        if (scan_string(s, &raw, &n, &escaped) != 0) return -1;
+        if (f) {
+            f->found = f->type == JSON_FIELD_STRING &&
+                       unescape(raw, n, escaped, (char*)f->out, f->cap) == 0 ? 1 : -1;
+        }
+        return 0;
+    }
+    if (c == '-' || (c >= '0' && c <= '9')) {
+        long long v = 0;
+        int is_int = 0;
+        if (scan_number(s, &v, &is_int) != 0) return -1;
+        if (f) {
+            f->found = -1;
+            if (is_int && f->type == JSON_FIELD_LONG) {
+                *(long long*)f->out = v;
+                f->found = 1;
+            } else if (is_int && f->type == JSON_FIELD_INT && v >= INT_MIN && v <= INT_MAX) {
+                *(int*)f->out = (int)v;
+                f->found = 1;
+            }
+        }
+        return 0;
+    }
+    if (f) f->found = -1;
+    if (c == 't') return scan_literal(s, "true");
+    if (c == 'f') return scan_literal(s, "false");
+    if (c == 'n') return scan_literal(s, "null");
+    return -1;
+}
+
+int json_extract(const char* json, size_t len, JsonField* fields, int nfields) {
+    for (int i = 0; i < nfields; i++) {
+        fields[i].found = 0;
+        fields[i].count = 0;
+    }
+    if (!json) return -1;
+    Scanner s = { json, json + len };
+    skip_ws(&s);
+    if (s.p >= s.end || *s.p != '{') return -1;
+    if (parse_object(&s, 1, fields, nfields) != 0) return -1;
+    skip_ws(&s);
+    return s.p == s.end ? 0 : -1;
+}
+
+typedef struct {
+    const char* begin;
+    const char* end;
+    int* out;         // first slot of this chunk's slice
+    size_t expected;  // elements counted in the split pass
+    int status;
+} IntChunk;
+
+static int parse_int_chunk(IntChunk* c) {
+    Scanner s = { c->begin, c->end };
+    size_t n = 0;
+    for (;;) {
+        skip_ws(&s);
+        long long v = 0;
+        int is_int = 0;
+        if (n >= c->expected || scan_number(&s, &v, &is_int) != 0) return -1;
+        if (!is_int || v < INT_MIN || v > INT_MAX) return -1;
+        c->out[n++] = (int)v;
+        skip_ws(&s);
+        if (s.p == s.end) break;
+        if (*s.p != ',') return -1;
+        s.p++;
+        if (s.p == s.end) break; // chunk ends right after its last comma
+    }
+    return n == c->expected ? 0 : -1;
+}
+
+#ifndef _WIN32
+static void* int_chunk_worker(void* arg) {
+    IntChunk* c = (IntChunk*)arg;
+    c->status = parse_int_chunk(c);
+    return NULL;
+}
+#endif
+
+static size_t count_byte(const char* p, const char* end, char b) {
+    size_t n = 0;
+    while ((p = (const char*)memchr(p, b, (size_t)(end - p))) != NULL) { n++; p++; }
+    return n;
+}
+
+int json_parse_int_array(const char* raw, size_t len, int* out, size_t cap, size_t* count, int threads) {
+    *count = 0;
+    Scanner s = { raw, raw + len };
+    skip_ws(&s);
+    if (s.p >= s.end || *s.p != '[') return -1;
+    const char* end = s.end;
+    while (end > s.p && CLASS[(unsigned char)end[-1]] == C_WS) end--;
+    if (end - s.p < 2 || end[-1] != ']') return -1;
+    const char* begin = s.p + 1;
+    end--;
+    Scanner body = { begin, end };
+    skip_ws(&body);
+    if (body.p == end) return 0; // []
+
+    size_t bytes = (size_t)(end - begin);
+#ifdef _WIN32
+    threads = 1;
+#else
+    if (threads <= 0) {
+        long cpus = sysconf(_SC_NPROCESSORS_ONLN);
+        threads = cpus > 0 ? (int)cpus : 1;
+        if ((size_t)threads > bytes / JSON_PARALLEL_MIN_BYTES) threads = (int)(bytes / JSON_PARALLEL_MIN_BYTES);
+    }
+#endif
+    if (threads > JSON_MAX_THREADS) threads = JSON_MAX_THREADS;
+    if ((size_t)threads > bytes) threads = (int)bytes;
+    if (threads < 1) threads = 1;
+
+    // Split at commas near even byte offsets; each chunk's element count
+    // is its comma count (plus one for the last), which fixes its slice.
+    IntChunk chunks[JSON_MAX_THREADS];
+    int n = 0;
+    size_t total = 0;
+    const char* p = begin;
+    for (int i = 0; i < threads && p < end; i++) {
+        const char* q = end;
+        if (i + 1 < threads) {
+            const char* target = begin + bytes * (size_t)(i + 1) / (size_t)threads;
+            if (target < p) target = p;
+            const char* comma = (const char*)memchr(target, ',', (size_t)(end - target));
+            q = comma ? comma + 1 : end;
+        }
+        size_t elems = count_byte(p, q, ',') + (q == end ? 1 : 0);
+        if (total + elems > cap) return -1;
+        chunks[n].begin = p;
+        chunks[n].end = q;
+        chunks[n].out = out + total;
+        chunks[n].expected = elems;
+        chunks[n].status = -1;
+        total += elems;
+        n++;
+        p = q;
+    }
+
+    int started = 0;
+#ifndef _WIN32
+    pthread_t tids[JSON_MAX_THREADS];
+    for (int i = 1; i < n; i++) {
+        if (pthread_create(&tids[i], NULL, int_chunk_worker, &chunks[i]) != 0) break;
+        started = i;
+    }
+#endif
+    // the calling thread takes chunk 0 and any chunk a thread was not started for
+    chunks[0].status = parse_int_chunk(&chunks[0]);
+    for (int i = started + 1; i < n; i++) chunks[i].status = parse_int_chunk(&chunks[i]);
+#ifndef _WIN32
+    for (int i = 1; i <= started; i++) pthread_join(tids[i], NULL);
+#endif
+    for (int i = 0; i < n; i++) {
+        if (chunks[i].status != 0) return -1;
+    }
+    *count = total;
+    return 0;
+}
@@ -1,9 +1,12 @@
 #define _POSIX_C_SOURCE 200809L
 #include <stdio.h>
 #include <stdlib.h>
+#include <string.h>
 #include "disk.h"
 #include "server.h"
 #include "system_disk.h"
+#include "sampler.h"
+#include "backing.h"
 
 #ifdef _WIN32
 #include <winsock2.h>
@@ -28,7 +31,44 @@ int main(int argc, char** argv) {
 
     // Initialize disk persistence
     const char* persist_env = getenv("DATA_FILE");
-    disk_init(persist_env && persist_env[0] ? persist_env : "disk_state.json");
+    // How hard snapshot writes push to stable storage (none|rename|fdatasync|fsync)
+    const char* durability_env = getenv("DURABILITY");
+    int durability = DURABILITY_RENAME;
+    if (durability_env && durability_env[0]) {
+        durability = durability_from_name(durability_env);
+        if (durability < 0) {
+            fprintf(stderr, "Unknown DURABILITY '%s', using rename\n", durability_env);
+            durability = DURABILITY_RENAME;
+        }
+    }
+    disk_init_ex(persist_env && persist_env[0] ? persist_env : "disk_state.json", (Durability)durability);
+    // RAND_SEED replays the blocks picked by mark-bad and repair
+    printf("Random seed: %llu\n", (unsigned long long)disk_get_seed());
+
+    // Write snapshots from a background thread unless PERSIST_MODE=sync
+    const char* mode_env = getenv("PERSIST_MODE");
+    if (!(mode_env && strcmp(mode_env, "sync") == 0) && disk_set_persist_mode(DISK_PERSIST_ASYNC) != 0) {
+        fprintf(stderr, "Async persistence unavailable, saving synchronously\n");
+    }
+
+    // Back the simulated blocks with a real image file (DISK_IMAGE unset: metadata only)
+    const char* image_env = getenv("DISK_IMAGE");
+    if (image_env && image_env[0]) {
+        const char* bs_env = getenv("DISK_IMAGE_BLOCK_SIZE");
+        const char* sync_env = getenv("DISK_IMAGE_SYNC");
+        long block_size = bs_env && bs_env[0] ? atol(bs_env) : BACKING_DEFAULT_BLOCK_SIZE;
+        int sync = sync_env && atoi(sync_env) != 0;
+        if (block_size <= 0 || disk_attach_image(image_env, (size_t)block_size, sync) != 0) {
+            fprintf(stderr, "Unable to attach disk image '%s', running without it\n", image_env);
+        } else {
+            // verify block checksums in the background (SCRUB_KBPS=0 disables)
+            const char* scrub_env = getenv("SCRUB_KBPS");
+            int kbps = scrub_env && scrub_env[0] ? atoi(scrub_env) : BACKING_SCRUB_DEFAULT_KBPS;
+            if (kbps > 0 && backing_scrub_start(kbps * 1024.0) != 0) {
+                fprintf(stderr, "Block scrubber unavailable\n");
+            }
+        }
+    }
 
     // Test system disk info
     SystemDiskInfo sys_info;
@@ -43,8 +83,16 @@ int main(int argc, char** argv) {
         printf("Failed to get system disk info\n");
     }
 
+    // Collect filesystem stats in the background (SAMPLE_INTERVAL_MS=0 disables)
+    const char* interval_env = getenv("SAMPLE_INTERVAL_MS");
+    int interval_ms = interval_env && interval_env[0] ? atoi(interval_env) : SAMPLER_DEFAULT_INTERVAL_MS;
+    if (interval_ms > 0 && sampler_start(interval_ms) != 0) {
+        fprintf(stderr, "Background disk sampler unavailable, querying per request\n");
+    }
+
     // Run the server
     int rc = run_server(port);
+    sampler_stop();
 
     // Shutdown disk
     disk_shutdown();
@@ -0,0 +1,470 @@
+#define _POSIX_C_SOURCE 200809L
+#include "../include/persist.h"
+#include "../include/utils.h"
+#include "../include/compress.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#ifndef _WIN32
+#include <pthread.h>
+#include <unistd.h>
+#endif
+
+#define LOG_COMPACT_RECORDS (DISK_MAX_LOGS * 4)
+#define LOG_BASE_OP 0xFF                     // first record: start = seq of the next one
+#define DELTA_MAGIC 0x544C4544u              // "DELT"
+#define DELTA_MAX_RECORDS (DISK_REGIONS * 4) // then write a full snapshot
+
+static char snapshot_path[DISK_PERSIST_PATH_LEN];
+static char log_path[DISK_PERSIST_PATH_LEN + 8];
+static char delta_path[DISK_PERSIST_PATH_LEN + 8];
+
+static DiskSnapshot pending;       // updated by the capturing thread
+static unsigned long submitted = 0; // commits so far
+static unsigned long written = 0;   // commits covered by a finished write
+static unsigned long write_count = 0;
+static int last_status = 0;
+static DiskPersistMode mode = DISK_PERSIST_SYNC;
+static Durability durability = DURABILITY_RENAME;
+
+// Log file state; owned by whichever thread is writing
+static FILE* log_fp = NULL;
+static int log_flushed = 0;        // snapshot log_head already appended
+static long log_file_records = 0;
+static unsigned log_epoch = 0;     // epoch the file currently holds
+
+// Checkpoint state; same ownership as the log
+static FILE* delta_fp = NULL;
+static long delta_records = 0;     // records in the delta file
+static unsigned checkpoint_seq = 0; // highest checkpoint number seen
+static unsigned base_checkpoint = 0; // checkpoint of the snapshot on disk
+
+#ifndef _WIN32
+static pthread_mutex_t lock = PTHREAD_MUTEX_INITIALIZER;
+static pthread_cond_t work_cv = PTHREAD_COND_INITIALIZER; // new commit or stop
+static pthread_cond_t done_cv = PTHREAD_COND_INITIALIZER; // a write finished
+static pthread_t writer;
+static int writer_running = 0;
+static int writer_stop = 0;
+static DiskSnapshot work;          // writer's private copy
+#define LOCK() pthread_mutex_lock(&lock)
+#define UNLOCK() pthread_mutex_unlock(&lock)
+#else
+#define LOCK() ((void)0)
+#define UNLOCK() ((void)0)
+#endif
+
+static void log_close() {
+    if (log_fp) {
+        fclose(log_fp);
+        log_fp = NULL;
+    }
+}
+
+static void delta_close() {
+    if (delta_fp) {
+        fclose(delta_fp);
+        delta_fp = NULL;
+    }
+}
+
+// Rewrite the log file with only the events still held in the ring. The
+// file opens with a base record carrying the sequence number of its first
+// event, so numbering carries on across restarts; files without one start at 0.
+static int log_compact(const DiskLogEvent* ring, int first, int head) {
+    int count = head - first < DISK_MAX_LOGS ? head - first : DISK_MAX_LOGS;
+    DiskLogEvent* tmp = (DiskLogEvent*)malloc(sizeof(DiskLogEvent) * (size_t)(count + 1));
+    if (!tmp) return -1;
+    memset(&tmp[0], 0, sizeof(tmp[0]));
+    tmp[0].op = LOG_BASE_OP;
+    tmp[0].start = head - count;
+    for (int i = 0; i < count; i++) {
+        tmp[i + 1] = ring[(head - count + i) % DISK_MAX_LOGS];
+    }
+    log_close();
+    int r = write_file_durable(log_path, tmp, sizeof(DiskLogEvent) * (size_t)(count + 1), durability);
+    free(tmp);
+    if (r != 0) return -1;
+    log_file_records = count + 1;
+    log_flushed = head;
+    return 0;
+}
+
+// Append events recorded since the last write; a new epoch starts the
+// file over
+static int log_sync(const DiskSnapshot* s) {
+    if (s->log_epoch != log_epoch) {
+        log_epoch = s->log_epoch;
+        return log_compact(s->logs, s->log_first, s->log_head);
+    }
+    if (log_flushed == s->log_head) return 0;
+    // events the ring already dropped would leave a gap in the numbering
+    if (s->log_head - log_flushed > DISK_MAX_LOGS ||
+        log_file_records + (s->log_head - log_flushed) > LOG_COMPACT_RECORDS) {
+        return log_compact(s->logs, s->log_first, s->log_head);
+    }
+    if (!log_fp) {
+        log_fp = fopen(log_path, "ab");
+        if (!log_fp) return -1;
+        // the file may have just been created
+        if (durability == DURABILITY_FSYNC && sync_parent_dir(log_path) != 0) return -1;
+    }
+    while (log_flushed < s->log_head) {
+        int idx = log_flushed % DISK_MAX_LOGS;
+        // write the contiguous run up to the ring wrap point in one call
+        int run = s->log_head - log_flushed;
+        if (idx + run > DISK_MAX_LOGS) run = DISK_MAX_LOGS - idx;
+        if (fwrite(&s->logs[idx], sizeof(DiskLogEvent), (size_t)run, log_fp) != (size_t)run) return -1;
+        log_flushed += run;
+        log_file_records += run;
+    }
+    return sync_stream(log_fp, durability);
+}
+
+// Full snapshot under a new checkpoint number; the delta file restarts
+static int write_full(const DiskSnapshot* s) {
+    unsigned seq = checkpoint_seq + 1;
+    StrBuf sb;
+    if (sb_init(&sb, 4096) != 0) return -1;
+    // first line carries the CRC of everything after it; patched below
+    sb_append(&sb, "{ \"crc32\": \"00000000\",\n");
+    size_t body = sb.len;
+    sb_appendf(&sb, "  \"blocks\": %d,\n", s->blocks);
+    sb_append(&sb, "  \"state\": [");
+    for (int i = 0; i < s->blocks; i++) {
+        sb_appendf(&sb, "%d", (int)s->state[i]);
+        if (i + 1 < s->blocks) sb_append(&sb, ",");
+    }
+    sb_append(&sb, "],\n  \"owner\": [");
+    for (int i = 0; i < s->blocks; i++) {
+        sb_appendf(&sb, "%d", s->owner[i]);
+        if (i + 1 < s->blocks) sb_append(&sb, ",");
+    }
+    sb_append(&sb, "],\n  \"files\": [");
+    int first = 1;
+    for (int i = 0; i < DISK_MAX_BLOCKS; i++) {
+        if (s->files[i].status != FILE_UNUSED) {
+            if (!first) sb_append(&sb, ",");
+            first = 0;
+            sb_appendf(&sb, "{\"id\":%d,\"status\":%d}", s->files[i].id, (int)s->files[i].status);
+        }
+    }
+    sb_append(&sb, "],\n  \"next_file_id\": ");
+    sb_appendf(&sb, "%d,\n", s->next_file_id);
+    sb_appendf(&sb, "  \"checkpoint\": %u\n", seq);
+    sb_append(&sb, "}\n");
+    char hex[9];
+    snprintf(hex, sizeof(hex), "%08lx", compress_crc32(0, sb.buf + body, sb.len - body));
+    memcpy(sb.buf + body - 11, hex, 8);
+    int r = write_file_durable(snapshot_path, sb.buf, sb.len, durability);
+    sb_free(&sb);
+    if (r != 0) return -1;
+    checkpoint_seq = seq;
+    base_checkpoint = seq;
+    // records left behind by a failed truncate name an older checkpoint
+    // and are skipped on load
+    delta_close();
+    if (write_file_durable(delta_path, "", 0, durability) == 0) delta_records = 0;
+    return 0;
+}
+
+static unsigned int delta_crc(const DiskDeltaRecord* rec) {
+    DiskDeltaRecord tmp = *rec;
+    tmp.crc32 = 0;
+    return (unsigned int)compress_crc32(0, &tmp, sizeof(tmp));
+}
+
+static void delta_seal(DiskDeltaRecord* rec) {
+    rec->crc32 = delta_crc(rec);
+}
+
+// Append one record per changed region (a header-only record if none)
+static int write_deltas(const DiskSnapshot* s) {
+    if (!delta_fp) {
+        delta_fp = fopen(delta_path, "ab");
+        if (!delta_fp) return -1;
+        if (durability == DURABILITY_FSYNC && sync_parent_dir(delta_path) != 0) return -1;
+    }
+    DiskDeltaRecord rec;
+    memset(&rec, 0, sizeof(rec));
+    rec.magic = DELTA_MAGIC;
+    rec.checkpoint = base_checkpoint;
+    rec.blocks = s->blocks;
+    rec.next_file_id = s->next_file_id;
+    int wrote = 0;
+    for (int r = 0; r < DISK_REGIONS; r++) {
+        if (!s->dirty[r]) continue;
+        rec.region = r;
+        for (int i = 0; i < DISK_REGION_BLOCKS; i++) {
+            int idx = r * DISK_REGION_BLOCKS + i;
+            rec.state[i] = idx < DISK_MAX_BLOCKS ? (unsigned char)s->state[idx] : 0;
+            rec.owner[i] = idx < DISK_MAX_BLOCKS ? s->owner[idx] : -1;
+        }
+        delta_seal(&rec);
+        if (fwrite(&rec, sizeof(rec), 1, delta_fp) != 1) return -1;
+        delta_records++;
+        wrote++;
+    }
+    if (!wrote) {
+        rec.region = -1;
+        delta_seal(&rec);
+        if (fwrite(&rec, sizeof(rec), 1, delta_fp) != 1) return -1;
+        delta_records++;
+    }
+    return sync_stream(delta_fp, durability);
+}
+
+static int write_snapshot(const DiskSnapshot* s) {
+    long changed = 0;
+    for (int r = 0; r < DISK_REGIONS; r++) changed += s->dirty[r];
+    if (changed == 0) changed = 1; // the header-only record
+    int r;
+    if (s->full || delta_records + changed > DELTA_MAX_RECORDS) r = write_full(s);
+    else r = write_deltas(s);
+    if (log_sync(s) != 0) r = -1;
+    return r;
+}
+
+// Once the pending snapshot is taken for writing, later commits only mark
+// what changes after that point. A failed write asks for a full snapshot
+// next time, since the regions it carried may be missing on disk.
+static void pending_taken() {
+    memset(pending.dirty, 0, sizeof(pending.dirty));
+    pending.full = 0;
+}
+
+int persist_open(const char* path, Durability d) {
+    if (!path || strlen(path) >= sizeof(snapshot_path)) return -1;
+    persist_flush();
+    LOCK();
+    log_close();
+    delta_close();
+    durability = d;
+    strncpy(snapshot_path, path, sizeof(snapshot_path) - 1);
+    snapshot_path[sizeof(snapshot_path) - 1] = '\0';
+    snprintf(log_path, sizeof(log_path), "%s.log", snapshot_path);
+    snprintf(delta_path, sizeof(delta_path), "%s.delta", snapshot_path);
+    // new checkpoint numbers must not collide with records already on disk,
+    // even if the snapshot they belong to turns out to be unreadable
+    delta_records = 0;
+    checkpoint_seq = 0;
+    FILE* f = fopen(delta_path, "rb");
+    if (f) {
+        DiskDeltaRecord rec;
+        while (fread(&rec, sizeof(rec), 1, f) == 1) {
+            delta_records++;
+            if (rec.magic == DELTA_MAGIC && rec.crc32 == delta_crc(&rec) && rec.checkpoint > checkpoint_seq)
+                checkpoint_seq = rec.checkpoint;
+        }
+        fclose(f);
+    }
+    pending.full = 1;
+    UNLOCK();
+    return 0;
+}
+
+int persist_delta_replay(unsigned checkpoint, int* blocks, int* next_file_id, int* state, int* owner) {
+    persist_flush();
+    LOCK();
+    if (checkpoint > checkpoint_seq) checkpoint_seq = checkpoint;
+    base_checkpoint = checkpoint;
+    int applied = 0;
+    long good = 0;
+    long bytes = 0;
+    FILE* f = fopen(delta_path, "rb");
+    if (f) {
+        DiskDeltaRecord rec;
+        // replay stops at the first torn or corrupt record; everything
+        // after it was written later and cannot be trusted either
+        while (fread(&rec, sizeof(rec), 1, f) == 1) {
+            if (rec.magic != DELTA_MAGIC || rec.crc32 != delta_crc(&rec) || rec.region >= DISK_REGIONS) break;
+            good++;
+            if (rec.checkpoint != checkpoint) continue; // belongs to an older snapshot
+            if (rec.blocks > 0 && rec.blocks <= DISK_MAX_BLOCKS) *blocks = rec.blocks;
+            if (rec.next_file_id > 0) *next_file_id = rec.next_file_id;
+            for (int i = 0; rec.region >= 0 && i < DISK_REGION_BLOCKS; i++) {
+                int idx = rec.region * DISK_REGION_BLOCKS + i;
+                if (idx >= DISK_MAX_BLOCKS) break;
+                state[idx] = rec.state[i];
+                owner[idx] = rec.owner[i];
+            }
+            applied++;
+        }
+        if (fseek(f, 0, SEEK_END) == 0) bytes = ftell(f);
+        fclose(f);
+    }
+    // cut the bad tail so new records are appended on a record boundary
+    long keep = good * (long)sizeof(DiskDeltaRecord);
+#ifndef _WIN32
+    if (bytes > keep) {
+        delta_close();
+        if (truncate(delta_path, keep) != 0) fprintf(stderr, "persist: cannot truncate '%s'\n", delta_path);
+    }
+#endif
+    delta_records = good;
+    UNLOCK();
+    return applied;
+}
+
+DiskSnapshot* persist_begin() {
+    LOCK();
+    return &pending;
+}
+
+int persist_commit() {
+    submitted++;
+#ifndef _WIN32
+    if (writer_running) {
+        pthread_cond_signal(&work_cv);
+        UNLOCK();
+        return 0;
+    }
+#endif
+    // sync: the caller writes while still holding the snapshot
+    last_status = write_snapshot(&pending);
+    pending_taken();
+    if (last_status != 0) pending.full = 1;
+    write_count++;
+    written = submitted;
+    int r = last_status;
+    UNLOCK();
+    return r;
+}
+
+#ifndef _WIN32
+static void* writer_main(void* arg) {
+    LOCK();
+    for (;;) {
+        while (written == submitted && !writer_stop) pthread_cond_wait(&work_cv, &lock);
+        if (written == submitted) break; // stopping and caught up
+        // take the latest snapshot; commits made meanwhile coalesce into it
+        unsigned long target = submitted;
+        memcpy(&work, &pending, sizeof(work));
+        pending_taken();
+        UNLOCK();
+        int r = write_snapshot(&work);
+        if (r != 0) fprintf(stderr, "persist: failed to write '%s'\n", snapshot_path);
+        LOCK();
+        if (r != 0) pending.full = 1;
+        last_status = r;
+        write_count++;
+        written = target;
+        pthread_cond_broadcast(&done_cv);
+    }
+    UNLOCK();
+    return NULL;
+}
+#endif
+
+int persist_set_mode(DiskPersistMode m) {
+#ifdef _WIN32
+    return m == DISK_PERSIST_SYNC ? 0 : -1;
+#else
+    LOCK();
+    if (m == DISK_PERSIST_ASYNC && !writer_running) {
+        writer_stop = 0;
+        if (pthread_create(&writer, NULL, writer_main, NULL) != 0) {
+            UNLOCK();
+            return -1;
+        }
+        writer_running = 1;
+    } else if (m == DISK_PERSIST_SYNC && writer_running) {
+        // the writer drains outstanding commits before it exits
+        writer_stop = 1;
+        pthread_cond_signal(&work_cv);
+        UNLOCK();
+        pthread_join(writer, NULL);
+        LOCK();
+        writer_running = 0;
+    }
+    mode = m;
+    UNLOCK();
+    return 0;
+#endif
+}
+
+void persist_release() {
+    UNLOCK();
+}
+
+DiskPersistMode persist_mode() {
+    return mode;
+}
+
+int persist_flush() {
+    LOCK();
+#ifndef _WIN32
+    unsigned long target = submitted;
+    while (writer_running && written < target) pthread_cond_wait(&done_cv, &lock);
+#endif
+    int r = last_status;
+    UNLOCK();
+    return r;
+}
+
+unsigned long persist_write_count() {
+    LOCK();
+    unsigned long n = write_count;
+    UNLOCK();
+    return n;
+}
+
+int persist_log_load(DiskLogEvent* ring, int* first, int* head) {
+    persist_flush();
+    LOCK();
+    log_close();
+    *first = *head = 0;
+    log_flushed = 0;
+    log_file_records = 0;
+    pending.log_first = pending.log_head = 0;
+    int r = -1;
+    FILE* f = fopen(log_path, "rb");
+    DiskLogEvent* tmp = (DiskLogEvent*)malloc(sizeof(DiskLogEvent) * DISK_MAX_LOGS);
+    if (f && tmp && fseek(f, 0, SEEK_END) == 0) {
+        long bytes = ftell(f);
+        // a torn trailing record is ignored
+        long records = bytes > 0 ? bytes / (long)sizeof(DiskLogEvent) : 0;
+        long skip = 0;
+        int base = 0;
+        if (records > 0 && fseek(f, 0, SEEK_SET) == 0 && fread(tmp, sizeof(DiskLogEvent), 1, f) == 1 &&
+            tmp[0].op == LOG_BASE_OP) {
+            base = tmp[0].start > 0 ? tmp[0].start : 0;
+            skip = 1;
+        }
+        long from = records - skip > DISK_MAX_LOGS ? records - DISK_MAX_LOGS : skip;
+        if (fseek(f, from * (long)sizeof(DiskLogEvent), SEEK_SET) == 0) {
+            size_t n = fread(tmp, sizeof(DiskLogEvent), (size_t)(records - from), f);
+            int kept = 0;
+            for (size_t i = 0; i < n; i++) {
+                if (tmp[i].op >= DISK_OP_COUNT) continue;
+                tmp[kept++] = tmp[i];
+            }
+            // events older than the window are taken to be intact
+            *head = base + (int)(from - skip) + kept;
+            *first = *head - kept;
+            for (int i = 0; i < kept; i++) {
+                ring[(*first + i) % DISK_MAX_LOGS] = tmp[i];
+                pending.logs[(*first + i) % DISK_MAX_LOGS] = tmp[i];
+            }
+            pending.log_first = *first;
+            pending.log_head = *head;
+            log_flushed = *head;
+            log_file_records = records;
+            if (records * (long)sizeof(DiskLogEvent) != bytes || (size_t)kept != n) log_compact(ring, *first, *head);
+            r = 0;
+        }
+    }
+    free(tmp);
+    if (f) fclose(f);
+    log_epoch = pending.log_epoch;
+    UNLOCK();
+    return r;
+}
+
+void persist_close() {
+    persist_set_mode(DISK_PERSIST_SYNC);
+    LOCK();
+    log_close();
+    delta_close();
+    UNLOCK();
+}
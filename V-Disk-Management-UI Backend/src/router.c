@@ -0,0 +1,148 @@
+#define _POSIX_C_SOURCE 200809L
+#include "router.h"
+#include <string.h>
+#include <stdint.h>
+
+static const char* const METHOD_NAMES[HTTP_METHOD_COUNT] = { "GET", "POST", "PUT", "DELETE" };
+
+int http_method_from_string(const char* method) {
+    for (int i = 0; i < HTTP_METHOD_COUNT; i++) {
+        if (strcmp(method, METHOD_NAMES[i]) == 0) return i;
+    }
+    return -1;
+}
+
+static uint32_t edge_hash(int parent, const char* seg, size_t len) {
+    uint32_t h = 2166136261u ^ (uint32_t)parent;
+    for (size_t i = 0; i < len; i++) {
+        h ^= (unsigned char)seg[i];
+        h *= 16777619u;
+    }
+    return h;
+}
+
+// Slot holding (parent, seg), or the empty slot where it would go
+static int edge_slot(const Router* r, int parent, const char* seg, size_t len) {
+    uint32_t i = edge_hash(parent, seg, len) & (ROUTER_EDGE_SLOTS - 1);
+    for (int probes = 0; probes < ROUTER_EDGE_SLOTS; probes++) {
+        const RouterEdge* e = &r->edges[i];
+        if (e->node < 0) return (int)i;
+        if (e->parent == parent && e->seg_len == len && memcmp(e->seg, seg, len) == 0) return (int)i;
+        i = (i + 1) & (ROUTER_EDGE_SLOTS - 1);
+    }
+    return -1;
+}
+
+static int new_node(Router* r) {
+    if (r->node_count >= ROUTER_MAX_NODES) return -1;
+    RouterNode* n = &r->nodes[r->node_count];
+    memset(n, 0, sizeof(*n));
+    n->param_child = -1;
+    return r->node_count++;
+}
+
+// Next "/"-separated segment of s starting at *pos; empty segments are skipped
+static int next_segment(const char* s, size_t* pos, const char** seg, size_t* len) {
+    size_t i = *pos;
+    while (s[i] == '/') i++;
+    if (!s[i]) return 0;
+    size_t start = i;
+    while (s[i] && s[i] != '/') i++;
+    *seg = s + start;
+    *len = i - start;
+    *pos = i;
+    return 1;
+}
+
+int router_build(Router* r, const Route* routes, size_t count) {
+    memset(r, 0, sizeof(*r));
+    for (int i = 0; i < ROUTER_EDGE_SLOTS; i++) r->edges[i].node = -1;
+    if (new_node(r) != 0) return -1;
+
+    for (size_t k = 0; k < count; k++) {
+        const Route* rt = &routes[k];
+        if ((int)rt->method < 0 || rt->method >= HTTP_METHOD_COUNT || !rt->handler) return -1;
+        int node = 0;
+        size_t pos = 0;
+        const char* seg;
+        size_t len;
+        while (next_segment(rt->pattern, &pos, &seg, &len)) {
+            if (len >= 2 && seg[0] == '{' && seg[len - 1] == '}') {
+                RouterNode* n = &r->nodes[node];
+                if (n->param_child < 0) {
+                    int child = new_node(r);
+                    if (child < 0) return -1;
+                    n = &r->nodes[node];
+                    n->param_child = child;
+                    n->param_name = seg + 1;
+                    n->param_name_len = len - 2;
+                }
+                node = n->param_child;
+                continue;
+            }
+            int slot = edge_slot(r, node, seg, len);
+            if (slot < 0) return -1;
+            RouterEdge* e = &r->edges[slot];
+            if (e->node < 0) {
+                int child = new_node(r);
+                if (child < 0) return -1;
+                e->node = child;
+                e->parent = node;
+                e->seg = seg;
+                e->seg_len = len;
+            }
+            node = e->node;
+        }
+        if (r->nodes[node].handlers[rt->method]) return -1; // duplicate route
+        r->nodes[node].handlers[rt->method] = rt->handler;
+    }
+    return 0;
+}
+
+// Literal segments win over "{param}" siblings; there is no backtracking
+RouteResult router_match(const Router* r, const char* method, const char* path,
+                         RouteHandler* out_handler, RouteParams* params) {
+    params->count = 0;
+    int node = 0;
+    size_t pos = 0;
+    const char* seg;
+    size_t len;
+    while (next_segment(path, &pos, &seg, &len)) {
+        int slot = edge_slot(r, node, seg, len);
+        if (slot >= 0 && r->edges[slot].node >= 0) {
+            node = r->edges[slot].node;
+            continue;
+        }
+        const RouterNode* n = &r->nodes[node];
+        if (n->param_child < 0 || params->count >= ROUTER_MAX_PARAMS || len >= ROUTER_PARAM_LEN) {
+            return ROUTE_NOT_FOUND;
+        }
+        params->names[params->count] = n->param_name;
+        memcpy(params->values[params->count], seg, len);
+        params->values[params->count][len] = '\0';
+        params->count++;
+        node = n->param_child;
+    }
+
+    const RouterNode* n = &r->nodes[node];
+    int m = http_method_from_string(method);
+    if (m >= 0 && n->handlers[m]) {
+        *out_handler = n->handlers[m];
+        return ROUTE_FOUND;
+    }
+    for (int i = 0; i < HTTP_METHOD_COUNT; i++) {
+        if (n->handlers[i]) return ROUTE_METHOD_NOT_ALLOWED;
+    }
+    return ROUTE_NOT_FOUND;
+}
+
+const char* route_param(const RouteParams* params, const char* name) {
+    size_t len = strlen(name);
+    for (int i = 0; i < params->count; i++) {
+        // names point into the pattern and end at the closing brace
+        if (strncmp(params->names[i], name, len) == 0 && params->names[i][len] == '}') {
+            return params->values[i];
+        }
+    }
+    return NULL;
+}
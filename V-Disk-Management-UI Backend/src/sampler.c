@@ -0,0 +1,169 @@
+#define _POSIX_C_SOURCE 200809L
+#include "sampler.h"
+#include "timeseries.h"
+#include "forecast.h"
+#include "utils.h"
+#include <string.h>
+#ifndef _WIN32
+#include <pthread.h>
+#include <time.h>
+#include <errno.h>
+#endif
+
+#ifdef _WIN32
+int sampler_start(int interval_ms) { return -1; }
+void sampler_stop() {}
+void sampler_set_sim_stats(int used, int free_blocks, int bad, double fragmentation_percent) {}
+const SystemSample* sampler_latest() { return NULL; }
+#else
+// Three buffers, each owned by exactly one side at a time: the collector
+// fills `back`, the reader holds `front`, and `middle` is the hand-off
+// slot. Publishing swaps back with middle and flags it fresh; the reader
+// swaps front with middle only when the flag is set. Neither side waits,
+// and neither ever sees a buffer the other is writing.
+#define SLOT_FRESH 4
+#define SLOT_MASK 3
+
+static SystemSample slots[3];
+static int back = 0;
+static int middle = 1;
+static int front = 2;
+
+static int running = 0;
+static int interval = SAMPLER_DEFAULT_INTERVAL_MS;
+static int stop_requested = 0;
+static pthread_t thread;
+static pthread_mutex_t stop_lock = PTHREAD_MUTEX_INITIALIZER;
+static pthread_cond_t stop_cv = PTHREAD_COND_INITIALIZER;
+
+// Previous /proc/diskstats reading; only the collector thread touches it
+static DiskCounters io_prev[DISKSTATS_MAX_DEVICES];
+static int io_prev_count = -1;
+static struct timespec io_prev_at;
+
+static void collect_io(SystemSample* s) {
+    DiskCounters cur[DISKSTATS_MAX_DEVICES];
+    struct timespec now;
+    clock_gettime(CLOCK_MONOTONIC, &now);
+    int n = diskstats_read(cur, DISKSTATS_MAX_DEVICES);
+    s->io_count = n < 0 ? -1 : 0;
+    s->io_interval_ms = 0;
+    if (n >= 0 && io_prev_count >= 0) {
+        s->io_interval_ms = (double)(now.tv_sec - io_prev_at.tv_sec) * 1000.0 +
+                            (double)(now.tv_nsec - io_prev_at.tv_nsec) / 1e6;
+        s->io_count = diskstats_rates(io_prev, io_prev_count, cur, n, s->io_interval_ms, s->io, DISKSTATS_MAX_DEVICES);
+    }
+    if (n >= 0) memcpy(io_prev, cur, sizeof(cur[0]) * (size_t)n);
+    io_prev_count = n;
+    io_prev_at = now;
+}
+
+// Latest simulated disk figures, written by the disk's owner thread
+static pthread_mutex_t sim_lock = PTHREAD_MUTEX_INITIALIZER;
+static int sim_valid = 0;
+static double sim_values[4];
+
+void sampler_set_sim_stats(int used, int free_blocks, int bad, double fragmentation_percent) {
+    pthread_mutex_lock(&sim_lock);
+    sim_values[0] = used;
+    sim_values[1] = free_blocks;
+    sim_values[2] = bad;
+    sim_values[3] = fragmentation_percent;
+    sim_valid = 1;
+    pthread_mutex_unlock(&sim_lock);
+}
+
+static void record_series(const SystemSample* s) {
+    long long t = s->sampled_ms;
+    for (int i = 0; i < s->mount_count; i++) {
+        const SystemMountInfo* m = &s->mounts[i];
+        if (m->status == 0) forecast_add(m->info.path, t, (double)m->info.used_space, (double)m->info.total_space);
+    }
+    if (s->root_status == 0) {
+        ts_record(TS_SYS_USED_PERCENT, t, s->root.used_percentage);
+        ts_record(TS_SYS_FREE_BYTES, t, (double)s->root.free_space);
+    }
+    DiskIoRates total;
+    if (s->io_count > 0 && diskstats_totals(s->io, s->io_count, &total) > 0) {
+        ts_record(TS_IO_READ_BYTES, t, total.read_bytes_per_sec);
+        ts_record(TS_IO_WRITE_BYTES, t, total.write_bytes_per_sec);
+        ts_record(TS_IO_IOPS, t, total.read_iops + total.write_iops);
+    }
+    double sim[4];
+    pthread_mutex_lock(&sim_lock);
+    int valid = sim_valid;
+    memcpy(sim, sim_values, sizeof(sim));
+    pthread_mutex_unlock(&sim_lock);
+    if (valid) {
+        ts_record(TS_SIM_USED_BLOCKS, t, sim[0]);
+        ts_record(TS_SIM_FREE_BLOCKS, t, sim[1]);
+        ts_record(TS_SIM_BAD_BLOCKS, t, sim[2]);
+        ts_record(TS_SIM_FRAGMENTATION, t, sim[3]);
+    }
+}
+
+static void collect(SystemSample* s, unsigned long seq) {
+    int timeout = interval < SYSTEM_MOUNT_TIMEOUT_MS ? interval : SYSTEM_MOUNT_TIMEOUT_MS;
+    s->root_status = get_system_disk_info(&s->root);
+    s->mount_count = get_system_mounts(s->mounts, SYSTEM_MAX_MOUNTS, timeout);
+    collect_io(s);
+    s->sampled_ms = utils_now_ms();
+    s->seq = seq;
+    record_series(s);
+}
+
+static void* sampler_main(void* arg) {
+    unsigned long seq = 0;
+    pthread_mutex_lock(&stop_lock);
+    while (!stop_requested) {
+        pthread_mutex_unlock(&stop_lock);
+        collect(&slots[back], ++seq);
+        back = __atomic_exchange_n(&middle, back | SLOT_FRESH, __ATOMIC_ACQ_REL) & SLOT_MASK;
+
+        // sleep until the next round, waking early on sampler_stop()
+        struct timespec deadline;
+        clock_gettime(CLOCK_REALTIME, &deadline);
+        deadline.tv_sec += interval / 1000;
+        deadline.tv_nsec += (long)(interval % 1000) * 1000000L;
+        if (deadline.tv_nsec >= 1000000000L) { deadline.tv_sec++; deadline.tv_nsec -= 1000000000L; }
+        pthread_mutex_lock(&stop_lock);
+        while (!stop_requested) {
+            if (pthread_cond_timedwait(&stop_cv, &stop_lock, &deadline) == ETIMEDOUT) break;
+        }
+    }
+    pthread_mutex_unlock(&stop_lock);
+    return NULL;
+}
+
+int sampler_start(int interval_ms) {
+    if (running || interval_ms <= 0) return -1;
+    memset(slots, 0, sizeof(slots));
+    back = 0;
+    middle = 1;
+    front = 2;
+    interval = interval_ms;
+    io_prev_count = -1;
+    stop_requested = 0;
+    if (pthread_create(&thread, NULL, sampler_main, NULL) != 0) return -1;
+    running = 1;
+    return 0;
+}
+
+void sampler_stop() {
+    if (!running) return;
+    pthread_mutex_lock(&stop_lock);
+    stop_requested = 1;
+    pthread_cond_signal(&stop_cv);
+    pthread_mutex_unlock(&stop_lock);
+    pthread_join(thread, NULL);
+    running = 0;
+}
+
+const SystemSample* sampler_latest() {
+    if (!running) return NULL;
+    if (__atomic_load_n(&middle, __ATOMIC_ACQUIRE) & SLOT_FRESH) {
+        front = __atomic_exchange_n(&middle, front, __ATOMIC_ACQ_REL) & SLOT_MASK;
+    }
+    return slots[front].seq ? &slots[front] : NULL;
+}
+#endif
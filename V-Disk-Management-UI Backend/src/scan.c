@@ -0,0 +1,515 @@
+#ifdef __linux__
+#define _GNU_SOURCE // O_DIRECT
+#endif
+#define _POSIX_C_SOURCE 200809L
+#include "scan.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#ifndef _WIN32
+#include <pthread.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <time.h>
+#include <sys/stat.h>
+#include <sys/ioctl.h>
+#ifdef __linux__
+#include <linux/fs.h> // BLKGETSIZE64, BLKSSZGET
+#endif
+#endif
+
+void scan_options_init(ScanOptions* opt) {
+    memset(opt, 0, sizeof(*opt));
+    opt->chunk_bytes = SCAN_DEFAULT_CHUNK;
+    opt->inflight = SCAN_DEFAULT_INFLIGHT;
+    opt->timeout_ms = SCAN_DEFAULT_TIMEOUT_MS;
+    opt->direct = 1;
+    opt->backend = AIO_AUTO;
+}
+
+#ifdef _WIN32
+int scan_device(const char* path, const ScanOptions* opt, ScanResult* out) {
+    memset(out, 0, sizeof(*out));
+    out->status = -1;
+    return -1;
+}
+
+int scan_start(const char* path, const ScanOptions* opt) { return -1; }
+int scan_status(ScanResult* out, char* path, size_t path_len) { return -1; }
+void scan_cancel() {}
+long long scan_last_bad_sectors() { return -1; }
+#else
+// One scan in progress. The sweep thread owns the read queue and reports
+// into result under lock; everything else is fixed once it starts.
+typedef struct {
+    pthread_mutex_t lock;
+    ScanOptions opt;
+    int fd;                        // O_DIRECT when possible, for sweep and bisect
+    int fd_plain;                  // buffered, for reads O_DIRECT refuses
+    int direct;                    // fd was opened with O_DIRECT
+    size_t sector;                 // logical block size, the bisect's unit
+    unsigned long long size;
+    double next_slot;              // throttle: when the next read may start
+    int cancel;
+    ScanResult result;
+} Scan;
+
+static double now_s() {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (double)ts.tv_sec + (double)ts.tv_nsec / 1e9;
+}
+
+// Paces reads so the scan averages at most max_bytes_per_sec
+static void throttle(Scan* s, size_t len) {
+    if (s->opt.max_bytes_per_sec <= 0) return;
+    pthread_mutex_lock(&s->lock);
+    double now = now_s();
+    double start = s->next_slot > now ? s->next_slot : now;
+    s->next_slot = start + (double)len / s->opt.max_bytes_per_sec;
+    pthread_mutex_unlock(&s->lock);
+    double wait = start - now;
+    if (wait > 0) {
+        struct timespec ts = { (time_t)wait, (long)((wait - (double)(time_t)wait) * 1e9) };
+        nanosleep(&ts, NULL);
+    }
+}
+
+static ssize_t do_read(Scan* s, int fd, void* buf, size_t len, unsigned long long off) {
+    ssize_t r;
+    do {
+        r = s->opt.read_fn ? s->opt.read_fn(s->opt.read_ctx, fd, buf, len, (off_t)off)
+                           : pread(fd, buf, len, (off_t)off);
+    } while (r < 0 && errno == EINTR);
+    return r;
+}
+
+// Reads [off, off + want) and reports whether all of it came back in time.
+// len may exceed want to keep O_DIRECT transfers sector-aligned at EOF.
+// Reads bypass the page cache, which would otherwise serve a failed
+// sector's neighbours from a page read before and hide or widen the error.
+static int read_ok(Scan* s, void* buf, size_t len, size_t want, unsigned long long off, int* slow) {
+    throttle(s, len);
+    double t0 = now_s();
+    ssize_t r = do_read(s, s->direct ? s->fd : s->fd_plain, buf, len, off);
+    // alignment O_DIRECT will not take here: not a media error
+    if (r < 0 && errno == EINVAL && s->direct) r = do_read(s, s->fd_plain, buf, len, off);
+    *slow = (now_s() - t0) * 1000.0 > s->opt.timeout_ms;
+    return r >= 0 && (size_t)r >= want && !*slow;
+}
+
+// Inserts [first, first + count) keeping ranges sorted and merged
+static void add_bad(Scan* s, unsigned long long first, unsigned long long count) {
+    ScanResult* r = &s->result;
+    pthread_mutex_lock(&s->lock);
+    r->bad_sectors += count;
+    int i = 0;
+    while (i < r->range_count && r->ranges[i].first_sector + r->ranges[i].count < first) i++;
+    if (i < r->range_count && r->ranges[i].first_sector <= first + count) {
+        // touches range i: grow it, then swallow any later range it reaches
+        BadRange* g = &r->ranges[i];
+        unsigned long long end = g->first_sector + g->count;
+        if (first + count > end) end = first + count;
+        if (first < g->first_sector) g->first_sector = first;
+        g->count = end - g->first_sector;
+        while (i + 1 < r->range_count && r->ranges[i + 1].first_sector <= end) {
+            unsigned long long e2 = r->ranges[i + 1].first_sector + r->ranges[i + 1].count;
+            if (e2 > end) end = e2;
+            g->count = end - g->first_sector;
+            memmove(&r->ranges[i + 1], &r->ranges[i + 2], sizeof(BadRange) * (size_t)(r->range_count - i - 2));
+            r->range_count--;
+        }
+    } else if (r->range_count < SCAN_MAX_RANGES) {
+        memmove(&r->ranges[i + 1], &r->ranges[i], sizeof(BadRange) * (size_t)(r->range_count - i));
+        r->ranges[i].first_sector = first;
+        r->ranges[i].count = count;
+        r->range_count++;
+    } else {
+        r->ranges_truncated = 1;
+    }
+    pthread_mutex_unlock(&s->lock);
+}
+
+static int cancelled(Scan* s) {
+    pthread_mutex_lock(&s->lock);
+    int c = s->cancel;
+    pthread_mutex_unlock(&s->lock);
+    return c;
+}
+
+// Narrows a failed span down to the logical blocks that cannot be read.
+// off is block-aligned and buf is an aligned buffer of a whole chunk.
+static void bisect(Scan* s, char* buf, unsigned long long off, size_t len) {
+    size_t unit = s->sector;
+    if (len <= unit) {
+        add_bad(s, off / SCAN_SECTOR_BYTES, (len + SCAN_SECTOR_BYTES - 1) / SCAN_SECTOR_BYTES);
+        return;
+    }
+    size_t blocks = (len + unit - 1) / unit;
+    size_t left = blocks / 2 * unit;
+    unsigned long long offs[2] = { off, off + left };
+    size_t lens[2] = { left, len - left };
+    for (int h = 0; h < 2 && !cancelled(s); h++) {
+        int slow = 0;
+        size_t rlen = (lens[h] + unit - 1) / unit * unit;
+        if (!read_ok(s, buf, rlen, lens[h], offs[h], &slow)) {
+            if (slow) {
+                pthread_mutex_lock(&s->lock);
+                s->result.slow_reads++;
+                pthread_mutex_unlock(&s->lock);
+            }
+            bisect(s, buf, offs[h], lens[h]);
+        }
+    }
+}
+
+// A chunk read queued on the AioQueue. A read still out past its deadline
+// is abandoned: the sweep stops waiting for it, but the buffer stays with
+// the kernel (or pool thread) until the completion finally arrives.
+typedef enum { SLOT_IDLE = 0, SLOT_BUSY, SLOT_ABANDONED } SlotState;
+
+typedef struct {
+    char* buf;
+    unsigned long long off;
+    size_t want;
+    size_t len;
+    double t0;
+    SlotState state;
+} ScanSlot;
+
+// A failed chunk waiting to be bisected
+typedef struct {
+    unsigned long long off;
+    size_t want;
+} ScanSpan;
+
+#define SCAN_WAIT_SLICE_MS 100     // longest wait before cancel is checked again
+
+static void count_done(Scan* s, size_t bytes) {
+    pthread_mutex_lock(&s->lock);
+    s->result.bytes_scanned += bytes;
+    pthread_mutex_unlock(&s->lock);
+}
+
+static ScanSlot* slot_new(size_t bytes) {
+    ScanSlot* slot = (ScanSlot*)calloc(1, sizeof(ScanSlot));
+    void* mem = NULL;
+    if (!slot || posix_memalign(&mem, 4096, bytes) != 0) {
+        free(slot);
+        return NULL;
+    }
+    slot->buf = (char*)mem;
+    return slot;
+}
+
+static void slot_free(ScanSlot* slot) {
+    free(slot->buf);
+    free(slot);
+}
+
+// Keeps up to opt.inflight chunk reads queued until the end of the target.
+// Failed chunks are held until the live reads have drained and are
+// bisected only then, so the synchronous bisect reads neither compete with
+// the queue nor make its reads look slow. A read that overruns timeout_ms
+// is not waited for: its chunk is recorded as bad as a whole (reading into
+// a hung region again would only hang again) and a fresh buffer takes its
+// place. Returns -1 if the queue itself failed or every buffer is stuck.
+static int sweep(Scan* s) {
+    int depth = s->opt.inflight;
+    // room for as many abandoned reads as live ones
+    unsigned cap = (unsigned)depth * 2;
+    AioQueue* q = aio_open(cap, s->opt.backend, s->opt.read_fn, s->opt.read_ctx);
+    if (!q && s->opt.backend != AIO_AUTO) q = aio_open(cap, AIO_AUTO, s->opt.read_fn, s->opt.read_ctx);
+    if (!q) return -1;
+    pthread_mutex_lock(&s->lock);
+    s->result.io_backend = aio_backend(q);
+    pthread_mutex_unlock(&s->lock);
+
+    size_t chunk = s->opt.chunk_bytes;
+    ScanSlot* slots[SCAN_MAX_INFLIGHT * 2];
+    ScanSpan failed[SCAN_MAX_INFLIGHT * 2];
+    int nslots = 0, nfailed = 0, nabandoned = 0, rc = 0;
+    for (int i = 0; i < depth; i++) {
+        ScanSlot* slot = slot_new(chunk);
+        if (!slot) break;
+        slots[nslots++] = slot;
+    }
+    void* bisect_mem = NULL;
+    if (nslots == 0 || posix_memalign(&bisect_mem, 4096, chunk) != 0) rc = -1;
+
+    unsigned long long next_off = 0;
+    while (rc == 0) {
+        int cancel = cancelled(s);
+        int live = aio_inflight(q) - nabandoned;
+        for (int i = 0; !cancel && nfailed == 0 && live < depth && i < nslots && next_off < s->size; i++) {
+            ScanSlot* slot = slots[i];
+            if (slot->state != SLOT_IDLE) continue;
+            slot->off = next_off;
+            slot->want = s->size - next_off < chunk ? (size_t)(s->size - next_off) : chunk;
+            slot->len = (slot->want + s->sector - 1) / s->sector * s->sector;
+            next_off += chunk;
+            throttle(s, slot->len);
+            slot->t0 = now_s();
+            if (aio_read(q, s->fd, slot->buf, slot->len, (long long)slot->off, slot) != 0) {
+                next_off -= chunk;
+                break;
+            }
+            slot->state = SLOT_BUSY;
+            live++;
+        }
+        if (live == 0) {
+            if (nfailed == 0) {
+                // every buffer is held by a hung read: the device has stopped answering
+                if (!cancel && next_off < s->size) rc = -1;
+                break;
+            }
+            for (int i = 0; i < nfailed; i++) {
+                if (!cancel) {
+                    bisect(s, (char*)bisect_mem, failed[i].off, failed[i].want);
+                    count_done(s, failed[i].want);
+                }
+            }
+            nfailed = 0;
+            continue;
+        }
+
+        // wait no longer than the oldest live read has left, nor than a slice
+        double now = now_s();
+        double wait_ms = SCAN_WAIT_SLICE_MS;
+        for (int i = 0; i < nslots; i++) {
+            if (slots[i]->state != SLOT_BUSY) continue;
+            double left = slots[i]->t0 * 1000.0 + s->opt.timeout_ms - now * 1000.0;
+            if (left < wait_ms) wait_ms = left;
+        }
+        AioCompletion done[SCAN_MAX_INFLIGHT * 2];
+        int n = aio_wait_timeout(q, done, SCAN_MAX_INFLIGHT * 2, 1, wait_ms > 0 ? (int)wait_ms + 1 : 0);
+        if (n < 0) {
+            rc = -1;
+            break;
+        }
+        now = now_s();
+        for (int i = 0; i < n; i++) {
+            ScanSlot* slot = (ScanSlot*)done[i].tag;
+            long long res = done[i].res;
+            if (slot->state == SLOT_ABANDONED) {
+                // a hung read came back after all; its chunk is already counted
+                slot->state = SLOT_IDLE;
+                nabandoned--;
+                continue;
+            }
+            slot->state = SLOT_IDLE;
+            if (res == -EINVAL && s->direct) {
+                // alignment O_DIRECT will not take here: not a media error
+                res = do_read(s, s->fd_plain, slot->buf, slot->len, slot->off);
+                now = now_s();
+            }
+            int slow = (now - slot->t0) * 1000.0 > s->opt.timeout_ms;
+            if (res >= 0 && (size_t)res >= slot->want && !slow) {
+                count_done(s, slot->want);
+                continue;
+            }
+            pthread_mutex_lock(&s->lock);
+            s->result.failed_reads++;
+            if (slow) s->result.slow_reads++;
+            pthread_mutex_unlock(&s->lock);
+            failed[nfailed].off = slot->off;
+            failed[nfailed].want = slot->want;
+            nfailed++;
+        }
+        // reads past their deadline are written off instead of waited on
+        for (int i = 0; i < nslots; i++) {
+            ScanSlot* slot = slots[i];
+            if (slot->state != SLOT_BUSY || (now - slot->t0) * 1000.0 <= s->opt.timeout_ms) continue;
+            slot->state = SLOT_ABANDONED;
+            nabandoned++;
+            pthread_mutex_lock(&s->lock);
+            s->result.failed_reads++;
+            s->result.slow_reads++;
+            pthread_mutex_unlock(&s->lock);
+            add_bad(s, slot->off / SCAN_SECTOR_BYTES, (slot->want + SCAN_SECTOR_BYTES - 1) / SCAN_SECTOR_BYTES);
+            count_done(s, slot->want);
+            if (nslots < (int)cap) {
+                ScanSlot* fresh = slot_new(chunk);
+                if (fresh) slots[nslots++] = fresh;
+            }
+        }
+    }
+    free(bisect_mem);
+    // hung reads may still write into their buffers: if they do not finish
+    // within one more timeout, the queue and those buffers are left behind
+    int stuck = aio_close_timeout(q, nabandoned > 0 ? s->opt.timeout_ms : -1) != 0;
+    for (int i = 0; i < nslots; i++) {
+        if (!stuck || slots[i]->state == SLOT_IDLE) slot_free(slots[i]);
+    }
+    return rc;
+}
+
+static unsigned long long device_size(int fd) {
+    struct stat st;
+    if (fstat(fd, &st) != 0) return 0;
+#ifdef BLKGETSIZE64
+    if (S_ISBLK(st.st_mode)) {
+        unsigned long long bytes = 0;
+        if (ioctl(fd, BLKGETSIZE64, &bytes) == 0) return bytes;
+    }
+#endif
+    return (unsigned long long)st.st_size;
+}
+
+// O_DIRECT transfer unit: the logical block size of a block device, and
+// the classic sector for images (whose reads fall back if it is refused)
+static size_t logical_block_size(int fd) {
+#ifdef BLKSSZGET
+    struct stat st;
+    int bytes = 0;
+    if (fstat(fd, &st) == 0 && S_ISBLK(st.st_mode) && ioctl(fd, BLKSSZGET, &bytes) == 0 &&
+        bytes >= SCAN_SECTOR_BYTES && bytes <= 4096 && (bytes & (bytes - 1)) == 0) return (size_t)bytes;
+#endif
+    return SCAN_SECTOR_BYTES;
+}
+
+// Opens the target, runs the sweep to completion and closes it again
+static int run_scan(Scan* s, const char* path) {
+    double t0 = now_s();
+    s->fd = -1;
+#ifdef O_DIRECT
+    if (s->opt.direct) s->fd = open(path, O_RDONLY | O_DIRECT);
+#endif
+    s->direct = s->fd >= 0;
+    if (s->fd < 0) s->fd = open(path, O_RDONLY); // filesystem refused O_DIRECT
+    s->fd_plain = open(path, O_RDONLY);
+    if (s->fd < 0 || s->fd_plain < 0) {
+        if (s->fd >= 0) close(s->fd);
+        if (s->fd_plain >= 0) close(s->fd_plain);
+        pthread_mutex_lock(&s->lock);
+        s->result.status = -1;
+        s->result.running = 0;
+        pthread_mutex_unlock(&s->lock);
+        return -1;
+    }
+#ifdef POSIX_FADV_RANDOM
+    // no readahead: a bisect read must touch only the sectors asked for
+    posix_fadvise(s->fd_plain, 0, 0, POSIX_FADV_RANDOM);
+#endif
+    pthread_mutex_lock(&s->lock);
+    s->size = device_size(s->fd);
+    s->sector = logical_block_size(s->fd);
+    // chunks start on block boundaries so every bisect read stays aligned
+    s->opt.chunk_bytes = (s->opt.chunk_bytes + s->sector - 1) / s->sector * s->sector;
+    s->result.bytes_total = s->size;
+    s->result.direct_io = s->direct;
+    s->result.sector_bytes = (unsigned)s->sector;
+    pthread_mutex_unlock(&s->lock);
+
+    int swept = sweep(s);
+    close(s->fd);
+    close(s->fd_plain);
+
+    pthread_mutex_lock(&s->lock);
+    s->result.elapsed_s = now_s() - t0;
+    s->result.status = swept != 0 ? -1 : s->cancel ? -2 : 0;
+    s->result.running = 0;
+    int status = s->result.status;
+    pthread_mutex_unlock(&s->lock);
+    return status;
+}
+
+static void prepare(Scan* s, const ScanOptions* opt) {
+    memset(&s->result, 0, sizeof(s->result));
+    if (opt) s->opt = *opt;
+    else scan_options_init(&s->opt);
+    s->opt.chunk_bytes = (s->opt.chunk_bytes + SCAN_SECTOR_BYTES - 1) / SCAN_SECTOR_BYTES * SCAN_SECTOR_BYTES;
+    if (s->opt.chunk_bytes == 0) s->opt.chunk_bytes = SCAN_DEFAULT_CHUNK;
+    if (s->opt.inflight <= 0) s->opt.inflight = 1;
+    if (s->opt.inflight > SCAN_MAX_INFLIGHT) s->opt.inflight = SCAN_MAX_INFLIGHT;
+    if (s->opt.timeout_ms <= 0) s->opt.timeout_ms = SCAN_DEFAULT_TIMEOUT_MS;
+    s->next_slot = 0;
+    s->cancel = 0;
+    s->result.running = 1;
+}
+
+int scan_device(const char* path, const ScanOptions* opt, ScanResult* out) {
+    Scan s;
+    memset(&s, 0, sizeof(s));
+    pthread_mutex_init(&s.lock, NULL);
+    prepare(&s, opt);
+    int r = path ? run_scan(&s, path) : -1;
+    if (out) {
+        *out = s.result;
+        if (!path) out->status = -1;
+    }
+    pthread_mutex_destroy(&s.lock);
+    return r;
+}
+
+// The background scan; job.lock also guards job_path and the flags below
+static Scan job = { .lock = PTHREAD_MUTEX_INITIALIZER };
+static char job_path[256];
+static int job_started = 0;
+static int job_thread_live = 0;
+static long long last_bad = -1;
+static pthread_t job_thread;
+
+static void* job_main(void* arg) {
+    char path[256];
+    pthread_mutex_lock(&job.lock);
+    memcpy(path, job_path, sizeof(path));
+    pthread_mutex_unlock(&job.lock);
+    int r = run_scan(&job, path);
+    pthread_mutex_lock(&job.lock);
+    if (r == 0) last_bad = (long long)job.result.bad_sectors;
+    pthread_mutex_unlock(&job.lock);
+    return NULL;
+}
+
+int scan_start(const char* path, const ScanOptions* opt) {
+    if (!path || strlen(path) >= sizeof(job_path)) return -1;
+    pthread_mutex_lock(&job.lock);
+    int busy = job.result.running;
+    pthread_mutex_unlock(&job.lock);
+    if (busy) return -1;
+    // the previous scan has finished; reap its thread before reusing job
+    if (job_thread_live) pthread_join(job_thread, NULL);
+    job_thread_live = 0;
+    pthread_mutex_lock(&job.lock);
+    prepare(&job, opt);
+    strcpy(job_path, path);
+    job_started = 1;
+    pthread_mutex_unlock(&job.lock);
+    if (pthread_create(&job_thread, NULL, job_main, NULL) != 0) {
+        pthread_mutex_lock(&job.lock);
+        job.result.running = 0;
+        job.result.status = -1;
+        pthread_mutex_unlock(&job.lock);
+        return -1;
+    }
+    job_thread_live = 1;
+    return 0;
+}
+
+int scan_status(ScanResult* out, char* path, size_t path_len) {
+    pthread_mutex_lock(&job.lock);
+    int started = job_started;
+    if (started && out) *out = job.result;
+    if (started && path && path_len) {
+        strncpy(path, job_path, path_len - 1);
+        path[path_len - 1] = '\0';
+    }
+    pthread_mutex_unlock(&job.lock);
+    return started ? 0 : -1;
+}
+
+void scan_cancel() {
+    pthread_mutex_lock(&job.lock);
+    job.cancel = 1;
+    pthread_mutex_unlock(&job.lock);
+}
+
+long long scan_last_bad_sectors() {
+    pthread_mutex_lock(&job.lock);
+    long long n = last_bad;
+    pthread_mutex_unlock(&job.lock);
+    return n;
+}
+#endif
@@ -1,445 +1,1147 @@
-// #define _POSIX_C_SOURCE 200809L
-// #include <stdio.h>
-// #include <stdlib.h>
-// #include <string.h>
-// #include <ctype.h>
-// #ifdef _WIN32
-// #include <io.h>
-// #else
-// #include <unistd.h>
-// #endif
-// #include <errno.h>
-// #include <stdint.h>
-// #ifdef _WIN32
-// #include <winsock2.h>
-// #include <ws2tcpip.h>
-// #pragma comment(lib, "ws2_32.lib")
-// #else
-// #include <netinet/in.h>
-// #include <sys/socket.h>
-// #include <sys/types.h>
-// #endif
-// #include "disk.h"
-// #include "utils.h"
-// #include "system_disk.h"
-// #include "server.h" // Include server.h so we can expose run_server()
-
-// #define RECV_BUF 8192
-// #define SEND_BUF 8192
-
-// // cross platform block
-// #ifdef _WIN32
-// #include <string.h>
-// #define strncasecmp _strnicmp
-// #else
-// #include <strings.h>
-// #endif
-// // end cross platform block
-
-// typedef struct {
-//     char method[8];
-//     char path[256];
-//     char protocol[16];
-//     int content_length;
-//     char body[RECV_BUF];
-// } HttpRequest;
-
-// static void send_json(int client_fd, int status, const char* json_data, const char* error_msg) {
-//     char header[SEND_BUF];
-//     StrBuf body;
-//     sb_init(&body, 1024);
-//     if (json_data) {
-//         sb_appendf(&body, "{ \"success\": 1, \"data\": %s, \"error\": null }", json_data);
-//     } else if (error_msg) {
-//         sb_appendf(&body, "{ \"success\": 0, \"data\": null, \"error\": \"%s\" }", error_msg);
-//     } else {
-//         sb_append(&body, "{ \"success\": 1, \"data\": null, \"error\": null }");
-//     }
-//     char* b = sb_take(&body);
-//     snprintf(header, sizeof(header),
-//              "HTTP/1.1 %d OK\r\n"
-//              "Content-Type: application/json\r\n"
-//              "Content-Length: %zu\r\n"
-//              "Connection: close\r\n\r\n",
-//              status, strlen(b));
-//     send(client_fd, header, strlen(header), 0);
-//     send(client_fd, b, strlen(b), 0);
-//     free(b);
-// }
-
-// static void send_json_kv(int client_fd, int status, const char* kv_pairs) {
-//     char buf[1024];
-//     snprintf(buf, sizeof(buf), "{ %s }", kv_pairs);
-//     send_json(client_fd, status, buf, NULL);
-// }
-
-// static int parse_request(int fd, HttpRequest* req) {
-//     char buf[RECV_BUF];
-//     int n = recv(fd, buf, sizeof(buf)-1, 0);
-//     if (n <= 0) return -1;
-//     buf[n] = '\0';
-
-//     char *line_end = strstr(buf, "\r\n");
-//     if (!line_end) return -1;
-//     *line_end = '\0';
-//     sscanf(buf, "%7s %255s %15s", req->method, req->path, req->protocol);
-
-//     char* p = line_end + 2;
-//     req->content_length = 0;
-//     while (1) {
-//         char* next = strstr(p, "\r\n");
-//         if (!next) return -1;
-//         if (next == p) { 
-//             p = next + 2;
-//             break;
-//         }
-//         *next = '\0';
-//         if (strncasecmp(p, "Content-Length:", 15) == 0) {
-//             req->content_length = atoi(p + 15);
-//         }
-//         p = next + 2;
-//     }
-
-//     int remaining = n - (int)(p - buf);
-//     if (remaining > 0) {
-//         int m = remaining < (int)sizeof(req->body)-1 ? remaining : (int)sizeof(req->body)-1;
-//         memcpy(req->body, p, m);
-//         req->body[m] = '\0';
-//     } else {
-//         req->body[0] = '\0';
-//     }
-//     return 0;
-// }
-
-// static void handle_client(int client_fd) {
-//     HttpRequest req;
-//     if (parse_request(client_fd, &req) != 0) {
-//         send_json(client_fd, 400, NULL, "Invalid request");
-//         return;
-//     }
-
-//     const char* m = req.method;
-//     const char* path = req.path;
-//     const char* body = req.body;
-
-//     char* response = NULL;
-
-//     if (strcmp(m, "POST") == 0 && strcmp(path, "/allocate/contiguous") == 0) {
-//         int size = 0; parse_json_int(req.body, "size", &size);
-//         if (size <= 0) { send_json(client_fd, 400, NULL, "size must be positive"); return; }
-//         int fid = 0;
-//         int r = disk_allocate_contiguous(size, &fid);
-//         if (r == 0) {
-//             char tmp[64]; snprintf(tmp, sizeof(tmp), "\"fileId\": %d", fid);
-//             send_json_kv(client_fd, 200, tmp);
-//         } else {
-//             send_json(client_fd, 409, NULL, "No contiguous space available");
-//         }
-//         return;
-//     }
-
-//     if (strcmp(m, "POST") == 0 && strcmp(path, "/allocate/fragmented") == 0) {
-//         int size = 0; parse_json_int(req.body, "size", &size);
-//         if (size <= 0) { send_json(client_fd, 400, NULL, "size must be positive"); return; }
-//         int fid = 0;
-//         int r = disk_allocate_fragmented(size, &fid);
-//         if (r == 0) {
-//             char tmp[64]; snprintf(tmp, sizeof(tmp), "\"fileId\": %d", fid);
-//             send_json_kv(client_fd, 200, tmp);
-//         } else {
-//             send_json(client_fd, 409, NULL, "Not enough free blocks");
-//         }
-//         return;
-//     }
-
-//     if (strcmp(m, "POST") == 0 && strcmp(path, "/allocate/custom") == 0) {
-//         int size = 0; parse_json_int(req.body, "size", &size);
-//         char strategy[32] = {0};
-//         if (parse_json_string(req.body, "strategy", strategy, sizeof(strategy)) != 0) {
-//             strncpy(strategy, "first-fit", sizeof(strategy)-1);
-//         }
-//         if (size <= 0) { send_json(client_fd, 400, NULL, "size must be positive"); return; }
-//         int fid = 0;
-//         int r = disk_allocate_custom(size, strategy, &fid);
-//         if (r == 0) {
-//             char tmp[128]; snprintf(tmp, sizeof(tmp), "\"fileId\": %d, \"strategy\": \"%s\"", fid, strategy);
-//             send_json_kv(client_fd, 200, tmp);
-//         } else {
-//             send_json(client_fd, 409, NULL, "Allocation failed");
-//         }
-//         return;
-//     }
-
-//     if (strcmp(m, "DELETE") == 0 && strncmp(path, "/file/", 6) == 0) {
-//         int id = atoi(path + 6);
-//         if (id <= 0) { send_json(client_fd, 400, NULL, "Invalid file id"); return; }
-//         int r = disk_logical_delete(id);
-//         if (r == 0) send_json(client_fd, 200, "{ \"deleted\": 1 }", NULL);
-//         else send_json(client_fd, 404, NULL, "File not found");
-//         return;
-//     }
-
-//     if (strcmp(m, "POST") == 0 && strcmp(path, "/undelete/last") == 0) {
-//         int r = disk_undelete_last();
-//         if (r == 0) send_json(client_fd, 200, "{ \"undeleted\": 1 }", NULL);
-//         else send_json(client_fd, 409, NULL, "No deletions to restore or space unavailable");
-//         return;
-//     }
-
-//     if (strcmp(m, "POST") == 0 && strcmp(path, "/defragment") == 0) {
-//         int r = disk_defragment();
-//         if (r == 0) send_json(client_fd, 200, "{ \"defragmented\": 1 }", NULL);
-//         else send_json(client_fd, 500, NULL, "Defragmentation failed");
-//         return;
-//     }
-
-//     if (strcmp(m, "POST") == 0 && strcmp(path, "/mark-bad") == 0) {
-//         int count = 0; parse_json_int(req.body, "count", &count);
-//         if (count <= 0) { send_json(client_fd, 400, NULL, "count must be positive"); return; }
-//         int r = disk_mark_random_bad(count);
-//         if (r == 0) send_json(client_fd, 200, "{ \"marked\": 1 }", NULL);
-//         else send_json(client_fd, 409, NULL, "Unable to mark requested number as bad");
-//         return;
-//     }
-
-//     if (strcmp(m, "GET") == 0 && strcmp(path, "/fragmentation") == 0) {
-//         double p = disk_fragmentation_percent();
-//         char tmp[128]; snprintf(tmp, sizeof(tmp), "{ \"fragmentationPercent\": %.2f }", p);
-//         send_json(client_fd, 200, tmp, NULL);
-//         return;
-//     }
-
-//     if (strcmp(m, "GET") == 0 && strcmp(path, "/api/system-disk") == 0) {
-//         response = handle_get_system_disk_info();
-//     } else if (strcmp(m, "POST") == 0 && strcmp(path, "/api/create-file") == 0) {
-//         response = handle_create_file(body);
-//     } else if (strcmp(m, "POST") == 0 && strcmp(path, "/api/delete-file") == 0) {
-//         response = handle_delete_file(body);
-//     } else if (strcmp(m, "GET") == 0 && strcmp(path, "/api/disk/state") == 0) {
-//         char* s = disk_get_state();
-//         if (s) { send_json(client_fd, 200, s, NULL); free(s); }
-//         else send_json(client_fd, 500, NULL, "Unable to build state");
-//         return;
-//     }
-
-//     if (strcmp(m, "GET") == 0 && strcmp(path, "/api/disk/files") == 0) {
-//         char* s = disk_get_files();
-//         if (s) { send_json(client_fd, 200, s, NULL); free(s); }
-//         else send_json(client_fd, 500, NULL, "Unable to build files");
-//         return;
-//     }
-
-//     if (strcmp(m, "GET") == 0 && strcmp(path, "/api/disk/stats") == 0) {
-//         char* s = disk_get_stats();
-//         if (s) { send_json(client_fd, 200, s, NULL); free(s); }
-//         else send_json(client_fd, 500, NULL, "Unable to build stats");
-//         return;
-//     }
-
-//     if (strcmp(m, "GET") == 0 && strcmp(path, "/api/disk/logs") == 0) {
-//         char* s = disk_get_logs();
-//         if (s) { send_json(client_fd, 200, s, NULL); free(s); }
-//         else send_json(client_fd, 500, NULL, "Unable to build logs");
-//         return;
-//     }
-
-//     if (strcmp(m, "POST") == 0 && strcmp(path, "/api/disk/reset") == 0) {
-//         int r = disk_reset();
-//         if (r == 0) send_json(client_fd, 200, "{ \"reset\": 1 }", NULL);
-//         else send_json(client_fd, 500, NULL, "Reset failed");
-//         return;
-//     }
-
-//     if (strcmp(m, "POST") == 0 && strcmp(path, "/api/repair") == 0) {
-//         int r = disk_repair();
-//         if (r == 0) send_json(client_fd, 200, "{ \"repaired\": 1 }", NULL);
-//         else send_json(client_fd, 500, NULL, "Repair failed");
-//         return;
-//     }
-
-//     // Not found
-//     send_json(client_fd, 404, NULL, "Endpoint not found");
-// }
-
-// char* handle_get_system_disk_info() {
-//     SystemDiskInfo info;
-//     if (get_system_disk_info(&info) != 0) {
-//         return utils_json_error("Failed to get system disk information");
-//     }
-    
-//     StrBuf sb;
-//     if (sb_init(&sb, 512) != 0) return utils_json_error("Out of memory");
-    
-//     sb_appendf(&sb, "{"
-//         "\"total\": %.0f,"
-//         "\"free\": %.0f,"
-//         "\"used\": %.0f,"
-//         "\"usedPercentage\": %.2f,"
-//         "\"freePercentage\": %.2f,"
-//         "\"badSectors\": %d,"
-//         "\"path\": \"%s\""
-//         "}",
-//         info.total_gb,
-//         info.free_gb,
-//         info.used_gb,
-//         info.used_percentage,
-//         100.0 - info.used_percentage,
-//         info.bad_sectors,
-//         info.path
-//     );
-    
-//     return sb_take(&sb);
-// }
-
-// char* handle_create_file(const char* body) {
-//     // Parse JSON to get filename and size
-//     char filename[256] = {0};
-//     int size = 0;
-    
-//     // Simple JSON parsing (in a real implementation, you'd use a proper JSON library)
-//     const char* name_ptr = strstr(body, "\"filename\"");
-//     if (name_ptr) {
-//         name_ptr = strchr(name_ptr, ':');
-//         if (name_ptr) {
-//             name_ptr = strchr(name_ptr, '"');
-//             if (name_ptr) {
-//                 name_ptr++;
-//                 const char* end_quote = strchr(name_ptr, '"');
-//                 if (end_quote && end_quote - name_ptr < sizeof(filename) - 1) {
-//                     strncpy(filename, name_ptr, end_quote - name_ptr);
-//                     filename[end_quote - name_ptr] = '\0';
-//                 }
-//             }
-//         }
-//     }
-    
-//     const char* size_ptr = strstr(body, "\"size\"");
-//     if (size_ptr) {
-//         size_ptr = strchr(size_ptr, ':');
-//         if (size_ptr) {
-//             size = atoi(size_ptr + 1);
-//         }
-//     }
-    
-//     if (strlen(filename) == 0) {
-//         return utils_json_error("Filename is required");
-//     }
-    
-//     // Create the file on the actual disk
-//     if (create_file_on_disk(filename, size) != 0) {
-//         return utils_json_error("Failed to create file");
-//     }
-    
-//     StrBuf sb;
-//     if (sb_init(&sb, 256) != 0) return utils_json_error("Out of memory");
-    
-//     sb_appendf(&sb, "{\"success\": true, \"message\": \"File %s created successfully\"}", filename);
-//     return sb_take(&sb);
-// }
-
-// char* handle_delete_file(const char* body) {
-//     // Parse JSON to get filename
-//     char filename[256] = {0};
-    
-//     // Simple JSON parsing
-//     const char* name_ptr = strstr(body, "\"filename\"");
-//     if (name_ptr) {
-//         name_ptr = strchr(name_ptr, ':');
-//         if (name_ptr) {
-//             name_ptr = strchr(name_ptr, '"');
-//             if (name_ptr) {
-//                 name_ptr++;
-//                 const char* end_quote = strchr(name_ptr, '"');
-//                 if (end_quote && end_quote - name_ptr < sizeof(filename) - 1) {
-//                     strncpy(filename, name_ptr, end_quote - name_ptr);
-//                     filename[end_quote - name_ptr] = '\0';
-//                 }
-//             }
-//         }
-//     }
-    
-//     if (strlen(filename) == 0) {
-//         return utils_json_error("Filename is required");
-//     }
-    
-//     // Delete the file from the actual disk
-//     if (delete_file_from_disk(filename) != 0) {
-//         return utils_json_error("Failed to delete file");
-//     }
-    
-//     StrBuf sb;
-//     if (sb_init(&sb, 256) != 0) return utils_json_error("Out of memory");
-    
-//     sb_appendf(&sb, "{\"success\": true, \"message\": \"File %s deleted successfully\"}", filename);
-//     return sb_take(&sb);
-// }
-
-// int run_server(int port) {
-// #ifdef _WIN32
-//     WSADATA wsa;
-//     if (WSAStartup(MAKEWORD(2,2), &wsa) != 0) {
-//         fprintf(stderr, "WSAStartup failed.\n");
-//         return 1;
-//     }
-// #endif
-
-//     const char* persist_env = getenv("DATA_FILE");
-//     disk_init(persist_env && persist_env[0] ? persist_env : "disk_state.json");
-
-//     int server_fd = socket(AF_INET, SOCK_STREAM, 0);
-//     if (server_fd < 0) { 
-//         perror("socket");
-// #ifdef _WIN32
-//         WSACleanup();
-// #endif
-//         return 1;
-//     }
-
-//     int opt = 1;
-//     setsockopt(server_fd, SOL_SOCKET, SO_REUSEADDR, &opt, sizeof(opt));
-
-//     struct sockaddr_in addr;
-//     memset(&addr, 0, sizeof(addr));
-//     addr.sin_family = AF_INET;
-//     addr.sin_addr.s_addr = htonl(INADDR_ANY);
-//     addr.sin_port = htons((uint16_t)port);
-
-//     if (bind(server_fd, (struct sockaddr*)&addr, sizeof(addr)) < 0) {
-//         perror("bind");
-//         close(server_fd);
-// #ifdef _WIN32
-//         WSACleanup();
-// #endif
-//         return 1;
-//     }
-
-//     if (listen(server_fd, 16) < 0) {
-//         perror("listen");
-//         close(server_fd);
-// #ifdef _WIN32
-//         WSACleanup();
-// #endif
-//         return 1;
-//     }
-
-//     printf("Disk Management Simulator server listening on port %d\n", port);
-
-//     while (1) {
-//         struct sockaddr_in cli;
-//         socklen_t clilen = sizeof(cli);
-//         int client_fd = accept(server_fd, (struct sockaddr*)&cli, &clilen);
-//         if (client_fd < 0) {
-//             perror("accept");
-//             continue;
-//         }
-//         handle_client(client_fd);
-//         close(client_fd);
-//     }
-
-//     close(server_fd);
-//     disk_shutdown();
-// #ifdef _WIN32
-//     WSACleanup();
-// #endif
-//     return 0;
-// }
+#define _POSIX_C_SOURCE 200809L
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <ctype.h>
+#ifdef _WIN32
+#include <io.h>
+#else
+#include <unistd.h>
+#endif
+#include <errno.h>
+#include <stdint.h>
+#ifdef _WIN32
+#include <winsock2.h>
+#include <ws2tcpip.h>
+#pragma comment(lib, "ws2_32.lib")
+#else
+#include <netinet/in.h>
+#include <netinet/tcp.h>
+#include <sys/socket.h>
+#include <sys/types.h>
+#include <sys/uio.h>
+#include <sys/time.h>
+#endif
+#include "disk.h"
+#include "utils.h"
+#include "system_disk.h"
+#include "sampler.h"
+#include "diskstats.h"
+#include "timeseries.h"
+#include "forecast.h"
+#include "scan.h"
+#include "backing.h"
+#include "compress.h"
+#include "http.h"
+#include "router.h"
+#include "json.h"
+#include "server.h" // Include server.h so we can expose run_server()
+
+#define RECV_TIMEOUT_SEC 5
+
+// cross platform block
+#ifdef _WIN32
+#include <string.h>
+#define strncasecmp _strnicmp
+struct iovec { void* iov_base; size_t iov_len; };
+#else
+#include <strings.h>
+#ifndef MSG_NOSIGNAL
+#define MSG_NOSIGNAL 0
+#endif
+#endif
+// end cross platform block
+
+#define ARENA_SIZE (HTTP_MAX_REQUEST_BYTES + 64)
+#define RESP_INITIAL_CAP (64 * 1024)
+
+typedef enum {
+    ENC_IDENTITY = 0,
+    ENC_GZIP,
+    ENC_DEFLATE,
+    ENC_COUNT
+} Encoding;
+
+// Per-connection state. Connections are served one at a time, so a single
+// context is reused: the arena is reset after every request and the
+// response buffer keeps its capacity, so steady-state request handling
+// performs no malloc/free.
+typedef struct {
+    Arena arena;         // request scratch (receive buffer)
+    StrBuf out;          // response payload; the envelope is gathered around it
+    StrBuf zout;         // compressed response body
+    Deflater deflater;
+    unsigned accept_enc; // Accept-Encoding of the current request
+} Conn;
+
+static Conn g_conn;
+
+// Compression knobs (COMPRESS_LEVEL=0 disables, COMPRESS_MIN_BYTES threshold)
+static int g_compress_level = COMPRESS_LEVEL_DEFAULT;
+static size_t g_compress_min = 1024;
+
+// Precomputed response fragments; a response is sent as one gathered write:
+// status line, fixed headers, Content-Length, envelope prefix, payload, suffix
+static const char HDR_FIXED[] = "Content-Type: application/json\r\nConnection: close\r\nContent-Length: ";
+static const char ENV_OK_PREFIX[] = "{ \"success\": 1, \"data\": ";
+static const char ENV_OK_SUFFIX[] = ", \"error\": null }";
+static const char ENV_ERR_PREFIX[] = "{ \"success\": 0, \"data\": null, \"error\": \"";
+static const char ENV_ERR_SUFFIX[] = "\" }";
+static const char ENV_NULL_DATA[] = "null";
+static const char* const ENC_HEADERS[ENC_COUNT] = {
+    "",
+    "Content-Encoding: gzip\r\nVary: Accept-Encoding\r\n",
+    "Content-Encoding: deflate\r\nVary: Accept-Encoding\r\n"
+};
+
+static const char* status_line(int status) {
+    switch (status) {
+        case 200: return "HTTP/1.1 200 OK\r\n";
+        case 400: return "HTTP/1.1 400 Bad Request\r\n";
+        case 404: return "HTTP/1.1 404 Not Found\r\n";
+        case 405: return "HTTP/1.1 405 Method Not Allowed\r\n";
+        case 409: return "HTTP/1.1 409 Conflict\r\n";
+        case 413: return "HTTP/1.1 413 Payload Too Large\r\n";
+        case 431: return "HTTP/1.1 431 Request Header Fields Too Large\r\n";
+        case 501: return "HTTP/1.1 501 Not Implemented\r\n";
+        case 507: return "HTTP/1.1 507 Insufficient Storage\r\n";
+        default:  return "HTTP/1.1 500 Internal Server Error\r\n";
+    }
+}
+
+#define IOV_SET(v, p, n) do { (v).iov_base = (void*)(p); (v).iov_len = (n); } while (0)
+
+// Write all iovecs, resuming after short writes
+static int send_iov(int client_fd, struct iovec* iov, int cnt) {
+#ifdef _WIN32
+    for (int i = 0; i < cnt; i++) {
+        if (send(client_fd, (const char*)iov[i].iov_base, (int)iov[i].iov_len, 0) < 0) return -1;
+    }
+    return 0;
+#else
+    while (cnt > 0) {
+        struct msghdr msg;
+        memset(&msg, 0, sizeof(msg));
+        msg.msg_iov = iov;
+        msg.msg_iovlen = (size_t)cnt;
+        ssize_t n = sendmsg(client_fd, &msg, MSG_NOSIGNAL);
+        if (n < 0) {
+            if (errno == EINTR) continue;
+            return -1;
+        }
+        while (cnt > 0 && (size_t)n >= iov->iov_len) {
+            n -= (ssize_t)iov->iov_len;
+            iov++;
+            cnt--;
+        }
+        if (cnt > 0) {
+            iov->iov_base = (char*)iov->iov_base + n;
+            iov->iov_len -= (size_t)n;
+        }
+    }
+    return 0;
+#endif
+}
+
+// Preferred encoding for a body of len bytes given the client's
+// Accept-Encoding; small bodies are not worth compressing
+static Encoding pick_encoding(size_t len) {
+    if (g_compress_level <= 0 || len < g_compress_min) return ENC_IDENTITY;
+    if (g_conn.accept_enc & (1u << ENC_GZIP)) return ENC_GZIP;
+    if (g_conn.accept_enc & (1u << ENC_DEFLATE)) return ENC_DEFLATE;
+    return ENC_IDENTITY;
+}
+
+// Compress the three body pieces into g_conn.zout; returns -1 (send the
+// identity body instead) on failure or when compression does not pay off
+static int compress_body(Encoding enc, const struct iovec* body, int cnt, size_t total) {
+    Deflater* d = &g_conn.deflater;
+    deflater_begin(d);
+    for (int i = 0; i < cnt; i++) {
+        if (deflater_write(d, body[i].iov_base, body[i].iov_len) != 0) return -1;
+    }
+    sb_reset(&g_conn.zout);
+    if (deflater_finish(d, enc == ENC_GZIP ? COMPRESS_GZIP : COMPRESS_ZLIB, &g_conn.zout) != 0) return -1;
+    return g_conn.zout.len < total ? 0 : -1;
+}
+
+// Content-Length digits plus the blank line ending the headers, written
+// backwards into buf; returns the start
+static char* format_content_length(char* buf, size_t cap, size_t total) {
+    char* p = buf + cap;
+    *--p = '\n'; *--p = '\r'; *--p = '\n'; *--p = '\r';
+    do { *--p = (char)('0' + total % 10); total /= 10; } while (total);
+    return p;
+}
+
+static void send_envelope(int client_fd, int status, const char* prefix, size_t prefix_len,
+                          const char* payload, size_t payload_len,
+                          const char* suffix, size_t suffix_len) {
+    struct iovec iov[7];
+    IOV_SET(iov[4], prefix, prefix_len);
+    IOV_SET(iov[5], payload, payload_len);
+    IOV_SET(iov[6], suffix, suffix_len);
+    int cnt = 7;
+    size_t total = prefix_len + payload_len + suffix_len;
+    Encoding enc = pick_encoding(total);
+    if (enc != ENC_IDENTITY) {
+        if (compress_body(enc, &iov[4], 3, total) == 0) {
+            IOV_SET(iov[4], g_conn.zout.buf, g_conn.zout.len);
+            total = g_conn.zout.len;
+            cnt = 5;
+        } else {
+            enc = ENC_IDENTITY;
+        }
+    }
+
+    char clen[32];
+    char* p = format_content_length(clen, sizeof(clen), total);
+    const char* sl = status_line(status);
+    IOV_SET(iov[0], sl, strlen(sl));
+    IOV_SET(iov[1], ENC_HEADERS[enc], strlen(ENC_HEADERS[enc]));
+    IOV_SET(iov[2], HDR_FIXED, sizeof(HDR_FIXED) - 1);
+    IOV_SET(iov[3], p, (size_t)(clen + sizeof(clen) - p));
+    send_iov(client_fd, iov, cnt);
+}
+
+// Response builder: payload writers append into the connection buffer,
+// then send_data() gathers it between the envelope fragments.
+static StrBuf* begin_data() {
+    sb_reset(&g_conn.out);
+    return &g_conn.out;
+}
+
+static void send_data(int client_fd, int status) {
+    send_envelope(client_fd, status, ENV_OK_PREFIX, sizeof(ENV_OK_PREFIX) - 1,
+                  g_conn.out.buf, g_conn.out.len, ENV_OK_SUFFIX, sizeof(ENV_OK_SUFFIX) - 1);
+}
+
+static void send_json(int client_fd, int status, const char* json_data, const char* error_msg) {
+    if (json_data) {
+        send_envelope(client_fd, status, ENV_OK_PREFIX, sizeof(ENV_OK_PREFIX) - 1,
+                      json_data, strlen(json_data), ENV_OK_SUFFIX, sizeof(ENV_OK_SUFFIX) - 1);
+    } else if (error_msg) {
+        send_envelope(client_fd, status, ENV_ERR_PREFIX, sizeof(ENV_ERR_PREFIX) - 1,
+                      error_msg, strlen(error_msg), ENV_ERR_SUFFIX, sizeof(ENV_ERR_SUFFIX) - 1);
+    } else {
+        send_envelope(client_fd, status, ENV_OK_PREFIX, sizeof(ENV_OK_PREFIX) - 1,
+                      ENV_NULL_DATA, sizeof(ENV_NULL_DATA) - 1, ENV_OK_SUFFIX, sizeof(ENV_OK_SUFFIX) - 1);
+    }
+}
+
+static void send_json_kv(int client_fd, int status, const char* kv_pairs) {
+    sb_appendf(begin_data(), "{ %s }", kv_pairs);
+    send_data(client_fd, status);
+}
+
+// Appends s as a JSON string literal
+static void append_json_string(StrBuf* sb, const char* s) {
+    sb_append(sb, "\"");
+    for (; *s; s++) {
+        unsigned char c = (unsigned char)*s;
+        if (c == '"' || c == '\\') sb_appendf(sb, "\\%c", c);
+        else if (c < 0x20) sb_appendf(sb, "\\u%04x", c);
+        else sb_append_n(sb, s, 1);
+    }
+    sb_append(sb, "\"");
+}
+
+// Response cache for read endpoints derived only from the simulated disk.
+// Entries hold the fully framed HTTP response, one per content encoding,
+// so a hit is a single write; the disk core's mutation hook drops every
+// entry.
+typedef enum {
+    CACHE_STATE = 0,
+    CACHE_FILES,
+    CACHE_STATS,
+    CACHE_FRAGMENTATION,
+    CACHE_SLOTS
+} CacheSlot;
+
+typedef struct {
+    int valid[ENC_COUNT];
+    StrBuf framed[ENC_COUNT]; // status line + headers + envelope + payload
+} CacheEntry;
+
+static CacheEntry g_cache[CACHE_SLOTS];
+
+static void cache_invalidate_all(void* ctx) {
+    for (int i = 0; i < CACHE_SLOTS; i++) {
+        for (int e = 0; e < ENC_COUNT; e++) g_cache[i].valid[e] = 0;
+    }
+}
+
+// Hands the simulator's figures to the sampler for the time series
+static void publish_sim_stats() {
+    sampler_set_sim_stats(disk_total_used(), disk_total_free(), disk_total_bad(), disk_fragmentation_percent());
+}
+
+static void on_disk_mutation(void* ctx) {
+    cache_invalidate_all(ctx);
+    publish_sim_stats();
+}
+
+static int cache_init() {
+    for (int i = 0; i < CACHE_SLOTS; i++) {
+        for (int e = 0; e < ENC_COUNT; e++) {
+            g_cache[i].valid[e] = 0;
+            if (sb_init(&g_cache[i].framed[e], 1024) != 0) return -1;
+        }
+    }
+    disk_set_mutation_hook(on_disk_mutation, NULL);
+    publish_sim_stats();
+    return 0;
+}
+
+static void cache_free() {
+    disk_set_mutation_hook(NULL, NULL);
+    for (int i = 0; i < CACHE_SLOTS; i++) {
+        for (int e = 0; e < ENC_COUNT; e++) sb_free(&g_cache[i].framed[e]);
+    }
+}
+
+// Frame a 200 response around payload into dst, compressed with enc when
+// that pays off
+static int frame_ok_response(StrBuf* dst, Encoding enc, const char* payload, size_t payload_len) {
+    struct iovec body[3];
+    IOV_SET(body[0], ENV_OK_PREFIX, sizeof(ENV_OK_PREFIX) - 1);
+    IOV_SET(body[1], payload, payload_len);
+    IOV_SET(body[2], ENV_OK_SUFFIX, sizeof(ENV_OK_SUFFIX) - 1);
+    int cnt = 3;
+    size_t total = body[0].iov_len + payload_len + body[2].iov_len;
+    if (enc != ENC_IDENTITY) {
+        if (compress_body(enc, body, 3, total) == 0) {
+            IOV_SET(body[0], g_conn.zout.buf, g_conn.zout.len);
+            total = g_conn.zout.len;
+            cnt = 1;
+        } else {
+            enc = ENC_IDENTITY;
+        }
+    }
+    sb_reset(dst);
+    if (sb_append(dst, status_line(200)) != 0) return -1;
+    if (sb_append(dst, ENC_HEADERS[enc]) != 0) return -1;
+    if (sb_append_n(dst, HDR_FIXED, sizeof(HDR_FIXED) - 1) != 0) return -1;
+    char clen[32];
+    char* p = format_content_length(clen, sizeof(clen), total);
+    if (sb_append_n(dst, p, (size_t)(clen + sizeof(clen) - p)) != 0) return -1;
+    for (int i = 0; i < cnt; i++) {
+        if (sb_append_n(dst, (const char*)body[i].iov_base, body[i].iov_len) != 0) return -1;
+    }
+    return 0;
+}
+
+static int write_fragmentation(StrBuf* out) {
+    return sb_appendf(out, "{ \"fragmentationPercent\": %.2f }", disk_fragmentation_percent());
+}
+
+static void send_cached(int client_fd, CacheSlot slot, int (*writer)(StrBuf*), const char* error_msg) {
+    CacheEntry* e = &g_cache[slot];
+    // the threshold check needs the size, so pick from the identity variant
+    // when it is known and otherwise optimistically from the client's list
+    Encoding enc = e->valid[ENC_IDENTITY] ? pick_encoding(e->framed[ENC_IDENTITY].len) : pick_encoding((size_t)-1);
+    if (!e->valid[enc]) {
+        if (writer(begin_data()) != 0) { send_json(client_fd, 500, NULL, error_msg); return; }
+        size_t total = (sizeof(ENV_OK_PREFIX) - 1) + g_conn.out.len + (sizeof(ENV_OK_SUFFIX) - 1);
+        enc = pick_encoding(total);
+        if (!e->valid[enc]) {
+            if (frame_ok_response(&e->framed[enc], enc, g_conn.out.buf, g_conn.out.len) != 0) {
+                send_data(client_fd, 200);
+                return;
+            }
+            e->valid[enc] = 1;
+        }
+    }
+    struct iovec iov[1];
+    IOV_SET(iov[0], e->framed[enc].buf, e->framed[enc].len);
+    send_iov(client_fd, iov, 1);
+}
+
+// Bitmask of supported encodings listed in an Accept-Encoding value;
+// entries with q=0 are refused
+static unsigned parse_accept_encoding(const char* v) {
+    unsigned mask = 0;
+    while (*v) {
+        while (*v == ' ' || *v == '\t' || *v == ',') v++;
+        const char* tok = v;
+        while (*v && *v != ',' && *v != ';' && *v != ' ') v++;
+        size_t n = (size_t)(v - tok);
+        int refused = 0;
+        while (*v && *v != ',') {
+            if (*v == 'q' && v[1] == '=') refused = strtod(v + 2, NULL) <= 0.0;
+            v++;
+        }
+        if (refused) continue;
+        if (n == 4 && strncasecmp(tok, "gzip", 4) == 0) mask |= 1u << ENC_GZIP;
+        else if (n == 7 && strncasecmp(tok, "deflate", 7) == 0) mask |= 1u << ENC_DEFLATE;
+        else if (n == 1 && *tok == '*') mask |= (1u << ENC_GZIP) | (1u << ENC_DEFLATE);
+    }
+    return mask;
+}
+
+// Read until the parser has a complete request. Returns 0 on success,
+// 1 when an error response was already sent, -1 when the client went away.
+static int read_request(int fd, HttpRequest* req) {
+    char* buf = (char*)arena_alloc(&g_conn.arena, HTTP_MAX_REQUEST_BYTES + 1);
+    if (!buf) return -1;
+    HttpParser parser;
+    http_parser_init(&parser, req);
+    size_t len = 0;
+    while (len < HTTP_MAX_REQUEST_BYTES) {
+        int n = recv(fd, buf + len, (int)(HTTP_MAX_REQUEST_BYTES - len), 0);
+        if (n < 0 && errno == EINTR) continue;
+        if (n <= 0) {
+            // a partial request is answered; silence (or a timeout) is not
+            if (len == 0) return -1;
+            send_json(fd, 400, NULL, "Incomplete request");
+            return 1;
+        }
+        len += (size_t)n;
+        HttpParseState st = http_parse(&parser, req, buf, len);
+        if (st == HTTP_PARSE_DONE) return 0;
+        if (st == HTTP_PARSE_ERROR) {
+            send_json(fd, parser.error_status, NULL, parser.error);
+            return 1;
+        }
+    }
+    send_json(fd, 413, NULL, "Request too large");
+    return 1;
+}
+
+// Extracts fields from a JSON request body; answers 400 if it is malformed
+static int parse_body(int client_fd, const HttpRequest* req, JsonField* fields, int nfields) {
+    if (json_extract(req->body, req->body_len, fields, nfields) == 0) return 0;
+    send_json(client_fd, 400, NULL, "Request body must be a JSON object");
+    return -1;
+}
+
+static void handle_allocate_contiguous(int client_fd, const HttpRequest* req, const RouteParams* params) {
+    int size = 0;
+    JsonField fields[] = { { "size", JSON_FIELD_INT, &size, 0, 0, 0 } };
+    if (parse_body(client_fd, req, fields, 1) != 0) return;
+    if (size <= 0) { send_json(client_fd, 400, NULL, "size must be positive"); return; }
+    int fid = 0;
+    int r = disk_allocate_contiguous(size, &fid);
+    if (r == 0) {
+        char tmp[64]; snprintf(tmp, sizeof(tmp), "\"fileId\": %d", fid);
+        send_json_kv(client_fd, 200, tmp);
+    } else {
+        send_json(client_fd, 409, NULL, "No contiguous space available");
+    }
+}
+
+static void handle_allocate_fragmented(int client_fd, const HttpRequest* req, const RouteParams* params) {
+    int size = 0;
+    JsonField fields[] = { { "size", JSON_FIELD_INT, &size, 0, 0, 0 } };
+    if (parse_body(client_fd, req, fields, 1) != 0) return;
+    if (size <= 0) { send_json(client_fd, 400, NULL, "size must be positive"); return; }
+    int fid = 0;
+    int r = disk_allocate_fragmented(size, &fid);
+    if (r == 0) {
+        char tmp[64]; snprintf(tmp, sizeof(tmp), "\"fileId\": %d", fid);
+        send_json_kv(client_fd, 200, tmp);
+    } else {
+        send_json(client_fd, 409, NULL, "Not enough free blocks");
+    }
+}
+
+static void handle_allocate_custom(int client_fd, const HttpRequest* req, const RouteParams* params) {
+    int size = 0;
+    char strategy[32] = {0};
+    JsonField fields[] = {
+        { "size", JSON_FIELD_INT, &size, 0, 0, 0 },
+        { "strategy", JSON_FIELD_STRING, strategy, sizeof(strategy), 0, 0 },
+    };
+    if (parse_body(client_fd, req, fields, 2) != 0) return;
+    if (fields[1].found < 0) { send_json(client_fd, 400, NULL, "Invalid strategy"); return; }
+    if (fields[1].found == 0) strncpy(strategy, "first-fit", sizeof(strategy)-1);
+    if (size <= 0) { send_json(client_fd, 400, NULL, "size must be positive"); return; }
+    int fid = 0;
+    int r = disk_allocate_custom(size, strategy, &fid);
+    if (r == 0) {
+        char tmp[128]; snprintf(tmp, sizeof(tmp), "\"fileId\": %d, \"strategy\": \"%s\"", fid, strategy);
+        send_json_kv(client_fd, 200, tmp);
+    } else {
+        send_json(client_fd, 409, NULL, "Allocation failed");
+    }
+}
+
+static void handle_delete_block_file(int client_fd, const HttpRequest* req, const RouteParams* params) {
+    const char* id_str = route_param(params, "id");
+    int id = id_str ? atoi(id_str) : 0;
+    if (id <= 0) { send_json(client_fd, 400, NULL, "Invalid file id"); return; }
+    int r = disk_logical_delete(id);
+    if (r == 0) send_json(client_fd, 200, "{ \"deleted\": 1 }", NULL);
+    else send_json(client_fd, 404, NULL, "File not found");
+}
+
+static void handle_undelete_last(int client_fd, const HttpRequest* req, const RouteParams* params) {
+    int r = disk_undelete_last();
+    if (r == 0) send_json(client_fd, 200, "{ \"undeleted\": 1 }", NULL);
+    else send_json(client_fd, 409, NULL, "No deletions to restore or space unavailable");
+}
+
+static void handle_defragment(int client_fd, const HttpRequest* req, const RouteParams* params) {
+    int r = disk_defragment();
+    if (r == 0) send_json(client_fd, 200, "{ \"defragmented\": 1 }", NULL);
+    else send_json(client_fd, 500, NULL, "Defragmentation failed");
+}
+
+static void handle_mark_bad(int client_fd, const HttpRequest* req, const RouteParams* params) {
+    int count = 0;
+    JsonField fields[] = { { "count", JSON_FIELD_INT, &count, 0, 0, 0 } };
+    if (parse_body(client_fd, req, fields, 1) != 0) return;
+    if (count <= 0) { send_json(client_fd, 400, NULL, "count must be positive"); return; }
+    int r = disk_mark_random_bad(count);
+    if (r == 0) send_json(client_fd, 200, "{ \"marked\": 1 }", NULL);
+    else send_json(client_fd, 409, NULL, "Unable to mark requested number as bad");
+}
+
+static void handle_get_fragmentation(int client_fd, const HttpRequest* req, const RouteParams* params) {
+    send_cached(client_fd, CACHE_FRAGMENTATION, write_fragmentation, "Unable to build fragmentation");
+}
+
+static void handle_get_system_disk_info(int client_fd, const HttpRequest* req, const RouteParams* params) {
+    // serve the collector's latest sample; query directly if there is none
+    const SystemSample* sample = sampler_latest();
+    SystemDiskInfo info;
+    long long sampled_ms = 0;
+    if (sample && sample->root_status == 0) {
+        info = sample->root;
+        sampled_ms = sample->sampled_ms;
+    } else if (get_system_disk_info(&info) != 0) {
+        send_json(client_fd, 500, NULL, "Failed to get system disk information");
+        return;
+    } else {
+        sampled_ms = utils_now_ms();
+    }
+    long long bad = scan_last_bad_sectors();
+    if (bad >= 0) info.bad_sectors = (int)bad;
+
+    sb_appendf(begin_data(), "{"
+        "\"total\": %.0f,"
+        "\"free\": %.0f,"
+        "\"used\": %.0f,"
+        "\"usedPercentage\": %.2f,"
+        "\"freePercentage\": %.2f,"
+        "\"badSectors\": %d,"
+        "\"path\": \"%s\","
+        "\"sampledAt\": %lld"
+        "}",
+        info.total_gb,
+        info.free_gb,
+        info.used_gb,
+        info.used_percentage,
+        100.0 - info.used_percentage,
+        info.bad_sectors,
+        info.path,
+        sampled_ms
+    );
+    send_data(client_fd, 200);
+}
+
+static void handle_get_system_mounts(int client_fd, const HttpRequest* req, const RouteParams* params) {
+    static SystemMountInfo probed[SYSTEM_MAX_MOUNTS];
+    long long timeout = SYSTEM_MOUNT_TIMEOUT_MS;
+    int explicit_timeout = parse_query_long(req->query, "timeoutMs", &timeout) == 0;
+    if (explicit_timeout && (timeout <= 0 || timeout > 60000)) {
+        send_json(client_fd, 400, NULL, "timeoutMs must be between 1 and 60000");
+        return;
+    }
+    // the sampled inventory unless the caller asks for a fresh probe
+    const SystemSample* sample = explicit_timeout ? NULL : sampler_latest();
+    const SystemMountInfo* mounts = probed;
+    int n;
+    if (sample && sample->mount_count >= 0) {
+        mounts = sample->mounts;
+        n = sample->mount_count;
+    } else {
+        n = get_system_mounts(probed, SYSTEM_MAX_MOUNTS, (int)timeout);
+    }
+    if (n < 0) {
+        send_json(client_fd, 500, NULL, "Failed to read mount table");
+        return;
+    }
+
+    static const char* STATUS[] = { "timeout", "error", "ok" };
+    StrBuf* sb = begin_data();
+    sb_append(sb, "[");
+    for (int i = 0; i < n; i++) {
+        const SystemMountInfo* m = &mounts[i];
+        sb_append(sb, i ? ",{\"path\": " : "{\"path\": ");
+        append_json_string(sb, m->info.path);
+        sb_append(sb, ",\"device\": ");
+        append_json_string(sb, m->device);
+        sb_append(sb, ",\"fstype\": ");
+        append_json_string(sb, m->fstype);
+        sb_appendf(sb, ",\"status\": \"%s\"", STATUS[m->status + 2]);
+        if (m->status == 0) {
+            sb_appendf(sb, ",\"total\": %.2f,\"free\": %.2f,\"used\": %.2f,\"usedPercentage\": %.2f",
+                       m->info.total_gb, m->info.free_gb, m->info.used_gb, m->info.used_percentage);
+        }
+        sb_append(sb, "}");
+    }
+    sb_append(sb, "]");
+    send_data(client_fd, 200);
+}
+
+#define IO_MEASURE_WINDOW_MS 100
+
+static void handle_get_system_disk_io(int client_fd, const HttpRequest* req, const RouteParams* params) {
+    static DiskIoRates measured[DISKSTATS_MAX_DEVICES];
+    // rates between the last two samples; without a sampler, measure briefly
+    const SystemSample* sample = sampler_latest();
+    const DiskIoRates* io = measured;
+    int n;
+    double interval_ms;
+    if (sample && sample->io_count >= 0 && sample->io_interval_ms > 0) {
+        io = sample->io;
+        n = sample->io_count;
+        interval_ms = sample->io_interval_ms;
+    } else {
+        n = diskstats_measure(measured, DISKSTATS_MAX_DEVICES, IO_MEASURE_WINDOW_MS);
+        interval_ms = IO_MEASURE_WINDOW_MS;
+    }
+    if (n < 0) {
+        send_json(client_fd, 501, NULL, "Block device statistics are not available");
+        return;
+    }
+
+    StrBuf* sb = begin_data();
+    sb_appendf(sb, "{\"intervalMs\": %.0f, \"devices\": [", interval_ms);
+    for (int i = 0; i < n; i++) {
+        const DiskIoRates* d = &io[i];
+        sb_append(sb, i ? ",{\"device\": " : "{\"device\": ");
+        append_json_string(sb, d->name);
+        sb_appendf(sb, ",\"readIops\": %.2f,\"writeIops\": %.2f"
+                   ",\"readBytesPerSec\": %.0f,\"writeBytesPerSec\": %.0f"
+                   ",\"queueDepth\": %.2f,\"readAwaitMs\": %.2f,\"writeAwaitMs\": %.2f"
+                   ",\"utilPercent\": %.1f,\"inFlight\": %llu,\"wholeDisk\": %d}",
+                   d->read_iops, d->write_iops, d->read_bytes_per_sec, d->write_bytes_per_sec,
+                   d->queue_depth, d->read_await_ms, d->write_await_ms, d->util_percent, d->in_flight,
+                   d->whole_disk);
+    }
+    sb_append(sb, "]}");
+    send_data(client_fd, 200);
+}
+
+static void handle_get_metrics(int client_fd, const HttpRequest* req, const RouteParams* params) {
+    static TsPoint points[1440];
+    char name[48] = {0};
+    char res_name[8] = "1s";
+    if (parse_query_string(req->query, "metric", name, sizeof(name)) != 0) {
+        // no metric: list what can be queried
+        StrBuf* sb = begin_data();
+        sb_append(sb, "{\"metrics\": [");
+        for (int m = 0; m < TS_METRIC_COUNT; m++) sb_appendf(sb, m ? ",\"%s\"" : "\"%s\"", ts_metric_name((TsMetric)m));
+        sb_append(sb, "], \"resolutions\": [\"1s\", \"1m\", \"1h\"]}");
+        send_data(client_fd, 200);
+        return;
+    }
+    if (ts_metric_from_name(name) < 0) {
+        send_json(client_fd, 400, NULL, "Unknown metric");
+        return;
+    }
+    parse_query_string(req->query, "resolution", res_name, sizeof(res_name));
+    int res = ts_resolution_from_name(res_name);
+    if (res < 0) {
+        send_json(client_fd, 400, NULL, "resolution must be 1s, 1m or 1h");
+        return;
+    }
+    // default window: everything the ring keeps
+    long long to = utils_now_ms(), from = 0;
+    parse_query_long(req->query, "to", &to);
+    if (parse_query_long(req->query, "from", &from) != 0) {
+        from = to - ts_resolution_ms((TsResolution)res) * ts_capacity((TsResolution)res);
+    }
+    int n = ts_query((TsMetric)ts_metric_from_name(name), (TsResolution)res, from, to,
+                     points, (int)(sizeof(points) / sizeof(points[0])));
+
+    StrBuf* sb = begin_data();
+    sb_appendf(sb, "{\"metric\": \"%s\", \"resolution\": \"%s\", \"points\": [", name, res_name);
+    for (int i = 0; i < n; i++) {
+        sb_appendf(sb, "%s{\"t\": %lld,\"min\": %.15g,\"max\": %.15g,\"avg\": %.15g,\"count\": %d}",
+                   i ? "," : "", points[i].start_ms, points[i].min, points[i].max, points[i].avg, points[i].count);
+    }
+    sb_append(sb, "]}");
+    send_data(client_fd, 200);
+}
+
+static void append_forecast(StrBuf* sb, const DiskForecast* f) {
+    sb_append(sb, "{\"path\": ");
+    append_json_string(sb, f->path);
+    sb_appendf(sb, ",\"usedBytes\": %.0f,\"totalBytes\": %.0f,\"growthBytesPerHour\": %.0f",
+               f->used_bytes, f->total_bytes, f->bytes_per_sec * 3600.0);
+    if (f->eta_seconds >= 0) {
+        sb_appendf(sb, ",\"etaSeconds\": %.0f,\"fullAt\": %lld",
+                   f->eta_seconds, f->updated_ms + (long long)(f->eta_seconds * 1000.0));
+    } else {
+        sb_append(sb, ",\"etaSeconds\": null,\"fullAt\": null");
+    }
+    sb_appendf(sb, ",\"confidence\": %.3f,\"samples\": %d}", f->confidence, f->samples);
+}
+
+static void handle_get_forecast(int client_fd, const HttpRequest* req, const RouteParams* params) {
+    static DiskForecast all[FORECAST_MAX_SERIES];
+    char path[256] = {0};
+    StrBuf* sb;
+    if (parse_query_string(req->query, "path", path, sizeof(path)) == 0) {
+        DiskForecast f;
+        if (forecast_get(path, &f) != 0) {
+            send_json(client_fd, 404, NULL, "No usage history for that mount");
+            return;
+        }
+        sb = begin_data();
+        append_forecast(sb, &f);
+        send_data(client_fd, 200);
+        return;
+    }
+    int n = forecast_list(all, FORECAST_MAX_SERIES);
+    sb = begin_data();
+    sb_append(sb, "[");
+    for (int i = 0; i < n; i++) {
+        if (i) sb_append(sb, ",");
+        append_forecast(sb, &all[i]);
+    }
+    sb_append(sb, "]");
+    send_data(client_fd, 200);
+}
+
+static void handle_get_image(int client_fd, const HttpRequest* req, const RouteParams* params) {
+    static BackingInfo info;
+    backing_info(&info);
+    StrBuf* sb = begin_data();
+    if (!info.attached) {
+        sb_append(sb, "{\"attached\": 0}");
+        send_data(client_fd, 200);
+        return;
+    }
+    sb_append(sb, "{\"attached\": 1,\"path\": ");
+    append_json_string(sb, info.path);
+    sb_appendf(sb, ",\"blockSize\": %zu,\"blocks\": %d,\"sync\": %d,\"copyOffload\": %d"
+               ",\"checksum\": \"crc32c\",\"checksumImpl\": \"%s\",\"checksummedBlocks\": %d",
+               info.block_size, info.blocks, info.sync, info.copy_offload, info.checksum_impl, info.checksummed);
+    const BackingScrubStats* sc = &info.scrub;
+    sb_appendf(sb, ",\"scrub\": {\"running\": %d,\"kbps\": %.0f,\"passes\": %llu,\"blocksVerified\": %llu"
+               ",\"mismatches\": %llu,\"lastPassAt\": %lld},\"ops\": [",
+               sc->running, sc->bytes_per_sec / 1024.0, sc->passes, sc->blocks_verified, sc->mismatches,
+               sc->last_pass_ms);
+    int first = 1;
+    for (int op = 0; op < DISK_OP_COUNT; op++) {
+        const BackingOpStats* st = &info.ops[op];
+        if (st->calls == 0 && st->errors == 0) continue;
+        sb_appendf(sb, "%s{\"op\": \"%s\",\"calls\": %llu,\"ioCalls\": %llu,\"bytesRead\": %llu"
+                   ",\"bytesWritten\": %llu,\"bytesCopied\": %llu,\"errors\": %llu"
+                   ",\"seconds\": %.6f,\"avgMicros\": %.1f}",
+                   first ? "" : ",", disk_op_name(op), st->calls, st->io_calls, st->bytes_read,
+                   st->bytes_written, st->bytes_copied, st->errors, st->seconds,
+                   st->calls ? st->seconds * 1e6 / (double)st->calls : 0.0);
+        first = 0;
+    }
+    sb_append(sb, "]}");
+    send_data(client_fd, 200);
+}
+
+static void handle_attach_image(int client_fd, const HttpRequest* req, const RouteParams* params) {
+    char path[DISK_PERSIST_PATH_LEN] = {0};
+    int block_size = BACKING_DEFAULT_BLOCK_SIZE, sync = 0, scrub_kbps = BACKING_SCRUB_DEFAULT_KBPS;
+    JsonField fields[] = {
+        { "path", JSON_FIELD_STRING, path, sizeof(path), 0, 0 },
+        { "blockSize", JSON_FIELD_INT, &block_size, 0, 0, 0 },
+        { "sync", JSON_FIELD_INT, &sync, 0, 0, 0 },
+        { "scrubKBps", JSON_FIELD_INT, &scrub_kbps, 0, 0, 0 },
+    };
+    if (parse_body(client_fd, req, fields, 4) != 0) return;
+    if (strlen(path) == 0) { send_json(client_fd, 400, NULL, "path is required"); return; }
+    if (scrub_kbps < 0) { send_json(client_fd, 400, NULL, "scrubKBps must not be negative"); return; }
+    int r = block_size > 0 ? disk_attach_image(path, (size_t)block_size, sync) : -1;
+    if (r == -1) {
+        send_json(client_fd, 400, NULL, "blockSize must be a multiple of 512 up to 1 MiB");
+        return;
+    }
+    if (r == -3) {
+        send_json(client_fd, 409, NULL, "path exists and is not a backing image of this size");
+        return;
+    }
+    if (r == -4) {
+        send_json(client_fd, 409, NULL, "path belongs to the disk state files");
+        return;
+    }
+    if (r != 0) {
+        send_json(client_fd, 500, NULL, "Unable to open or size the image");
+        return;
+    }
+    if (scrub_kbps > 0) backing_scrub_start(scrub_kbps * 1024.0);
+    send_json(client_fd, 200, "{ \"attached\": 1 }", NULL);
+}
+
+static void handle_detach_image(int client_fd, const HttpRequest* req, const RouteParams* params) {
+    disk_detach_image();
+    send_json(client_fd, 200, "{ \"attached\": 0 }", NULL);
+}
+
+static void handle_reset_image_stats(int client_fd, const HttpRequest* req, const RouteParams* params) {
+    backing_reset_stats();
+    send_json(client_fd, 200, "{ \"reset\": 1 }", NULL);
+}
+
+static void handle_start_scan(int client_fd, const HttpRequest* req, const RouteParams* params) {
+    char path[256] = {0};
+    int chunk_kb = SCAN_DEFAULT_CHUNK / 1024, inflight = SCAN_DEFAULT_INFLIGHT;
+    int max_mbps = 0, timeout_ms = SCAN_DEFAULT_TIMEOUT_MS, direct = 1;
+    char backend_name[16] = "auto";
+    JsonField fields[] = {
+        { "path", JSON_FIELD_STRING, path, sizeof(path), 0, 0 },
+        { "chunkKb", JSON_FIELD_INT, &chunk_kb, 0, 0, 0 },
+        { "inflight", JSON_FIELD_INT, &inflight, 0, 0, 0 },
+        { "maxMBps", JSON_FIELD_INT, &max_mbps, 0, 0, 0 },
+        { "timeoutMs", JSON_FIELD_INT, &timeout_ms, 0, 0, 0 },
+        { "direct", JSON_FIELD_INT, &direct, 0, 0, 0 },
+        { "backend", JSON_FIELD_STRING, backend_name, sizeof(backend_name), 0, 0 },
+    };
+    if (parse_body(client_fd, req, fields, 7) != 0) return;
+    if (strlen(path) == 0) { send_json(client_fd, 400, NULL, "path is required"); return; }
+    if (chunk_kb <= 0 || chunk_kb > 64 * 1024 || inflight <= 0 || inflight > SCAN_MAX_INFLIGHT ||
+        max_mbps < 0 || timeout_ms <= 0) {
+        send_json(client_fd, 400, NULL, "chunkKb, inflight, maxMBps or timeoutMs out of range");
+        return;
+    }
+    int backend = aio_backend_from_name(backend_name);
+    if (backend < 0) {
+        send_json(client_fd, 400, NULL, "backend must be auto, io_uring or threads");
+        return;
+    }
+    ScanOptions opt;
+    scan_options_init(&opt);
+    opt.chunk_bytes = (size_t)chunk_kb * 1024;
+    opt.inflight = inflight;
+    opt.max_bytes_per_sec = (double)max_mbps * 1024 * 1024;
+    opt.timeout_ms = timeout_ms;
+    opt.direct = direct != 0;
+    opt.backend = (AioBackend)backend;
+    if (scan_start(path, &opt) != 0) {
+        send_json(client_fd, 409, NULL, "A scan is already running");
+        return;
+    }
+    send_json(client_fd, 200, "{ \"started\": 1 }", NULL);
+}
+
+static void handle_get_scan(int client_fd, const HttpRequest* req, const RouteParams* params) {
+    static ScanResult r;
+    char path[256];
+    if (scan_status(&r, path, sizeof(path)) != 0) {
+        send_json(client_fd, 404, NULL, "No scan has been started");
+        return;
+    }
+    static const char* STATUS[] = { "cancelled", "failed", "ok" };
+    StrBuf* sb = begin_data();
+    sb_append(sb, "{\"path\": ");
+    append_json_string(sb, path);
+    sb_appendf(sb, ",\"state\": \"%s\",\"bytesTotal\": %llu,\"bytesScanned\": %llu"
+               ",\"badSectors\": %llu,\"failedReads\": %llu,\"slowReads\": %llu"
+               ",\"directIo\": %d,\"sectorBytes\": %u,\"ioBackend\": \"%s\",\"elapsedSeconds\": %.2f"
+               ",\"rangesTruncated\": %d,\"badRanges\": [",
+               r.running ? "running" : STATUS[r.status + 2], r.bytes_total, r.bytes_scanned,
+               r.bad_sectors, r.failed_reads, r.slow_reads, r.direct_io, r.sector_bytes, aio_backend_name(r.io_backend),
+               r.elapsed_s, r.ranges_truncated);
+    for (int i = 0; i < r.range_count; i++) {
+        sb_appendf(sb, "%s{\"firstSector\": %llu,\"count\": %llu}", i ? "," : "",
+                   r.ranges[i].first_sector, r.ranges[i].count);
+    }
+    sb_append(sb, "]}");
+    send_data(client_fd, 200);
+}
+
+static void handle_cancel_scan(int client_fd, const HttpRequest* req, const RouteParams* params) {
+    scan_cancel();
+    send_json(client_fd, 200, "{ \"cancelled\": 1 }", NULL);
+}
+
+static void handle_create_file(int client_fd, const HttpRequest* req, const RouteParams* params) {
+    char filename[256] = {0};
+    char mode_name[16] = "allocate";
+    long long size = 0;
+    JsonField fields[] = {
+        { "filename", JSON_FIELD_STRING, filename, sizeof(filename), 0, 0 },
+        { "size", JSON_FIELD_LONG, &size, 0, 0, 0 },
+        { "mode", JSON_FIELD_STRING, mode_name, sizeof(mode_name), 0, 0 },
+    };
+    if (parse_body(client_fd, req, fields, 3) != 0) return;
+
+    if (strlen(filename) == 0) {
+        send_json(client_fd, 400, NULL, "Filename is required");
+        return;
+    }
+    if (size < 0) {
+        send_json(client_fd, 400, NULL, "size must not be negative");
+        return;
+    }
+    int mode = prealloc_mode_from_name(mode_name);
+    if (fields[2].found == -1 || mode < 0) {
+        send_json(client_fd, 400, NULL, "mode must be sparse, allocate, keep-size, zero-range or write-fill");
+        return;
+    }
+
+    // Create the file on the actual disk
+    int r = create_file_on_disk_ex(filename, (size_t)size, (PreallocMode)mode);
+    if (r == -2) {
+        send_json(client_fd, 507, NULL, "Not enough space to preallocate file");
+        return;
+    }
+    if (r != 0) {
+        send_json(client_fd, 500, NULL, "Failed to create file");
+        return;
+    }
+
+    char msg[320];
+    snprintf(msg, sizeof(msg), "File %s created successfully", filename);
+    StrBuf* sb = begin_data();
+    sb_append(sb, "{ \"message\": ");
+    append_json_string(sb, msg);
+    sb_appendf(sb, ", \"mode\": \"%s\" }", prealloc_mode_name((PreallocMode)mode));
+    send_data(client_fd, 200);
+}
+
+static void handle_delete_file(int client_fd, const HttpRequest* req, const RouteParams* params) {
+    char filename[256] = {0};
+    JsonField fields[] = { { "filename", JSON_FIELD_STRING, filename, sizeof(filename), 0, 0 } };
+    if (parse_body(client_fd, req, fields, 1) != 0) return;
+
+    if (strlen(filename) == 0) {
+        send_json(client_fd, 400, NULL, "Filename is required");
+        return;
+    }
+
+    // Delete the file from the actual disk
+    if (delete_file_from_disk(filename) != 0) {
+        send_json(client_fd, 500, NULL, "Failed to delete file");
+        return;
+    }
+
+    char msg[320];
+    snprintf(msg, sizeof(msg), "File %s deleted successfully", filename);
+    StrBuf* sb = begin_data();
+    sb_append(sb, "{ \"message\": ");
+    append_json_string(sb, msg);
+    sb_append(sb, " }");
+    send_data(client_fd, 200);
+}
+
+static void handle_get_state(int client_fd, const HttpRequest* req, const RouteParams* params) {
+    send_cached(client_fd, CACHE_STATE, disk_write_state, "Unable to build state");
+}
+
+static void handle_get_files(int client_fd, const HttpRequest* req, const RouteParams* params) {
+    send_cached(client_fd, CACHE_FILES, disk_write_files, "Unable to build files");
+}
+
+static void handle_get_stats(int client_fd, const HttpRequest* req, const RouteParams* params) {
+    send_cached(client_fd, CACHE_STATS, disk_write_stats, "Unable to build stats");
+}
+
+static void handle_get_logs(int client_fd, const HttpRequest* req, const RouteParams* params) {
+    const char* query = req->query;
+    if (!query[0]) {
+        if (disk_write_logs(begin_data()) == 0) send_data(client_fd, 200);
+        else send_json(client_fd, 500, NULL, "Unable to build logs");
+        return;
+    }
+
+    DiskLogQuery q;
+    disk_log_query_init(&q);
+    long long v = 0;
+    if (parse_query_long(query, "cursor", &v) == 0) q.cursor = v > 0 ? (int)v : 0;
+    if (parse_query_long(query, "limit", &v) == 0) q.limit = v > 0 ? (int)v : 0;
+    if (parse_query_long(query, "since", &v) == 0) q.since_ms = v;
+    if (parse_query_long(query, "until", &v) == 0) q.until_ms = v;
+    if (parse_query_long(query, "fileId", &v) == 0) q.file_id = v > 0 ? (int)v : -1;
+
+    // op=delete,allocate_custom
+    char ops[256];
+    if (parse_query_string(query, "op", ops, sizeof(ops)) == 0) {
+        char* save = NULL;
+        for (char* tok = strtok_r(ops, ",", &save); tok; tok = strtok_r(NULL, ",", &save)) {
+            int op = disk_op_from_name(tok);
+            if (op < 0) { send_json(client_fd, 400, NULL, "Unknown op filter"); return; }
+            q.op_mask |= 1u << op;
+        }
+    }
+
+    if (disk_write_log_query(begin_data(), &q) == 0) send_data(client_fd, 200);
+    else send_json(client_fd, 500, NULL, "Unable to build logs");
+}
+
+static void handle_reset(int client_fd, const HttpRequest* req, const RouteParams* params) {
+    int r = disk_reset();
+    if (r == 0) send_json(client_fd, 200, "{ \"reset\": 1 }", NULL);
+    else send_json(client_fd, 500, NULL, "Reset failed");
+}
+
+static void handle_repair(int client_fd, const HttpRequest* req, const RouteParams* params) {
+    int r = disk_repair();
+    if (r == 0) send_json(client_fd, 200, "{ \"repaired\": 1 }", NULL);
+    else send_json(client_fd, 500, NULL, "Repair failed");
+}
+
+// Every endpoint the server exposes; compiled into g_router at startup
+static const Route ROUTES[] = {
+    { HTTP_POST,   "/allocate/contiguous", handle_allocate_contiguous },
+    { HTTP_POST,   "/allocate/fragmented", handle_allocate_fragmented },
+    { HTTP_POST,   "/allocate/custom",     handle_allocate_custom },
+    { HTTP_DELETE, "/file/{id}",           handle_delete_block_file },
+    { HTTP_POST,   "/undelete/last",       handle_undelete_last },
+    { HTTP_POST,   "/defragment",          handle_defragment },
+    { HTTP_POST,   "/mark-bad",            handle_mark_bad },
+    { HTTP_GET,    "/fragmentation",       handle_get_fragmentation },
+    { HTTP_GET,    "/api/system-disk",     handle_get_system_disk_info },
+    { HTTP_GET,    "/api/system-disks",    handle_get_system_mounts },
+    { HTTP_GET,    "/api/system-disk/io",  handle_get_system_disk_io },
+    { HTTP_GET,    "/api/metrics",         handle_get_metrics },
+    { HTTP_GET,    "/api/forecast",        handle_get_forecast },
+    { HTTP_POST,   "/api/scan",            handle_start_scan },
+    { HTTP_GET,    "/api/scan",            handle_get_scan },
+    { HTTP_DELETE, "/api/scan",            handle_cancel_scan },
+    { HTTP_POST,   "/api/create-file",     handle_create_file },
+    { HTTP_POST,   "/api/delete-file",     handle_delete_file },
+    { HTTP_GET,    "/api/disk/state",      handle_get_state },
+    { HTTP_GET,    "/api/disk/files",      handle_get_files },
+    { HTTP_GET,    "/api/disk/stats",      handle_get_stats },
+    { HTTP_GET,    "/api/disk/logs",       handle_get_logs },
+    { HTTP_POST,   "/api/disk/reset",      handle_reset },
+    { HTTP_GET,    "/api/disk/image",      handle_get_image },
+    { HTTP_POST,   "/api/disk/image",      handle_attach_image },
+    { HTTP_DELETE, "/api/disk/image",      handle_detach_image },
+    { HTTP_DELETE, "/api/disk/image/stats", handle_reset_image_stats },
+    { HTTP_POST,   "/api/repair",          handle_repair },
+};
+
+static Router g_router;
+
+static void handle_client(int client_fd) {
+    HttpRequest req;
+    g_conn.accept_enc = 0;
+    if (read_request(client_fd, &req) != 0) return;
+    g_conn.accept_enc = parse_accept_encoding(req.accept_encoding);
+
+    RouteHandler handler = NULL;
+    RouteParams params;
+    switch (router_match(&g_router, req.method, req.path, &handler, &params)) {
+        case ROUTE_FOUND:
+            // blocks the scrubber found damaged turn bad before anyone looks
+            disk_apply_scrub();
+            handler(client_fd, &req, &params);
+            break;
+        case ROUTE_METHOD_NOT_ALLOWED:
+            send_json(client_fd, 405, NULL, "Method not allowed");
+            break;
+        default:
+            send_json(client_fd, 404, NULL, "Endpoint not found");
+            break;
+    }
+}
+
+int run_server(int port) {
+#ifdef _WIN32
+    WSADATA wsa;
+    if (WSAStartup(MAKEWORD(2,2), &wsa) != 0) {
+        fprintf(stderr, "WSAStartup failed.\n");
+        return 1;
+    }
+#endif
+
+    const char* level_env = getenv("COMPRESS_LEVEL");
+    if (level_env && level_env[0]) {
+        g_compress_level = atoi(level_env);
+        if (g_compress_level > COMPRESS_LEVEL_MAX) g_compress_level = COMPRESS_LEVEL_MAX;
+    }
+    const char* min_env = getenv("COMPRESS_MIN_BYTES");
+    if (min_env && min_env[0] && atol(min_env) >= 0) g_compress_min = (size_t)atol(min_env);
+
+    if (arena_init(&g_conn.arena, ARENA_SIZE) != 0 || sb_init(&g_conn.out, RESP_INITIAL_CAP) != 0 ||
+        sb_init(&g_conn.zout, RESP_INITIAL_CAP / 4) != 0 ||
+        deflater_init(&g_conn.deflater, g_compress_level > 0 ? g_compress_level : COMPRESS_LEVEL_DEFAULT) != 0 ||
+        cache_init() != 0) {
+        fprintf(stderr, "Out of memory\n");
+        return 1;
+    }
+    if (router_build(&g_router, ROUTES, sizeof(ROUTES) / sizeof(ROUTES[0])) != 0) {
+        fprintf(stderr, "Invalid route table\n");
+        return 1;
+    }
+
+    int server_fd = socket(AF_INET, SOCK_STREAM, 0);
+    if (server_fd < 0) { 
+        perror("socket");
+#ifdef _WIN32
+        WSACleanup();
+#endif
+        return 1;
+    }
+
+    int opt = 1;
+    setsockopt(server_fd, SOL_SOCKET, SO_REUSEADDR, &opt, sizeof(opt));
+
+    struct sockaddr_in addr;
+    memset(&addr, 0, sizeof(addr));
+    addr.sin_family = AF_INET;
+    addr.sin_addr.s_addr = htonl(INADDR_ANY);
+    addr.sin_port = htons((uint16_t)port);
+
+    if (bind(server_fd, (struct sockaddr*)&addr, sizeof(addr)) < 0) {
+        perror("bind");
+        close(server_fd);
+#ifdef _WIN32
+        WSACleanup();
+#endif
+        return 1;
+    }
+
+    if (listen(server_fd, 16) < 0) {
+        perror("listen");
+        close(server_fd);
+#ifdef _WIN32
+        WSACleanup();
+#endif
+        return 1;
+    }
+
+    printf("Disk Management Simulator server listening on port %d\n", port);
+
+    while (1) {
+        struct sockaddr_in cli;
+        socklen_t clilen = sizeof(cli);
+        int client_fd = accept(server_fd, (struct sockaddr*)&cli, &clilen);
+        if (client_fd < 0) {
+            perror("accept");
+            continue;
+        }
+        // bound how long a slow or idle client can hold the server
+#ifdef _WIN32
+        DWORD rcv_timeout = RECV_TIMEOUT_SEC * 1000;
+        setsockopt(client_fd, SOL_SOCKET, SO_RCVTIMEO, (const char*)&rcv_timeout, sizeof(rcv_timeout));
+#else
+        struct timeval rcv_timeout = { RECV_TIMEOUT_SEC, 0 };
+        setsockopt(client_fd, SOL_SOCKET, SO_RCVTIMEO, &rcv_timeout, sizeof(rcv_timeout));
+#endif
+#ifdef TCP_NODELAY
+        // responses are written in one call; don't let Nagle hold the tail
+        int nodelay = 1;
+        setsockopt(client_fd, IPPROTO_TCP, TCP_NODELAY, (const char*)&nodelay, sizeof(nodelay));
+#endif
+        handle_client(client_fd);
+        close(client_fd);
+        arena_reset(&g_conn.arena);
+    }
+
+    close(server_fd);
+    arena_free(&g_conn.arena);
+    sb_free(&g_conn.out);
+    sb_free(&g_conn.zout);
+    deflater_free(&g_conn.deflater);
+    cache_free();
+    disk_shutdown();
+#ifdef _WIN32
+    WSACleanup();
+#endif
+    return 0;
+}
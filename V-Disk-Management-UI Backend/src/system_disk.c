@@ -1,13 +1,42 @@
+#ifdef __linux__
+#define _GNU_SOURCE // fallocate() and its FALLOC_FL_* flags
+#endif
 #define _POSIX_C_SOURCE 200809L
 #include "system_disk.h"
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
+#include <errno.h>
 
 #ifdef _WIN32
 #include <windows.h>
 #else
 #include <sys/statvfs.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <pthread.h>
+#include <time.h>
+#endif
+
+#ifndef _WIN32
+static void fill_disk_info(SystemDiskInfo* info, const struct statvfs* buf, const char* path) {
+    info->total_space = (unsigned long long)buf->f_blocks * (unsigned long long)buf->f_frsize;
+    info->free_space = (unsigned long long)buf->f_bavail * (unsigned long long)buf->f_frsize;
+    info->used_space = info->total_space - info->free_space;
+    
+    // Convert to GB for display
+    info->total_gb = (double)info->total_space / (1024 * 1024 * 1024);
+    info->free_gb = (double)info->free_space / (1024 * 1024 * 1024);
+    info->used_gb = (double)info->used_space / (1024 * 1024 * 1024);
+    info->used_percentage = (info->total_space > 0) ? 
+                           ((double)info->used_space / (double)info->total_space) * 100.0 : 0.0;
+    
+    if (path != info->path) {
+        strncpy(info->path, path, sizeof(info->path) - 1);
+        info->path[sizeof(info->path) - 1] = '\0';
+    }
+    info->bad_sectors = 0; // Not easily accessible
+}
 #endif
 
 int get_system_disk_info(SystemDiskInfo* info) {
@@ -47,21 +76,7 @@ int get_system_disk_info(SystemDiskInfo* info) {
     // On Unix-like systems
     struct statvfs buf;
     if (statvfs("/", &buf) == 0) {
-        info->total_space = (unsigned long long)buf.f_blocks * (unsigned long long)buf.f_frsize;
-        info->free_space = (unsigned long long)buf.f_bavail * (unsigned long long)buf.f_frsize;
-        info->used_space = info->total_space - info->free_space;
-        
-        // Convert to GB for display
-        info->total_gb = (double)info->total_space / (1024 * 1024 * 1024);
-        info->free_gb = (double)info->free_space / (1024 * 1024 * 1024);
-        info->used_gb = (double)info->used_space / (1024 * 1024 * 1024);
-        info->used_percentage = (info->total_space > 0) ? 
-                               ((double)info->used_space / (double)info->total_space) * 100.0 : 0.0;
-        
-        strncpy(info->path, "/", sizeof(info->path) - 1);
-        info->path[sizeof(info->path) - 1] = '\0';
-        info->bad_sectors = 0; // Not easily accessible
-        
+        fill_disk_info(info, &buf, "/");
         return 0;
     }
 #endif
@@ -69,24 +84,375 @@ int get_system_disk_info(SystemDiskInfo* info) {
     return -1;
 }
 
+#ifdef _WIN32
+int get_system_mounts(SystemMountInfo* out, int cap, int timeout_ms) {
+    if (!out || cap <= 0) return -1;
+    memset(&out[0], 0, sizeof(out[0]));
+    out[0].status = get_system_disk_info(&out[0].info);
+    return 1;
+}
+#else
+// Undo the octal escapes (\040 etc.) mountinfo uses for blanks in paths
+static void unescape_mount_field(const char* in, char* out, size_t cap) {
+    size_t n = 0;
+    while (*in && n + 1 < cap) {
+        if (in[0] == '\\' && in[1] >= '0' && in[1] <= '3' && in[2] >= '0' && in[2] <= '7' && in[3] >= '0' && in[3] <= '7') {
+            out[n++] = (char)((in[1] - '0') * 64 + (in[2] - '0') * 8 + (in[3] - '0'));
+            in += 4;
+        } else {
+            out[n++] = *in++;
+        }
+    }
+    out[n] = '\0';
+}
+
+// State shared between get_system_mounts() and its statvfs threads. It is
+// reference counted because a thread stuck in statvfs may outlive the call.
+typedef struct {
+    pthread_mutex_t lock;
+    pthread_cond_t done_cv;
+    int refs;
+    int pending;
+    int count;
+    struct { char path[256]; struct statvfs st; int status; int done; } slot[SYSTEM_MAX_MOUNTS];
+} MountProbe;
+
+typedef struct { MountProbe* probe; int index; int busy; } MountJob;
+
+// Mount points whose statvfs thread has not returned yet, kept across calls.
+// A path stays here until its probe comes back, so a hung filesystem costs
+// one stuck thread rather than one per call. Each entry remembers the probe
+// that owns it and that caller's deadline: later calls wait on the result
+// while the deadline has not passed, and report the mount timed out after.
+static pthread_mutex_t busy_lock = PTHREAD_MUTEX_INITIALIZER;
+static struct {
+    char path[256];
+    int inflight;
+    struct timespec deadline;      // when the owning call gave up on it
+    MountProbe* probe;             // kept alive by its worker while inflight
+    int index;
+} busy_probes[SYSTEM_MAX_MOUNTS];
+
+static int past(const struct timespec* t) {
+    struct timespec now;
+    clock_gettime(CLOCK_REALTIME, &now);
+    return now.tv_sec > t->tv_sec || (now.tv_sec == t->tv_sec && now.tv_nsec >= t->tv_nsec);
+}
+
+// Claims a busy_probes entry for slot index of p; returns it, or -2 with a
+// reference to the in-flight probe of the same path in *share / *share_index,
+// or -1 if that probe has outlived its caller's deadline (or every entry is
+// held by a probe that never came back)
+static int busy_claim(MountProbe* p, int index, const struct timespec* deadline,
+                      MountProbe** share, int* share_index) {
+    const char* path = p->slot[index].path;
+    int slot = -1;
+    pthread_mutex_lock(&busy_lock);
+    for (int i = 0; i < SYSTEM_MAX_MOUNTS; i++) {
+        if (!busy_probes[i].inflight) {
+            if (slot < 0) slot = i;
+        } else if (strcmp(busy_probes[i].path, path) == 0) {
+            int r = -1;
+            if (!past(&busy_probes[i].deadline)) {
+                *share = busy_probes[i].probe;
+                *share_index = busy_probes[i].index;
+                pthread_mutex_lock(&(*share)->lock);
+                (*share)->refs++;
+                pthread_mutex_unlock(&(*share)->lock);
+                r = -2;
+            }
+            pthread_mutex_unlock(&busy_lock);
+            return r;
+        }
+    }
+    if (slot >= 0) {
+        snprintf(busy_probes[slot].path, sizeof(busy_probes[slot].path), "%s", path);
+        busy_probes[slot].inflight = 1;
+        busy_probes[slot].deadline = *deadline;
+        busy_probes[slot].probe = p;
+        busy_probes[slot].index = index;
+    }
+    pthread_mutex_unlock(&busy_lock);
+    return slot;
+}
+
+static void busy_release(int index) {
+    pthread_mutex_lock(&busy_lock);
+    busy_probes[index].inflight = 0;
+    busy_probes[index].probe = NULL;
+    pthread_mutex_unlock(&busy_lock);
+}
+
+static void probe_release(MountProbe* p) {
+    pthread_mutex_lock(&p->lock);
+    int last = --p->refs == 0;
+    pthread_mutex_unlock(&p->lock);
+    if (last) {
+        pthread_cond_destroy(&p->done_cv);
+        pthread_mutex_destroy(&p->lock);
+        free(p);
+    }
+}
+
+static void* probe_worker(void* arg) {
+    MountJob job = *(MountJob*)arg;
+    free(arg);
+    MountProbe* p = job.probe;
+    struct statvfs st;
+    int r = statvfs(p->slot[job.index].path, &st);
+    pthread_mutex_lock(&p->lock);
+    if (r == 0) p->slot[job.index].st = st;
+    p->slot[job.index].status = r == 0 ? 0 : -1;
+    p->slot[job.index].done = 1;
+    p->pending--;
+    pthread_cond_broadcast(&p->done_cv); // callers sharing this slot wait too
+    pthread_mutex_unlock(&p->lock);
+    busy_release(job.busy);
+    probe_release(p);
+    return NULL;
+}
+
+// Reads the mount table into out[] and the probe's paths; returns the count
+static int read_mountinfo(SystemMountInfo* out, int cap, MountProbe* p) {
+    FILE* f = fopen("/proc/self/mountinfo", "r");
+    if (!f) return -1;
+    char line[1024];
+    int n = 0;
+    while (n < cap && n < SYSTEM_MAX_MOUNTS && fgets(line, sizeof(line), f)) {
+        // id parent major:minor root mount-point options [optional...] - fstype source super-options
+        char mnt[256], fstype[32], source[128];
+        char* sep = strstr(line, " - ");
+        if (!sep || sscanf(line, "%*s %*s %*s %*s %255s", mnt) != 1) continue;
+        if (sscanf(sep + 3, "%31s %127s", fstype, source) != 2) continue;
+        SystemMountInfo* m = &out[n];
+        memset(m, 0, sizeof(*m));
+        unescape_mount_field(mnt, m->info.path, sizeof(m->info.path));
+        unescape_mount_field(source, m->device, sizeof(m->device));
+        snprintf(m->fstype, sizeof(m->fstype), "%s", fstype);
+        memcpy(p->slot[n].path, m->info.path, sizeof(p->slot[n].path));
+        n++;
+    }
+    fclose(f);
+    return n;
+}
+
+int get_system_mounts(SystemMountInfo* out, int cap, int timeout_ms) {
+    if (!out || cap <= 0) return -1;
+    MountProbe* p = (MountProbe*)calloc(1, sizeof(MountProbe));
+    if (!p) return -1;
+    int n = read_mountinfo(out, cap, p);
+    if (n < 0) {
+        // no /proc: report the root filesystem alone
+        free(p);
+        memset(&out[0], 0, sizeof(out[0]));
+        out[0].status = get_system_disk_info(&out[0].info);
+        return 1;
+    }
+    pthread_mutex_init(&p->lock, NULL);
+    pthread_cond_init(&p->done_cv, NULL);
+    p->count = n;
+    p->refs = 1;
+
+    struct timespec deadline;
+    clock_gettime(CLOCK_REALTIME, &deadline);
+    deadline.tv_sec += timeout_ms / 1000;
+    deadline.tv_nsec += (long)(timeout_ms % 1000) * 1000000L;
+    if (deadline.tv_nsec >= 1000000000L) { deadline.tv_sec++; deadline.tv_nsec -= 1000000000L; }
+
+    // probes of the same mount started by another call that is still waiting
+    MountProbe* shared[SYSTEM_MAX_MOUNTS] = {0};
+    int shared_index[SYSTEM_MAX_MOUNTS];
+    pthread_attr_t attr;
+    pthread_attr_init(&attr);
+    pthread_attr_setdetachstate(&attr, PTHREAD_CREATE_DETACHED);
+    for (int i = 0; i < n; i++) {
+        // -1: the previous probe of this mount is stuck, leave it timed out
+        int busy = busy_claim(p, i, &deadline, &shared[i], &shared_index[i]);
+        if (busy < 0) continue;
+        MountJob* job = (MountJob*)malloc(sizeof(MountJob));
+        pthread_t t;
+        pthread_mutex_lock(&p->lock);
+        p->refs++;
+        p->pending++;
+        pthread_mutex_unlock(&p->lock);
+        if (job) {
+            job->probe = p;
+            job->index = i;
+            job->busy = busy;
+        }
+        if (!job || pthread_create(&t, &attr, probe_worker, job) != 0) {
+            // no thread to spare: probe inline
+            free(job);
+            busy_release(busy);
+            p->slot[i].status = statvfs(p->slot[i].path, &p->slot[i].st) == 0 ? 0 : -1;
+            p->slot[i].done = 1;
+            pthread_mutex_lock(&p->lock);
+            p->refs--;
+            p->pending--;
+            pthread_mutex_unlock(&p->lock);
+        }
+    }
+    pthread_attr_destroy(&attr);
+
+    for (int i = 0; i < n; i++) {
+        MountProbe* o = shared[i];
+        if (!o) continue;
+        int k = shared_index[i];
+        pthread_mutex_lock(&o->lock);
+        while (!o->slot[k].done) {
+            if (pthread_cond_timedwait(&o->done_cv, &o->lock, &deadline) == ETIMEDOUT) break;
+        }
+        if (o->slot[k].done) {
+            p->slot[i].st = o->slot[k].st;
+            p->slot[i].status = o->slot[k].status;
+            p->slot[i].done = 1;
+        }
+        pthread_mutex_unlock(&o->lock);
+        probe_release(o);
+    }
+
+    pthread_mutex_lock(&p->lock);
+    while (p->pending > 0) {
+        if (pthread_cond_timedwait(&p->done_cv, &p->lock, &deadline) == ETIMEDOUT) break;
+    }
+    // keep mounts that answered with real blocks, plus the ones that hung
+    int kept = 0;
+    for (int i = 0; i < n; i++) {
+        // a mount point listed twice (overmounts) was probed once, by its first entry
+        for (int j = 0; j < i && !p->slot[i].done; j++) {
+            if (p->slot[j].done && strcmp(p->slot[j].path, p->slot[i].path) == 0) {
+                p->slot[i].st = p->slot[j].st;
+                p->slot[i].status = p->slot[j].status;
+                p->slot[i].done = 1;
+            }
+        }
+        if (p->slot[i].done && p->slot[i].status == 0 && p->slot[i].st.f_blocks == 0) continue;
+        if (kept != i) out[kept] = out[i];
+        if (!p->slot[i].done) out[kept].status = -2;
+        else if (p->slot[i].status != 0) out[kept].status = -1;
+        else fill_disk_info(&out[kept].info, &p->slot[i].st, out[kept].info.path);
+        kept++;
+    }
+    pthread_mutex_unlock(&p->lock);
+    probe_release(p);
+    return kept;
+}
+#endif
+
+static const char* PREALLOC_NAMES[] = { "sparse", "allocate", "keep-size", "zero-range", "write-fill" };
+
+const char* prealloc_mode_name(PreallocMode mode) {
+    if (mode < PREALLOC_SPARSE || mode > PREALLOC_WRITE_FILL) return "unknown";
+    return PREALLOC_NAMES[mode];
+}
+
+int prealloc_mode_from_name(const char* name) {
+    if (!name) return -1;
+    for (int i = PREALLOC_SPARSE; i <= PREALLOC_WRITE_FILL; i++) {
+        if (strcmp(name, PREALLOC_NAMES[i]) == 0) return i;
+    }
+    return -1;
+}
+
 int create_file_on_disk(const char* filename, size_t size) {
+    return create_file_on_disk_ex(filename, size, PREALLOC_ALLOCATE);
+}
+
+#ifdef _WIN32
+int create_file_on_disk_ex(const char* filename, size_t size, PreallocMode mode) {
     if (!filename) return -1;
     
     FILE* file = fopen(filename, "wb");
     if (!file) return -1;
     
-    // Create a file of the specified size
-    if (size > 0) {
-        // Seek to size-1 and write a byte to allocate the space
-        if (fseek(file, size - 1, SEEK_SET) == 0) {
-            fputc(0, file);
+    int r = 0;
+    if (mode == PREALLOC_WRITE_FILL) {
+        char* buf = (char*)calloc(1, PREALLOC_FILL_CHUNK);
+        if (!buf) r = -1;
+        for (size_t done = 0; r == 0 && done < size; ) {
+            size_t n = size - done < PREALLOC_FILL_CHUNK ? size - done : PREALLOC_FILL_CHUNK;
+            if (fwrite(buf, 1, n, file) != n) r = -1;
+            done += n;
         }
+        free(buf);
+    } else if (size > 0 && mode != PREALLOC_KEEP_SIZE) {
+        // Seek to size-1 and write a byte to allocate the space
+        if (fseek(file, size - 1, SEEK_SET) != 0 || fputc(0, file) == EOF) r = -1;
     }
     
-    fclose(file);
-    return 0;
+    if (fclose(file) != 0) r = -1;
+    if (r != 0) remove(filename);
+    return r;
+}
+#else
+// Writes size zero bytes from a page-aligned buffer, retrying short writes
+static int write_fill(int fd, size_t size) {
+    void* buf = NULL;
+    if (posix_memalign(&buf, 4096, PREALLOC_FILL_CHUNK) != 0) return ENOMEM;
+    memset(buf, 0, PREALLOC_FILL_CHUNK);
+    int err = 0;
+    size_t done = 0;
+    while (done < size) {
+        size_t n = size - done < PREALLOC_FILL_CHUNK ? size - done : PREALLOC_FILL_CHUNK;
+        ssize_t w = write(fd, buf, n);
+        if (w < 0) {
+            if (errno == EINTR) continue;
+            err = errno;
+            break;
+        }
+        done += (size_t)w;
+    }
+    free(buf);
+    return err;
 }
 
+int create_file_on_disk_ex(const char* filename, size_t size, PreallocMode mode) {
+    if (!filename) return -1;
+    if ((off_t)size < 0) return -1;
+
+    int fd = open(filename, O_WRONLY | O_CREAT | O_TRUNC, 0644);
+    if (fd < 0) return -1;
+
+    // every branch leaves an errno value in err (0 = success)
+    int err = 0;
+    switch (mode) {
+        case PREALLOC_SPARSE:
+            if (ftruncate(fd, (off_t)size) != 0) err = errno;
+            break;
+        case PREALLOC_KEEP_SIZE:
+#ifdef __linux__
+            if (size > 0 && fallocate(fd, FALLOC_FL_KEEP_SIZE, 0, (off_t)size) != 0) err = errno;
+#else
+            err = EOPNOTSUPP;
+#endif
+            break;
+        case PREALLOC_ZERO_RANGE:
+#ifdef __linux__
+            if (size == 0 || fallocate(fd, FALLOC_FL_ZERO_RANGE, 0, (off_t)size) == 0) break;
+            if (errno != EOPNOTSUPP && errno != ENOSYS) { err = errno; break; }
+#endif
+            // filesystem cannot zero a range: a plain reservation reads the same
+            if (size > 0) err = posix_fallocate(fd, 0, (off_t)size);
+            break;
+        case PREALLOC_ALLOCATE:
+            if (size > 0) err = posix_fallocate(fd, 0, (off_t)size);
+            break;
+        case PREALLOC_WRITE_FILL:
+            err = write_fill(fd, size);
+            break;
+        default:
+            err = EINVAL;
+            break;
+    }
+
+    if (close(fd) != 0 && err == 0) err = errno;
+    if (err == 0) return 0;
+    // never leave a half-reserved file behind
+    remove(filename);
+    return err == ENOSPC || err == EDQUOT ? -2 : -1;
+}
+#endif
+
 int delete_file_from_disk(const char* filename) {
     if (!filename) return -1;
     
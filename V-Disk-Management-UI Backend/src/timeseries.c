@@ -0,0 +1,149 @@
+#define _POSIX_C_SOURCE 200809L
+#include "timeseries.h"
+#include <string.h>
+#ifndef _WIN32
+#include <pthread.h>
+#endif
+
+// One fixed ring per metric and resolution. A slot remembers which bucket
+// number (time / resolution) it holds, so slots left over from an earlier
+// lap of the ring are recognised as empty without ever being cleared.
+typedef struct {
+    long long bucket;
+    int count;
+    double min;
+    double max;
+    double sum;
+} TsSlot;
+
+#define CAP_1S 600
+#define CAP_1M 1440
+#define CAP_1H 744
+
+static const int CAPACITY[TS_RES_COUNT] = { CAP_1S, CAP_1M, CAP_1H };
+static const long long RES_MS[TS_RES_COUNT] = { 1000LL, 60000LL, 3600000LL };
+static const char* RES_NAMES[TS_RES_COUNT] = { "1s", "1m", "1h" };
+static const char* METRIC_NAMES[TS_METRIC_COUNT] = {
+    "sys_used_percent", "sys_free_bytes",
+    "io_read_bytes_per_sec", "io_write_bytes_per_sec", "io_iops",
+    "sim_used_blocks", "sim_free_blocks", "sim_bad_blocks", "sim_fragmentation_percent"
+};
+
+static TsSlot ring_1s[TS_METRIC_COUNT][CAP_1S];
+static TsSlot ring_1m[TS_METRIC_COUNT][CAP_1M];
+static TsSlot ring_1h[TS_METRIC_COUNT][CAP_1H];
+static long long newest[TS_METRIC_COUNT][TS_RES_COUNT];
+static int initialized = 0;
+
+#ifndef _WIN32
+static pthread_mutex_t lock = PTHREAD_MUTEX_INITIALIZER;
+#define LOCK() pthread_mutex_lock(&lock)
+#define UNLOCK() pthread_mutex_unlock(&lock)
+#else
+#define LOCK() do {} while (0)
+#define UNLOCK() do {} while (0)
+#endif
+
+static TsSlot* ring(TsMetric m, TsResolution r) {
+    switch (r) {
+        case TS_RES_1S: return ring_1s[m];
+        case TS_RES_1M: return ring_1m[m];
+        default: return ring_1h[m];
+    }
+}
+
+static void reset_locked() {
+    // bucket -1 never matches a real bucket number
+    for (int m = 0; m < TS_METRIC_COUNT; m++) {
+        for (int r = 0; r < TS_RES_COUNT; r++) {
+            TsSlot* slots = ring((TsMetric)m, (TsResolution)r);
+            for (int i = 0; i < CAPACITY[r]; i++) slots[i].bucket = -1;
+            newest[m][r] = -1;
+        }
+    }
+    initialized = 1;
+}
+
+void ts_reset() {
+    LOCK();
+    reset_locked();
+    UNLOCK();
+}
+
+void ts_record(TsMetric metric, long long now_ms, double value) {
+    if (metric < 0 || metric >= TS_METRIC_COUNT || now_ms < 0) return;
+    LOCK();
+    if (!initialized) reset_locked();
+    for (int r = 0; r < TS_RES_COUNT; r++) {
+        long long b = now_ms / RES_MS[r];
+        // too old for this ring: its slot already belongs to a newer bucket
+        if (b <= newest[metric][r] - CAPACITY[r]) continue;
+        TsSlot* s = &ring(metric, (TsResolution)r)[b % CAPACITY[r]];
+        if (s->bucket != b) {
+            s->bucket = b;
+            s->count = 0;
+            s->sum = 0;
+        }
+        if (s->count == 0 || value < s->min) s->min = value;
+        if (s->count == 0 || value > s->max) s->max = value;
+        s->sum += value;
+        s->count++;
+        if (b > newest[metric][r]) newest[metric][r] = b;
+    }
+    UNLOCK();
+}
+
+int ts_query(TsMetric metric, TsResolution res, long long from_ms, long long to_ms, TsPoint* out, int cap) {
+    if (metric < 0 || metric >= TS_METRIC_COUNT || res < 0 || res >= TS_RES_COUNT || !out) return 0;
+    LOCK();
+    if (!initialized) reset_locked();
+    long long step = RES_MS[res];
+    long long last = newest[metric][res];
+    long long first = last - CAPACITY[res] + 1;
+    long long lo = from_ms <= 0 ? 0 : (from_ms + step - 1) / step;
+    long long hi = to_ms / step;
+    if (lo < first) lo = first;
+    if (hi > last) hi = last;
+    const TsSlot* slots = ring(metric, res);
+    int n = 0;
+    for (long long b = lo; b <= hi && n < cap; b++) {
+        const TsSlot* s = &slots[b % CAPACITY[res]];
+        if (s->bucket != b || s->count == 0) continue;
+        out[n].start_ms = b * step;
+        out[n].count = s->count;
+        out[n].min = s->min;
+        out[n].max = s->max;
+        out[n].avg = s->sum / s->count;
+        n++;
+    }
+    UNLOCK();
+    return n;
+}
+
+int ts_capacity(TsResolution res) {
+    return res >= 0 && res < TS_RES_COUNT ? CAPACITY[res] : 0;
+}
+
+long long ts_resolution_ms(TsResolution res) {
+    return res >= 0 && res < TS_RES_COUNT ? RES_MS[res] : 0;
+}
+
+const char* ts_metric_name(TsMetric metric) {
+    return metric >= 0 && metric < TS_METRIC_COUNT ? METRIC_NAMES[metric] : "unknown";
+}
+
+int ts_metric_from_name(const char* name) {
+    if (!name) return -1;
+    for (int i = 0; i < TS_METRIC_COUNT; i++) if (strcmp(name, METRIC_NAMES[i]) == 0) return i;
+    return -1;
+}
+
+const char* ts_resolution_name(TsResolution res) {
+    return res >= 0 && res < TS_RES_COUNT ? RES_NAMES[res] : "unknown";
+}
+
+int ts_resolution_from_name(const char* name) {
+    if (!name) return -1;
+    for (int i = 0; i < TS_RES_COUNT; i++) if (strcmp(name, RES_NAMES[i]) == 0) return i;
+    return -1;
+}
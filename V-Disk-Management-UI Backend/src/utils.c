@@ -6,6 +6,13 @@
 #include <stdarg.h>
 #include <time.h>
 #include <errno.h>
+#ifdef _WIN32
+#include <io.h>
+#else
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/stat.h>
+#endif
 
 int sb_init(StrBuf* sb, size_t initial_cap) {
     if (!sb) return -1;
@@ -79,6 +86,54 @@ char* sb_take(StrBuf* sb) {
     return out;
 }
 
+int sb_reserve(StrBuf* sb, size_t extra) {
+    if (!sb || !sb->buf) return -1;
+    return sb_ensure(sb, extra);
+}
+
+void sb_reset(StrBuf* sb) {
+    if (!sb || !sb->buf) return;
+    sb->len = 0;
+    sb->buf[0] = '\0';
+}
+
+void sb_free(StrBuf* sb) {
+    if (!sb) return;
+    free(sb->buf);
+    sb->buf = NULL;
+    sb->len = 0;
+    sb->cap = 0;
+}
+
+int arena_init(Arena* a, size_t cap) {
+    if (!a) return -1;
+    a->base = (char*)malloc(cap);
+    if (!a->base) return -1;
+    a->used = 0;
+    a->cap = cap;
+    return 0;
+}
+
+void* arena_alloc(Arena* a, size_t n) {
+    if (!a || !a->base) return NULL;
+    size_t off = (a->used + 15) & ~(size_t)15;
+    if (off > a->cap || n > a->cap - off) return NULL;
+    a->used = off + n;
+    return a->base + off;
+}
+
+void arena_reset(Arena* a) {
+    if (a) a->used = 0;
+}
+
+void arena_free(Arena* a) {
+    if (!a) return;
+    free(a->base);
+    a->base = NULL;
+    a->used = 0;
+    a->cap = 0;
+}
+
 int file_exists(const char* path) {
     FILE* f = fopen(path, "rb");
     if (!f) return 0;
@@ -99,25 +154,111 @@ int read_text_file(const char* path, StrBuf* out) {
     return 0;
 }
 
-int write_text_file_atomic(const char* path, const char* content) {
+static const char* const DURABILITY_NAMES[] = { "none", "rename", "fdatasync", "fsync" };
+
+const char* durability_name(Durability d) {
+    return d >= DURABILITY_NONE && d <= DURABILITY_FSYNC ? DURABILITY_NAMES[d] : "unknown";
+}
+
+int durability_from_name(const char* name) {
+    if (!name) return -1;
+    for (int i = DURABILITY_NONE; i <= DURABILITY_FSYNC; i++) {
+        if (strcmp(name, DURABILITY_NAMES[i]) == 0) return i;
+    }
+    return -1;
+}
+
+int sync_stream(FILE* f, Durability d) {
+    if (fflush(f) != 0) return -1;
+#ifdef _WIN32
+    return d >= DURABILITY_FDATASYNC ? _commit(_fileno(f)) : 0;
+#else
+    if (d == DURABILITY_FSYNC) return fsync(fileno(f));
+    if (d == DURABILITY_FDATASYNC) return fdatasync(fileno(f));
+    return 0;
+#endif
+}
+
+#ifndef _WIN32
+// Directory part of path ("." when it has none); -1 if it does not fit
+static int parent_dir(const char* path, char* dir, size_t cap) {
+    const char* slash = strrchr(path, '/');
+    if (!slash) {
+        strcpy(dir, ".");
+        return 0;
+    }
+    size_t n = slash == path ? 1 : (size_t)(slash - path);
+    if (n >= cap) return -1;
+    memcpy(dir, path, n);
+    dir[n] = '\0';
+    return 0;
+}
+#endif
+
+int sync_parent_dir(const char* path) {
+#ifdef _WIN32
+    return 0; // directory entries cannot be synced on Windows
+#else
+    char dir[512];
+    if (parent_dir(path, dir, sizeof(dir)) != 0) return -1;
+    int fd = open(dir, O_RDONLY | O_DIRECTORY);
+    if (fd < 0) return -1;
+    int r = fsync(fd);
+    close(fd);
+    return r;
+#endif
+}
+
+int same_file(const char* a, const char* b) {
+    if (strcmp(a, b) == 0) return 1;
+#ifdef _WIN32
+    return 0;
+#else
+    struct stat sa, sb;
+    int ea = stat(a, &sa) == 0, eb = stat(b, &sb) == 0;
+    if (ea && eb) return sa.st_dev == sb.st_dev && sa.st_ino == sb.st_ino;
+    if (ea || eb) return 0;
+    // neither exists yet: same name in the same directory
+    const char* na = strrchr(a, '/');
+    const char* nb = strrchr(b, '/');
+    if (strcmp(na ? na + 1 : a, nb ? nb + 1 : b) != 0) return 0;
+    char da[512], db[512];
+    if (parent_dir(a, da, sizeof(da)) != 0 || parent_dir(b, db, sizeof(db)) != 0) return 0;
+    if (stat(da, &sa) != 0 || stat(db, &sb) != 0) return 0;
+    return sa.st_dev == sb.st_dev && sa.st_ino == sb.st_ino;
+#endif
+}
+
+int write_file_durable(const char* path, const void* data, size_t len, Durability d) {
     char tmp[512];
-    snprintf(tmp, sizeof(tmp), "%s.tmp", path);
-    FILE* f = fopen(tmp, "wb");
-    if (!f) return -1;
-    size_t n = strlen(content);
-    if (fwrite(content, 1, n, f) != n) {
-        fclose(f);
-        remove(tmp);
-        return -1;
+    const char* target = path;
+    if (d != DURABILITY_NONE) {
+        snprintf(tmp, sizeof(tmp), "%s.tmp", path);
+        target = tmp;
     }
-    fclose(f);
-    if (rename(tmp, path) != 0) {
+    FILE* f = fopen(target, "wb");
+    if (!f) return -1;
+    int ok = len == 0 || fwrite(data, 1, len, f) == len;
+    if (ok && sync_stream(f, d) != 0) ok = 0;
+    if (fclose(f) != 0) ok = 0;
+    if (d == DURABILITY_NONE) return ok ? 0 : -1;
+    if (!ok || rename(tmp, path) != 0) {
         remove(tmp);
         return -1;
     }
+    // the rename itself is only durable once the directory is
+    if (d == DURABILITY_FSYNC && sync_parent_dir(path) != 0) return -1;
     return 0;
 }
 
+int write_binary_file_atomic(const char* path, const void* data, size_t len) {
+    return write_file_durable(path, data, len, DURABILITY_RENAME);
+}
+
+int write_text_file_atomic(const char* path, const char* content) {
+    return write_binary_file_atomic(path, content, strlen(content));
+}
+
 void trim_whitespace(char* s) {
     if (!s) return;
     size_t len = strlen(s);
@@ -129,56 +270,110 @@ void trim_whitespace(char* s) {
     s[end - start] = '\0';
 }
 
-// Very naive JSON parsing: looks for "key": <number>
-int parse_json_int(const char* json, const char* key, int* out_value) {
-    if (!json || !key || !out_value) return -1;
-    char pattern[128];
-    snprintf(pattern, sizeof(pattern), "\"%s\"", key);
-    const char* p = strstr(json, pattern);
-    if (!p) return -1;
-    p = strchr(p + strlen(pattern), ':');
-    if (!p) return -1;
-    p++;
-    while (*p == ' ' || *p == '\t') p++;
+// Locate the value for key in "a=1&b=two"; returns start and sets *len
+static const char* find_query_value(const char* query, const char* key, size_t* len) {
+    size_t klen = strlen(key);
+    const char* p = query;
+    while (p && *p) {
+        const char* end = strchr(p, '&');
+        size_t plen = end ? (size_t)(end - p) : strlen(p);
+        if (plen > klen && strncmp(p, key, klen) == 0 && p[klen] == '=') {
+            *len = plen - klen - 1;
+            return p + klen + 1;
+        }
+        p = end ? end + 1 : NULL;
+    }
+    return NULL;
+}
+
+int parse_query_long(const char* query, const char* key, long long* out_value) {
+    if (!query || !key || !out_value) return -1;
+    size_t len = 0;
+    const char* v = find_query_value(query, key, &len);
+    if (!v || len == 0) return -1;
     char* endptr = NULL;
-    long v = strtol(p, &endptr, 10);
-    if (p == endptr) return -1;
-    *out_value = (int)v;
+    long long n = strtoll(v, &endptr, 10);
+    if (endptr != v + len) return -1;
+    *out_value = n;
     return 0;
 }
 
-// Very naive JSON parsing: "key": "value"
-int parse_json_string(const char* json, const char* key, char* out, size_t out_len) {
-    if (!json || !key || !out || out_len == 0) return -1;
-    char pattern[128];
-    snprintf(pattern, sizeof(pattern), "\"%s\"", key);
-    const char* p = strstr(json, pattern);
-    if (!p) return -1;
-    p = strchr(p + strlen(pattern), ':');
-    if (!p) return -1;
-    p++;
-    while (*p == ' ' || *p == '\t') p++;
-    if (*p != '\"') return -1;
-    p++;
-    const char* q = strchr(p, '\"');
-    if (!q) return -1;
-    size_t n = (size_t)(q - p);
-    if (n >= out_len) n = out_len - 1;
-    memcpy(out, p, n);
-    out[n] = '\0';
+int parse_query_string(const char* query, const char* key, char* out, size_t out_len) {
+    if (!query || !key || !out || out_len == 0) return -1;
+    size_t len = 0;
+    const char* v = find_query_value(query, key, &len);
+    if (!v) return -1;
+    if (len >= out_len) len = out_len - 1;
+    memcpy(out, v, len);
+    out[len] = '\0';
     return 0;
 }
 
-void utils_srand() {
-    static int seeded = 0;
-    if (!seeded) {
-        seeded = 1;
-        srand((unsigned int)time(NULL));
+long long utils_now_ms() {
+#ifdef _WIN32
+    return (long long)time(NULL) * 1000LL;
+#else
+    struct timespec ts;
+    if (clock_gettime(CLOCK_REALTIME, &ts) != 0) return (long long)time(NULL) * 1000LL;
+    return (long long)ts.tv_sec * 1000LL + (long long)(ts.tv_nsec / 1000000L);
+#endif
+}
+
+static uint64_t splitmix64(uint64_t* x) {
+    uint64_t z = (*x += 0x9E3779B97F4A7C15ull);
+    z = (z ^ (z >> 30)) * 0xBF58476D1CE4E5B9ull;
+    z = (z ^ (z >> 27)) * 0x94D049BB133111EBull;
+    return z ^ (z >> 31);
+}
+
+static uint64_t rotl64(uint64_t x, int k) {
+    return (x << k) | (x >> (64 - k));
+}
+
+void utils_rand_seed(RandState* r, uint64_t seed) {
+    // never all zero: splitmix64 outputs are a bijection of distinct inputs
+    for (int i = 0; i < 4; i++) r->s[i] = splitmix64(&seed);
+}
+
+uint64_t utils_rand_next(RandState* r) {
+    uint64_t* s = r->s;
+    uint64_t out = rotl64(s[1] * 5, 7) * 9;
+    uint64_t t = s[1] << 17;
+    s[2] ^= s[0];
+    s[3] ^= s[1];
+    s[1] ^= s[2];
+    s[0] ^= s[3];
+    s[2] ^= t;
+    s[3] = rotl64(s[3], 45);
+    return out;
+}
+
+uint32_t utils_rand_below(RandState* r, uint32_t bound) {
+    if (bound <= 1) return 0;
+    // multiply-shift (Lemire): reject the few low products that would
+    // make some results one draw more likely than others
+    uint64_t m = (uint64_t)(uint32_t)(utils_rand_next(r) >> 32) * bound;
+    if ((uint32_t)m < bound) {
+        uint32_t threshold = (uint32_t)(-bound) % bound;
+        while ((uint32_t)m < threshold) m = (uint64_t)(uint32_t)(utils_rand_next(r) >> 32) * bound;
     }
+    return (uint32_t)(m >> 32);
 }
 
-int utils_rand_range(int min_inclusive, int max_inclusive) {
+int utils_rand_range(RandState* r, int min_inclusive, int max_inclusive) {
     if (max_inclusive <= min_inclusive) return min_inclusive;
-    int span = max_inclusive - min_inclusive + 1;
-    return min_inclusive + (rand() % span);
+    uint32_t span = (uint32_t)((int64_t)max_inclusive - min_inclusive + 1);
+    return (int)((int64_t)min_inclusive + utils_rand_below(r, span));
+}
+
+uint64_t utils_seed_from_env(const char* name) {
+    const char* v = name ? getenv(name) : NULL;
+    if (v && v[0]) return strtoull(v, NULL, 0);
+    uint64_t x = (uint64_t)utils_now_ms();
+#ifndef _WIN32
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    x ^= ((uint64_t)ts.tv_nsec << 20) ^ ((uint64_t)getpid() << 40);
+#endif
+    return splitmix64(&x);
 }
@@ -1,6 +1,28 @@
+#define _POSIX_C_SOURCE 200809L
 #include <stdio.h>
+#include <stdlib.h>
 #include <string.h>
+#include <sys/stat.h>
+#include <time.h>
+#include <math.h>
 #include "../include/disk.h"
+#include "../include/compress.h"
+#include "../include/http.h"
+#include "../include/router.h"
+#include "../include/json.h"
+#include "../include/persist.h"
+#include "../include/system_disk.h"
+#include "../include/sampler.h"
+#include "../include/diskstats.h"
+#include "../include/timeseries.h"
+#include "../include/forecast.h"
+#include "../include/scan.h"
+#include "../include/aio.h"
+#include "../include/backing.h"
+#include <errno.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <pthread.h>
 
 static int test_allocate_and_delete() {
     disk_reset();
@@ -38,6 +60,828 @@ static int test_fragmented_and_defrag() {
     return 0;
 }
 
+static int test_logs_formatted_on_read() {
+    disk_reset();
+    int fid = 0;
+    if (disk_allocate_custom(3, "best-fit", &fid) != 0) return 1;
+    char* logs = disk_get_logs();
+    if (!logs) return 2;
+    char expect[128];
+    snprintf(expect, sizeof(expect), "allocate_custom: id=%d size=3 strategy=best-fit start=0", fid);
+    int ok = strstr(logs, expect) != NULL && strstr(logs, "disk_reset: disk reinitialized") != NULL;
+    free(logs);
+    return ok ? 0 : 3;
+}
+
+// Sequence number of the newest event, read back through the query API
+static int log_head_seq() {
+    DiskLogQuery q;
+    disk_log_query_init(&q);
+    q.limit = 1;
+    char* s = disk_query_logs(&q);
+    const char* h = s ? strstr(s, "\"head\": ") : NULL;
+    int head = h ? atoi(h + 8) : -1;
+    free(s);
+    return head;
+}
+
+static int test_log_query_cursor_and_filters() {
+    disk_reset();
+    int base = log_head_seq() - 1; // the reset event
+    int f1 = 0, f2 = 0;
+    if (disk_allocate_contiguous(4, &f1) != 0) return 1;
+    if (disk_allocate_contiguous(4, &f2) != 0) return 2;
+    if (disk_logical_delete(f1) != 0) return 3;
+
+    DiskLogQuery q;
+    char want[3][64];
+    disk_log_query_init(&q);
+    q.cursor = base + 1;
+    q.limit = 1;
+    char* s = disk_query_logs(&q);
+    if (!s) return 4;
+    snprintf(want[0], sizeof(want[0]), "\"seq\":%d,", base + 1);
+    snprintf(want[1], sizeof(want[1]), "\"seq\":%d,", base + 2);
+    snprintf(want[2], sizeof(want[2]), "\"nextCursor\": %d", base + 2);
+    int ok = strstr(s, want[0]) && !strstr(s, want[1]) && strstr(s, want[2]) && strstr(s, "\"hasMore\": 1") &&
+             strstr(s, "\"reset\": 0");
+    free(s);
+    if (!ok) return 5;
+
+    disk_log_query_init(&q);
+    q.file_id = f1;
+    s = disk_query_logs(&q);
+    if (!s) return 6;
+    ok = strstr(s, "\"op\":\"allocate_contiguous\"") && strstr(s, "\"op\":\"delete\"") && !strstr(s, want[1]);
+    free(s);
+    if (!ok) return 7;
+
+    disk_log_query_init(&q);
+    q.op_mask = 1u << DISK_OP_DELETE;
+    q.cursor = base + 4; // tail: nothing new yet
+    s = disk_query_logs(&q);
+    if (!s) return 8;
+    snprintf(want[2], sizeof(want[2]), "\"nextCursor\": %d", base + 4);
+    ok = strstr(s, "\"logs\": []") && strstr(s, want[2]) && strstr(s, "\"reset\": 0");
+    free(s);
+    if (!ok) return 9;
+
+    // a cursor from before a reset keeps working: numbering carries on
+    disk_reset();
+    if (log_head_seq() != base + 5) return 10;
+    disk_log_query_init(&q);
+    q.cursor = base + 100; // never handed out
+    s = disk_query_logs(&q);
+    ok = s && strstr(s, "\"reset\": 1") && strstr(s, "\"op\":\"disk_reset\"");
+    free(s);
+    return ok ? 0 : 11;
+}
+
+// A reload continues the sequence from the log file instead of restarting it
+static int test_log_seq_survives_reload() {
+    disk_reset();
+    int f1 = 0;
+    if (disk_allocate_contiguous(2, &f1) != 0) return 1;
+    if (disk_flush() != 0) return 2;
+    int head = log_head_seq();
+    if (disk_load() != 0) return 3;
+    if (log_head_seq() != head + 1) return 4; // plus the load event
+    DiskLogQuery q;
+    disk_log_query_init(&q);
+    q.cursor = head;
+    char* s = disk_query_logs(&q);
+    int ok = s && strstr(s, "\"op\":\"disk_load\"") && !strstr(s, "\"op\":\"allocate_contiguous\"") &&
+             strstr(s, "\"reset\": 0");
+    free(s);
+    return ok ? 0 : 5;
+}
+
+static int hook_calls = 0;
+static void count_hook(void* ctx) { (void)ctx; hook_calls++; }
+
+// Hooks see the event already complete, strategy included
+static int hook_saw_strategy = 0;
+static void strategy_hook(void* ctx) {
+    (void)ctx;
+    char* s = disk_get_logs();
+    hook_saw_strategy = s && strstr(s, "strategy=worst-fit") != NULL;
+    free(s);
+}
+
+static int test_mutation_hook_fires() {
+    disk_reset();
+    disk_set_mutation_hook(count_hook, NULL);
+    unsigned long gen = disk_generation();
+    hook_calls = 0;
+    int fid = 0;
+    if (disk_allocate_contiguous(2, &fid) != 0) return 1;
+    if (disk_defragment() != 0) return 2;
+    char* s = disk_get_stats(); // reads must not count as mutations
+    free(s);
+    disk_set_mutation_hook(NULL, NULL);
+    if (hook_calls != 2) return 3;
+    if (disk_generation() != gen + 2) return 4;
+    disk_set_mutation_hook(strategy_hook, NULL);
+    int r = disk_allocate_custom(1, "worst-fit", &fid);
+    disk_set_mutation_hook(NULL, NULL);
+    if (r != 0 || !hook_saw_strategy) return 5;
+    return 0;
+}
+
+static int test_gzip_state_payload() {
+    if (compress_crc32(0, "123456789", 9) != 0xCBF43926UL) return 1;
+    if (compress_adler32(1, "Wikipedia", 9) != 0x11E60398UL) return 2;
+    disk_reset();
+    char* state = disk_get_state();
+    if (!state) return 3;
+    size_t n = strlen(state);
+    Deflater d;
+    if (deflater_init(&d, COMPRESS_LEVEL_DEFAULT) != 0) { free(state); return 4; }
+    StrBuf out;
+    sb_init(&out, 64);
+    deflater_begin(&d);
+    deflater_write(&d, state, n);
+    int r = deflater_finish(&d, COMPRESS_GZIP, &out);
+    const unsigned char* g = (const unsigned char*)out.buf;
+    int ok = r == 0 && out.len > 18 && g[0] == 0x1f && g[1] == 0x8b && g[2] == 8;
+    // trailer: CRC32 and length of the input, little endian
+    unsigned long crc = (unsigned long)g[out.len-8] | ((unsigned long)g[out.len-7] << 8) |
+                        ((unsigned long)g[out.len-6] << 16) | ((unsigned long)g[out.len-5] << 24);
+    ok = ok && crc == compress_crc32(0, state, n) && g[out.len-4] == (n & 0xFF);
+    ok = ok && out.len * 8 < n; // block map is highly repetitive
+    sb_free(&out);
+    deflater_free(&d);
+    free(state);
+    return ok ? 0 : 5;
+}
+
+static int test_http_parser_partial_reads() {
+    const char* raw = "POST /allocate/custom?x=1 HTTP/1.1\r\nContent-Length: 32\r\n"
+                      "Accept-Encoding: gzip\r\n\r\n{\"size\":4,\"strategy\":\"best-fit\"}";
+    static char buf[HTTP_MAX_REQUEST_BYTES + 1];
+    size_t n = strlen(raw);
+    HttpParser p;
+    HttpRequest req;
+    http_parser_init(&p, &req);
+    // deliver one byte per read
+    HttpParseState st = HTTP_PARSE_REQUEST_LINE;
+    for (size_t i = 0; i < n; i++) {
+        buf[i] = raw[i];
+        st = http_parse(&p, &req, buf, i + 1);
+        if (st == HTTP_PARSE_ERROR) return 1;
+        if (st == HTTP_PARSE_DONE && i + 1 < n) return 2;
+    }
+    if (st != HTTP_PARSE_DONE) return 3;
+    if (strcmp(req.method, "POST") != 0 || strcmp(req.path, "/allocate/custom") != 0) return 4;
+    if (strcmp(req.query, "x=1") != 0 || strcmp(req.accept_encoding, "gzip") != 0) return 5;
+    if (req.body_len != 32 || strcmp(req.body, "{\"size\":4,\"strategy\":\"best-fit\"}") != 0) return 6;
+
+    const char* big = "POST / HTTP/1.1\r\nContent-Length: 99999999\r\n\r\n";
+    http_parser_init(&p, &req);
+    memcpy(buf, big, strlen(big));
+    if (http_parse(&p, &req, buf, strlen(big)) != HTTP_PARSE_ERROR || p.error_status != 413) return 7;
+    return 0;
+}
+
+static void route_a(int fd, const HttpRequest* req, const RouteParams* params) {}
+static void route_b(int fd, const HttpRequest* req, const RouteParams* params) {}
+
+static int test_router_dispatch() {
+    static const Route routes[] = {
+        { HTTP_GET,    "/api/disk/state", route_a },
+        { HTTP_POST,   "/api/disk/reset", route_b },
+        { HTTP_DELETE, "/file/{id}",      route_b },
+        { HTTP_GET,    "/file/latest",    route_a },
+    };
+    static Router r;
+    if (router_build(&r, routes, 4) != 0) return 1;
+    RouteHandler h = NULL;
+    RouteParams params;
+    if (router_match(&r, "GET", "/api/disk/state", &h, &params) != ROUTE_FOUND || h != route_a) return 2;
+    if (router_match(&r, "POST", "/api/disk/reset/", &h, &params) != ROUTE_FOUND || h != route_b) return 3;
+    if (router_match(&r, "DELETE", "/file/42", &h, &params) != ROUTE_FOUND) return 4;
+    const char* id = route_param(&params, "id");
+    if (!id || strcmp(id, "42") != 0 || route_param(&params, "i") != NULL) return 5;
+    if (router_match(&r, "GET", "/file/latest", &h, &params) != ROUTE_FOUND || h != route_a) return 6;
+    if (router_match(&r, "POST", "/api/disk/state", &h, &params) != ROUTE_METHOD_NOT_ALLOWED) return 7;
+    if (router_match(&r, "GET", "/api/disk", &h, &params) != ROUTE_NOT_FOUND) return 8;
+    if (router_match(&r, "GET", "/nope", &h, &params) != ROUTE_NOT_FOUND) return 9;
+    // duplicate (method, pattern) pairs are rejected
+    static const Route dup[] = { { HTTP_GET, "/a", route_a }, { HTTP_GET, "/a/", route_b } };
+    if (router_build(&r, dup, 2) == 0) return 10;
+    return 0;
+}
+
+static int test_json_extract_one_pass() {
+    // "size" inside a string value must not be mistaken for the key
+    const char* body = "{ \"note\": \"\\\"size\\\": 99\", \"nested\": {\"size\": 7, \"l\": [1, {}, null]},"
+                       " \"size\": 12, \"name\": \"a\\u00e9\\n\", \"ids\": [3, -4, 5] }";
+    int size = 0, ids[4];
+    char name[16];
+    JsonField f[] = {
+        { "size", JSON_FIELD_INT, &size, 0, 0, 0 },
+        { "name", JSON_FIELD_STRING, name, sizeof(name), 0, 0 },
+        { "ids", JSON_FIELD_INT_ARRAY, ids, 4, 0, 0 },
+        { "missing", JSON_FIELD_INT, &size, 0, 0, 0 },
+    };
+    if (json_extract(body, strlen(body), f, 4) != 0) return 1;
+    if (f[0].found != 1 || size != 12) return 2;
+    if (f[1].found != 1 || strcmp(name, "a\xc3\xa9\n") != 0) return 3;
+    if (f[2].found != 1 || f[2].count != 3 || ids[1] != -4) return 4;
+    if (f[3].found != 0) return 5;
+
+    // wrong types and overflows are reported per field
+    const char* bad_types = "{\"size\": \"12\", \"ids\": [1, 2, 3, 4, 5], \"name\": 1.5e3}";
+    if (json_extract(bad_types, strlen(bad_types), f, 3) != 0) return 6;
+    if (f[0].found != -1 || f[1].found != -1 || f[2].found != -1) return 7;
+
+    const char* malformed[] = { "", "[1]", "{\"size\": 1,}", "{\"size\": 01}", "{\"a\": \"x}", "{} x" };
+    for (size_t i = 0; i < sizeof(malformed) / sizeof(malformed[0]); i++) {
+        if (json_extract(malformed[i], strlen(malformed[i]), f, 1) == 0) return 8;
+    }
+    return 0;
+}
+
+static int test_parallel_int_array() {
+    enum { N = 20000 };
+    StrBuf sb;
+    if (sb_init(&sb, N * 8) != 0) return 1;
+    sb_append(&sb, " [ ");
+    for (int i = 0; i < N; i++) sb_appendf(&sb, i + 1 < N ? "%d, " : "%d", (i * 37) % 1001 - 500);
+    sb_append(&sb, " ]");
+    static int seq[N], par[N];
+    size_t nseq = 0, npar = 0;
+    int ok = json_parse_int_array(sb.buf, sb.len, seq, N, &nseq, 1) == 0 &&
+             json_parse_int_array(sb.buf, sb.len, par, N, &npar, 4) == 0 &&
+             nseq == N && npar == N && memcmp(seq, par, sizeof(seq)) == 0 && par[N - 1] == (int)(((N - 1) * 37L) % 1001 - 500);
+    // too small a destination, and a trailing comma, are both rejected
+    if (ok && json_parse_int_array(sb.buf, sb.len, par, N - 1, &npar, 4) == 0) ok = 0;
+    if (ok && json_parse_int_array("[1, 2, 3,]", 10, par, N, &npar, 2) == 0) ok = 0;
+    if (ok && (json_parse_int_array("[ ]", 3, par, N, &npar, 4) != 0 || npar != 0)) ok = 0;
+    sb_free(&sb);
+    return ok ? 0 : 2;
+}
+
+static int test_async_persist_coalesces() {
+    disk_reset();
+    if (disk_set_persist_mode(DISK_PERSIST_ASYNC) != 0) return 1;
+    int fid = 0;
+    for (int i = 0; i < 40; i++) {
+        if (disk_allocate_contiguous(2, &fid) != 0) { disk_set_persist_mode(DISK_PERSIST_SYNC); return 2; }
+    }
+    int flushed = disk_flush();
+    if (disk_set_persist_mode(DISK_PERSIST_SYNC) != 0 || flushed != 0) return 3;
+    // reloading from disk brings back the state after the last mutation
+    if (disk_load() != 0 || disk_total_used() != 80) return 4;
+    int next = 0;
+    if (disk_allocate_contiguous(1, &next) != 0 || next != fid + 1) return 5;
+    return 0;
+}
+
+static int test_durable_write_modes() {
+    const char* path = "test_durable.tmpfile";
+    for (int d = DURABILITY_NONE; d <= DURABILITY_FSYNC; d++) {
+        char content[32];
+        snprintf(content, sizeof(content), "mode=%s", durability_name((Durability)d));
+        if (write_file_durable(path, content, strlen(content), (Durability)d) != 0) return 1;
+        StrBuf in;
+        if (read_text_file(path, &in) != 0) return 2;
+        int same = strcmp(in.buf, content) == 0;
+        free(in.buf);
+        if (!same) return 3;
+        if (file_exists("test_durable.tmpfile.tmp")) return 4;
+    }
+    remove(path);
+    if (durability_from_name("fdatasync") != DURABILITY_FDATASYNC || durability_from_name("sometimes") != -1) return 5;
+    return 0;
+}
+
+static long file_size(const char* path) {
+    FILE* f = fopen(path, "rb");
+    if (!f) return -1;
+    fseek(f, 0, SEEK_END);
+    long n = ftell(f);
+    fclose(f);
+    return n;
+}
+
+static int test_incremental_checkpoints() {
+    disk_reset(); // full snapshot
+    StrBuf before;
+    if (read_text_file("test_state.json", &before) != 0) return 1;
+    long delta0 = file_size("test_state.json.delta");
+    int fid = 0;
+    // 3 blocks inside one region: one delta record, base untouched
+    if (disk_allocate_contiguous(3, &fid) != 0) { free(before.buf); return 2; }
+    StrBuf after;
+    if (read_text_file("test_state.json", &after) != 0) { free(before.buf); return 3; }
+    int same = strcmp(before.buf, after.buf) == 0;
+    free(before.buf);
+    free(after.buf);
+    if (!same) return 4;
+    if (file_size("test_state.json.delta") != delta0 + (long)sizeof(DiskDeltaRecord)) return 5;
+    if (disk_load() != 0 || disk_total_used() != 3) return 6;
+    // enough churn forces a full snapshot, which restarts the delta file
+    for (int i = 0; i < DISK_REGIONS * 4; i++) disk_defragment();
+    if (file_size("test_state.json.delta") >= (long)sizeof(DiskDeltaRecord) * DISK_REGIONS * 4) return 7;
+    if (disk_load() != 0 || disk_total_used() != 3) return 8;
+    return 0;
+}
+
+static int test_snapshot_checksum_recovery() {
+    disk_reset();
+    int fid = 0;
+    if (disk_allocate_contiguous(3, &fid) != 0) return 1;
+    StrBuf good;
+    if (read_text_file("test_state.json", &good) != 0) return 2;
+    // a flipped byte in the body must fail validation, not load garbage
+    char* digit = strstr(good.buf, "\"state\": [");
+    if (!digit) { free(good.buf); return 3; }
+    char orig = digit[10];
+    digit[10] = orig == '0' ? '2' : '0';
+    write_text_file_atomic("test_state.json", good.buf);
+    int r = disk_load();
+    digit[10] = orig;
+    write_text_file_atomic("test_state.json", good.buf);
+    free(good.buf);
+    if (r != -2) return 4;
+    if (disk_load() != 0 || disk_total_used() != 3) return 5;
+    // a torn record at the end of the delta log is dropped on replay and
+    // cut off so later records still line up
+    FILE* f = fopen("test_state.json.delta", "ab");
+    if (!f) return 6;
+    fwrite("torn-tail", 1, 9, f);
+    fclose(f);
+    if (disk_load() != 0 || disk_total_used() != 3) return 7;
+    if (file_size("test_state.json.delta") % (long)sizeof(DiskDeltaRecord) != 0) return 8;
+    if (disk_allocate_contiguous(2, &fid) != 0) return 9;
+    if (disk_load() != 0 || disk_total_used() != 5) return 10;
+    return 0;
+}
+
+static int test_preallocation_modes() {
+    const char* path = "test_prealloc.bin";
+    const size_t size = 3 * PREALLOC_FILL_CHUNK + 123;
+    struct stat st;
+    for (int m = PREALLOC_SPARSE; m <= PREALLOC_WRITE_FILL; m++) {
+        if (create_file_on_disk_ex(path, size, (PreallocMode)m) != 0) return 1 + m;
+        if (stat(path, &st) != 0) return 10;
+        remove(path);
+        // keep-size reserves blocks behind an empty file
+        size_t want = m == PREALLOC_KEEP_SIZE ? 0 : size;
+        if ((size_t)st.st_size != want) return 20 + m;
+        if (m != PREALLOC_SPARSE && (size_t)st.st_blocks * 512 < size) return 30 + m;
+    }
+    if (prealloc_mode_from_name("zero-range") != PREALLOC_ZERO_RANGE || prealloc_mode_from_name("lazy") != -1) return 40;
+    return 0;
+}
+
+static void* list_mounts_thread(void* arg) {
+    SystemMountInfo* m = (SystemMountInfo*)calloc(SYSTEM_MAX_MOUNTS, sizeof(SystemMountInfo));
+    int n = m ? get_system_mounts(m, SYSTEM_MAX_MOUNTS, SYSTEM_MOUNT_TIMEOUT_MS) : 0;
+    for (int i = 0; i < n; i++) if (m[i].status == -2) *(int*)arg = 1;
+    free(m);
+    return NULL;
+}
+
+static int test_system_mounts() {
+    static SystemMountInfo m[SYSTEM_MAX_MOUNTS];
+    // a tiny timeout may leave probes running; they must clean up after us
+    int n = get_system_mounts(m, SYSTEM_MAX_MOUNTS, 1);
+    if (n < 1) return 1;
+    for (int i = 0; i < n; i++) if (m[i].status < -2 || m[i].status > 0) return 2;
+    n = get_system_mounts(m, SYSTEM_MAX_MOUNTS, SYSTEM_MOUNT_TIMEOUT_MS);
+    int root = 0;
+    for (int i = 0; i < n; i++) {
+        if (strcmp(m[i].info.path, "/") == 0 && m[i].status == 0 && m[i].info.total_space > 0) root = 1;
+    }
+    if (!root) return 3;
+    if (get_system_mounts(m, 1, SYSTEM_MOUNT_TIMEOUT_MS) > 1) return 4;
+    // overlapping calls share in-flight probes instead of timing each other out
+    int timed_out[4] = {0};
+    pthread_t t[4];
+    for (int i = 0; i < 4; i++) pthread_create(&t[i], NULL, list_mounts_thread, &timed_out[i]);
+    for (int i = 0; i < 4; i++) pthread_join(t[i], NULL);
+    for (int i = 0; i < 4; i++) if (timed_out[i]) return 5;
+    return 0;
+}
+
+static int test_sampler_publishes() {
+    if (sampler_latest() != NULL) return 1;
+    if (sampler_start(10) != 0) return 2;
+    if (sampler_start(10) != -1) { sampler_stop(); return 3; }
+    struct timespec nap = { 0, 5 * 1000000L };
+    unsigned long first = 0, last = 0;
+    // wait (up to ~5s) for the collector to publish a few rounds
+    for (int i = 0; i < 1000 && last < first + 3; i++) {
+        const SystemSample* s = sampler_latest();
+        if (s) {
+            if (s->seq < last) { sampler_stop(); return 4; }
+            if (!first) first = s->seq;
+            last = s->seq;
+            if (s->root_status != 0 || s->mount_count < 1) { sampler_stop(); return 5; }
+        }
+        nanosleep(&nap, NULL);
+    }
+    sampler_stop();
+    if (!first || last < first + 3) return 6;
+    if (sampler_latest() != NULL) return 7;
+    return 0;
+}
+
+static int test_diskstats_rates() {
+    const char* t0 =
+        "   7       0 loop0 0 0 0 0 0 0 0 0 0 0 0\n"
+        " 253       0 vda 1000 10 8000 500 2000 20 16000 4000 1 900 4500 0 0 0 0\n"
+        " 253      16 vdb 50 0 400 10 0 0 0 0 0 10 10\n";
+    const char* t1 =
+        " 253      16 vdb 40 0 320 8 0 0 0 0 0 8 8\n"
+        " 253       0 vda 1100 10 8800 700 2300 20 18400 4600 3 1400 5300 0 0 0 0\n";
+    DiskCounters a[4], b[4];
+    if (diskstats_parse(t0, a, 4) != 2 || strcmp(a[0].name, "vda") != 0) return 1; // idle loop0 skipped
+    if (diskstats_parse(t1, b, 4) != 2) return 2;
+    DiskIoRates r[4];
+    // 1s apart; vdb's counters went backwards (reset) and restart from zero
+    if (diskstats_rates(a, 2, b, 2, 1000.0, r, 4) != 2) return 3;
+    const DiskIoRates* vda = strcmp(r[0].name, "vda") == 0 ? &r[0] : &r[1];
+    const DiskIoRates* vdb = vda == &r[0] ? &r[1] : &r[0];
+    if (vda->read_iops != 100.0 || vda->write_iops != 300.0) return 4;
+    if (vda->read_bytes_per_sec != 800.0 * 512 || vda->write_bytes_per_sec != 2400.0 * 512) return 5;
+    if (vda->read_await_ms != 2.0 || vda->write_await_ms != 2.0) return 6;
+    if (vda->queue_depth != 0.8 || vda->util_percent != 50.0 || vda->in_flight != 3) return 7;
+    if (vdb->read_iops != 40.0) return 8;
+    return 0;
+}
+
+// Partitions and stacked devices repeat their disk's I/O; totals skip them
+static int test_diskstats_whole_disks() {
+    const char* t0 =
+        "   8       0 vdz 1000 0 8000 0 1000 0 8000 0 0 0 0\n"
+        "   8       1 vdz1 1000 0 8000 0 1000 0 8000 0 0 0 0\n"
+        " 259       0 nvme9n1 100 0 800 0 0 0 0 0 0 0 0\n"
+        " 259       1 nvme9n1p2 100 0 800 0 0 0 0 0 0 0 0\n"
+        " 253       0 dm-0 1000 0 8000 0 1000 0 8000 0 0 0 0\n"
+        "   9     127 md127 5 0 40 0 0 0 0 0 0 0 0\n"
+        "   7       3 loop3 5 0 40 0 0 0 0 0 0 0 0\n";
+    const char* t1 =
+        "   8       0 vdz 2000 0 16000 0 1500 0 12000 0 0 0 0\n"
+        "   8       1 vdz1 2000 0 16000 0 1500 0 12000 0 0 0 0\n"
+        " 259       0 nvme9n1 200 0 1600 0 0 0 0 0 0 0 0\n"
+        " 259       1 nvme9n1p2 200 0 1600 0 0 0 0 0 0 0 0\n"
+        " 253       0 dm-0 2000 0 16000 0 1500 0 12000 0 0 0 0\n"
+        "   9     127 md127 10 0 80 0 0 0 0 0 0 0 0\n"
+        "   7       3 loop3 10 0 80 0 0 0 0 0 0 0 0\n";
+    DiskCounters a[8], b[8];
+    if (diskstats_parse(t0, a, 8) != 7 || diskstats_parse(t1, b, 8) != 7) return 1;
+    static const int WHOLE[7] = { 1, 0, 1, 0, 0, 0, 0 };
+    for (int i = 0; i < 7; i++) if (a[i].whole_disk != WHOLE[i]) return 2;
+    DiskIoRates r[8], total;
+    int n = diskstats_rates(a, 7, b, 7, 1000.0, r, 8);
+    if (n != 7) return 3;
+    // vdz and nvme9n1 only: partitions, dm-0, md127 and loop3 add nothing
+    if (diskstats_totals(r, n, &total) != 2) return 4;
+    if (total.read_iops != 1100.0 || total.write_iops != 500.0) return 5;
+    if (total.read_bytes_per_sec != 8800.0 * 512 || total.write_bytes_per_sec != 4000.0 * 512) return 6;
+    return 0;
+}
+
+#define CAP_POINTS 1024
+
+static int test_timeseries_rollups() {
+    ts_reset();
+    // two minutes of one sample per second, value = second
+    for (int t = 0; t < 120; t++) ts_record(TS_SIM_USED_BLOCKS, t * 1000LL + 500, t);
+    TsPoint p[CAP_POINTS];
+    int n = ts_query(TS_SIM_USED_BLOCKS, TS_RES_1M, 0, 120000, p, CAP_POINTS);
+    if (n != 2 || p[0].start_ms != 0 || p[1].start_ms != 60000) return 1;
+    if (p[0].count != 60 || p[0].min != 0 || p[0].max != 59 || p[0].avg != 29.5) return 2;
+    if (p[1].min != 60 || p[1].max != 119 || p[1].avg != 89.5) return 3;
+    n = ts_query(TS_SIM_USED_BLOCKS, TS_RES_1S, 10000, 19999, p, CAP_POINTS);
+    if (n != 10 || p[0].avg != 10 || p[9].avg != 19) return 4;
+    if (ts_query(TS_SIM_USED_BLOCKS, TS_RES_1H, 0, 120000, p, CAP_POINTS) != 1 || p[0].count != 120) return 5;
+    // the 1s ring keeps its last ts_capacity() seconds only
+    for (int t = 120; t < 1000; t++) ts_record(TS_SIM_USED_BLOCKS, t * 1000LL, t);
+    n = ts_query(TS_SIM_USED_BLOCKS, TS_RES_1S, 0, 1000000, p, CAP_POINTS);
+    if (n != ts_capacity(TS_RES_1S) || p[0].start_ms != (1000 - n) * 1000LL) return 6;
+    if (ts_query(TS_SIM_BAD_BLOCKS, TS_RES_1S, 0, 1000000, p, CAP_POINTS) != 0) return 7;
+    if (ts_metric_from_name("io_iops") != TS_IO_IOPS || ts_resolution_from_name("1d") != -1) return 8;
+    ts_reset();
+    return 0;
+}
+
+static int test_forecast_time_to_full() {
+    forecast_reset();
+    // grows 1000 bytes/s from 1e6 on a 2e6 volume, sampled every 10s
+    long long t0 = 1700000000000LL;
+    for (int i = 0; i <= 30; i++) {
+        forecast_add("/data", t0 + i * 10000LL, 1e6 + i * 10000.0, 2e6);
+        forecast_add("/flat", t0 + i * 10000LL, 5e5, 2e6);
+    }
+    DiskForecast f;
+    if (forecast_get("/data", &f) != 0 || f.samples != 31) return 1;
+    if (fabs(f.bytes_per_sec - 1000.0) > 1e-3) return 2;
+    // 1e6 + 300 * 1000 used at the last sample: 700s to go
+    if (fabs(f.eta_seconds - 700.0) > 1e-2 || f.confidence < 0.999) return 3;
+    if (forecast_get("/flat", &f) != 0 || f.eta_seconds != -1 || f.bytes_per_sec != 0) return 4;
+    if (forecast_get("/nope", &f) != -1) return 5;
+    DiskForecast all[4];
+    if (forecast_list(all, 4) != 2) return 6;
+    forecast_reset();
+    return 0;
+}
+
+// Fails any read touching one of the listed sectors, like a bad disk would
+typedef struct { const unsigned long long* bad; int n; } FaultMap;
+
+static ssize_t faulty_pread(void* ctx, int fd, void* buf, size_t len, off_t off) {
+    const FaultMap* m = (const FaultMap*)ctx;
+    for (int i = 0; i < m->n; i++) {
+        unsigned long long at = m->bad[i] * SCAN_SECTOR_BYTES;
+        if (at < (unsigned long long)off + len && at + SCAN_SECTOR_BYTES > (unsigned long long)off) {
+            errno = EIO;
+            return -1;
+        }
+    }
+    return pread(fd, buf, len, off);
+}
+
+static int test_scan_bisects_bad_sectors() {
+    const char* img = "test_scan.img";
+    const size_t size = 4 * 1024 * 1024 + 1000; // odd tail: last sector is partial
+    if (create_file_on_disk_ex(img, size, PREALLOC_WRITE_FILL) != 0) return 1;
+    unsigned long long last = size / SCAN_SECTOR_BYTES;
+    const unsigned long long bad[] = { 5000, 101, 100, 102, last };
+    FaultMap map = { bad, 5 };
+    ScanOptions opt;
+    scan_options_init(&opt);
+    opt.chunk_bytes = 256 * 1024;
+    opt.read_fn = faulty_pread;
+    opt.read_ctx = &map;
+    ScanResult r;
+    int rc = scan_device(img, &opt, &r);
+    if (rc != 0 || r.bytes_scanned != size || r.bad_sectors != 5) { remove(img); return 2; }
+    if (r.range_count != 3 || r.ranges[0].first_sector != 100 || r.ranges[0].count != 3) { remove(img); return 3; }
+    if (r.ranges[1].first_sector != 5000 || r.ranges[2].first_sector != last) { remove(img); return 4; }
+    if (r.failed_reads != 3) { remove(img); return 5; } // chunks 0, 9 and the tail
+    // a clean pass capped at 16 MiB/s needs about a quarter of a second
+    opt.read_fn = NULL;
+    opt.max_bytes_per_sec = 16.0 * 1024 * 1024;
+    rc = scan_device(img, &opt, &r);
+    remove(img);
+    if (rc != 0 || r.bad_sectors != 0 || r.range_count != 0) return 6;
+    if (r.elapsed_s < 0.2) return 7;
+    if (scan_device("no-such-image.img", NULL, &r) != -1 || r.status != -1) return 8;
+    return 0;
+}
+
+// Holds up the read at one offset, as a device that stops answering would
+typedef struct { off_t at; int ms; } HangMap;
+
+static ssize_t hanging_pread(void* ctx, int fd, void* buf, size_t len, off_t off) {
+    const HangMap* h = (const HangMap*)ctx;
+    if (off == h->at) {
+        struct timespec ts = { h->ms / 1000, (long)(h->ms % 1000) * 1000000L };
+        nanosleep(&ts, NULL);
+    }
+    return pread(fd, buf, len, off);
+}
+
+static double mono_s() {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (double)ts.tv_sec + (double)ts.tv_nsec / 1e9;
+}
+
+static int test_read_deadlines() {
+    AioCompletion done[4];
+    static char buf[4096];
+    // io_uring: a read from an empty pipe waits until something is written
+    int p[2];
+    if (pipe(p) != 0) return 1;
+    AioQueue* q = aio_open(2, AIO_IO_URING, NULL, NULL);
+    int rc = 0;
+    if (q) {
+        double t0 = mono_s();
+        if (aio_read(q, p[0], buf, 16, 0, buf) != 0 || aio_wait_timeout(q, done, 4, 1, 50) != 0) rc = 2;
+        double waited = mono_s() - t0;
+        if (!rc && (waited < 0.04 || waited > 1.0)) rc = 3;
+        if (!rc && (write(p[1], "x", 1) != 1 || aio_wait(q, done, 4, 1) != 1 || done[0].res != 1)) rc = 4;
+        aio_close(q);
+    }
+    close(p[0]);
+    close(p[1]);
+    if (rc) return rc;
+    // thread pool: the same through a hook that stalls
+    const char* img = "test_hang.img";
+    const size_t size = 2 * 1024 * 1024;
+    if (create_file_on_disk_ex(img, size, PREALLOC_WRITE_FILL) != 0) return 5;
+    int fd = open(img, O_RDONLY);
+    HangMap hang = { 512 * 1024, 100 }; // back within the sweep's grace period below
+    q = aio_open(2, AIO_THREADS, hanging_pread, &hang);
+    if (fd < 0 || !q) rc = 6;
+    if (!rc && (aio_read(q, fd, buf, sizeof(buf), hang.at, buf) != 0 || aio_wait_timeout(q, done, 4, 1, 20) != 0)) rc = 7;
+    if (!rc && (aio_wait(q, done, 4, 1) != 1 || done[0].res != (long long)sizeof(buf))) rc = 8;
+    aio_close(q);
+    if (fd >= 0) close(fd);
+    // a scan writes the stalled chunk off as bad instead of waiting for it
+    ScanOptions opt;
+    scan_options_init(&opt);
+    opt.chunk_bytes = 256 * 1024;
+    opt.timeout_ms = 60;
+    opt.read_fn = hanging_pread;
+    opt.read_ctx = &hang;
+    ScanResult r;
+    if (!rc && scan_device(img, &opt, &r) != 0) rc = 9;
+    if (!rc && (r.bytes_scanned != size || r.failed_reads != 1 || r.slow_reads != 1)) rc = 10;
+    if (!rc && (r.range_count != 1 || r.ranges[0].first_sector != 1024 || r.ranges[0].count != 512)) rc = 11;
+    remove(img);
+    return rc;
+}
+
+// Writes four blocks through the queue, syncs and reads them back
+static int aio_round_trip(AioQueue* q, int fd) {
+    static char out[4][4096], in[4][4096];
+    AioCompletion done[8];
+    for (int i = 0; i < 4; i++) {
+        memset(out[i], 'a' + i, sizeof(out[i]));
+        if (aio_write(q, fd, out[i], sizeof(out[i]), (long long)i * 4096, out[i]) != 0) return 1;
+    }
+    if (aio_write(q, fd, out[0], 1, 0, NULL) != -1) return 2; // depth 4
+    int got = 0;
+    while (got < 4) {
+        int n = aio_wait(q, done, 8, 1);
+        if (n <= 0) return 3;
+        for (int i = 0; i < n; i++) {
+            const char* t = (const char*)done[i].tag;
+            if (done[i].res != 4096 || t < out[0] || t > out[3] || (t - out[0]) % 4096 != 0) return 4;
+        }
+        got += n;
+    }
+    if (aio_fsync(q, fd, 1, NULL) != 0 || aio_wait(q, done, 8, 1) != 1 || done[0].res != 0) return 5;
+    for (int i = 0; i < 4; i++) {
+        if (aio_read(q, fd, in[i], sizeof(in[i]), (long long)i * 4096, in[i]) != 0) return 6;
+    }
+    for (got = 0; got < 4;) {
+        int n = aio_wait(q, done, 8, 4 - got);
+        if (n <= 0) return 7;
+        got += n;
+    }
+    if (memcmp(in, out, sizeof(in)) != 0 || aio_inflight(q) != 0) return 8;
+    // past EOF reads come back short, a bad fd as -errno
+    if (aio_read(q, fd, in[0], 4096, 1 << 20, NULL) != 0 || aio_read(q, -1, in[1], 4096, 0, NULL) != 0) return 9;
+    if (aio_wait(q, done, 8, 2) != 2) return 10;
+    if (done[0].res + done[1].res != -EBADF || (done[0].res != 0 && done[1].res != 0)) return 11;
+    return 0;
+}
+
+static int test_aio_backends() {
+    const char* path = "test_aio.bin";
+    int fd = open(path, O_RDWR | O_CREAT | O_TRUNC, 0644);
+    if (fd < 0) return 1;
+    int rc = 0;
+    AioQueue* q = aio_open(4, AIO_THREADS, NULL, NULL);
+    if (!q || aio_backend(q) != AIO_THREADS) rc = 2;
+    else if ((rc = aio_round_trip(q, fd)) != 0) rc += 10;
+    aio_close(q);
+    // io_uring may be disabled here; AUTO must still hand back a queue
+    q = aio_open(4, AIO_IO_URING, NULL, NULL);
+    if (q && rc == 0 && (rc = aio_round_trip(q, fd)) != 0) rc += 30;
+    aio_close(q);
+    q = aio_open(4, AIO_AUTO, NULL, NULL);
+    if (!q && rc == 0) rc = 4;
+    aio_close(q);
+    if (rc == 0 && aio_open(4, AIO_IO_URING, faulty_pread, NULL) != NULL) rc = 5; // hooks need threads
+    if (rc == 0 && aio_backend_from_name("io_uring") != AIO_IO_URING) rc = 6;
+    close(fd);
+    remove(path);
+    return rc;
+}
+
+static int header_is(int block, int file_id, int ordinal, int deleted) {
+    BackingHeader h;
+    return backing_read_header(block, &h) == 0 && h.magic == BACKING_MAGIC && h.file_id == file_id &&
+           h.ordinal == ordinal && (int)h.deleted == deleted;
+}
+
+static int test_backing_image() {
+    const char* img = "test_disk.img";
+    disk_reset();
+    if (disk_attach_image(img, 1000, 0) != -1) return 1;
+    if (disk_attach_image(img, 4096, 0) != 0) return 2;
+    struct stat st;
+    if (stat(img, &st) != 0 || st.st_size != (off_t)DISK_MAX_BLOCKS * 4096) { disk_detach_image(); remove(img); return 3; }
+    int a = 0, b = 0, rc = 0;
+    disk_allocate_contiguous(3, &a);
+    disk_allocate_contiguous(2, &b);
+    if (!header_is(0, a, 0, 0) || !header_is(2, a, 2, 0) || !header_is(4, b, 1, 0)) rc = 4;
+    // delete only flags the headers; undelete in place finds the data again
+    if (!rc && (disk_logical_delete(a) != 0 || !header_is(1, a, 1, 1))) rc = 5;
+    if (!rc && (disk_undelete_last() != 0 || !header_is(1, a, 1, 0))) rc = 6;
+    // after deleting a, defragment moves b's data down to blocks 0 and 1
+    if (!rc && (disk_logical_delete(a) != 0 || disk_defragment() != 0)) rc = 7;
+    if (!rc && (!header_is(0, b, 0, 0) || !header_is(1, b, 1, 0))) rc = 8;
+    BackingInfo info;
+    backing_info(&info);
+    const BackingOpStats* alloc = &info.ops[DISK_OP_ALLOC_CONTIGUOUS];
+    const BackingOpStats* defrag = &info.ops[DISK_OP_DEFRAGMENT];
+    if (!rc && (alloc->calls != 2 || alloc->bytes_written != 5 * 4096 || alloc->io_calls != 2)) rc = 9;
+    if (!rc && (info.ops[DISK_OP_UNDELETE].bytes_read == 0 || info.ops[DISK_OP_DELETE].calls != 2)) rc = 10;
+    if (!rc && (defrag->calls != 1 || defrag->bytes_copied + defrag->bytes_written != 2 * 4096)) rc = 11;
+    disk_detach_image();
+    // our own image is reused; other files and the state files are refused
+    if (!rc && disk_attach_image(img, 4096, 0) != 0) rc = 12;
+    disk_detach_image();
+    if (!rc && (disk_attach_image(img, 8192, 0) != -3 || disk_attach_image("test_state.json", 4096, 0) != -4 ||
+                disk_attach_image("./test_state.json.corrupt", 4096, 0) != -4 ||
+                file_size("test_state.json.corrupt") != -1)) rc = 13;
+    FILE* f = rc ? NULL : fopen(img, "r+b");
+    if (f) {
+        fputs("not an image", f);
+        fclose(f);
+        if (disk_attach_image(img, 4096, 0) != -3) rc = 14;
+    }
+    remove(img);
+    disk_reset();
+    return rc;
+}
+
+static int test_block_checksums_and_scrub() {
+    // the standard check value, and chaining across odd-sized pieces
+    if (compress_crc32c(0, "123456789", 9) != 0xE3069283ul) return 1;
+    const char* text = "scrub every block that holds data";
+    size_t len = strlen(text);
+    if (compress_crc32c(compress_crc32c(0, text, 5), text + 5, len - 5) != compress_crc32c(0, text, len)) return 2;
+
+    const char* img = "test_scrub.img";
+    disk_reset();
+    if (disk_attach_image(img, 4096, 0) != 0) return 3;
+    int fid = 0, rc = 0;
+    disk_allocate_contiguous(8, &fid);
+    if (backing_scrub_pass(0) != 0) rc = 4;
+    // with no scrubber running, injected damage is verified on the spot
+    if (!rc && (disk_mark_random_bad(2) != 0 || disk_total_bad() != 2 || disk_total_used() != 6)) rc = 5;
+    char* logs = rc ? NULL : disk_get_logs();
+    if (!rc && (!logs || !strstr(logs, "mark_bad: requested=2 corrupted=2 in image") ||
+                !strstr(logs, "mark_bad: requested=2 marked=2"))) rc = 6;
+    free(logs);
+    if (!rc && disk_apply_scrub() != 0) rc = 7;
+    if (!rc && (backing_scrub_pass(0) != 0 || disk_apply_scrub() != 0)) rc = 8;
+    // the background scrubber finds damage on its own
+    if (!rc && backing_scrub_start(64.0 * 1024 * 1024) != 0) rc = 9;
+    int victim = -1;
+    for (int i = 0; i < 8 && victim < 0 && !rc; i++) {
+        if (backing_corrupt(i) == 0) victim = i; // only still-checksummed blocks take it
+    }
+    if (!rc && victim < 0) rc = 10;
+    int applied = 0;
+    for (int waited = 0; !rc && applied == 0 && waited < 3000; waited += 10) {
+        struct timespec ts = { 0, 10 * 1000000L };
+        nanosleep(&ts, NULL);
+        applied = disk_apply_scrub();
+    }
+    if (!rc && (applied != 1 || disk_total_bad() != 3)) rc = 11;
+    BackingInfo info;
+    backing_info(&info);
+    if (!rc && (!info.scrub.running || info.scrub.mismatches != 3 || info.checksummed != 5)) rc = 12;
+    backing_scrub_stop();
+    disk_detach_image();
+    remove(img);
+    disk_reset();
+    return rc;
+}
+
+static int test_seeded_prng() {
+    // xoshiro256** seeded through splitmix64 with 42
+    RandState r;
+    utils_rand_seed(&r, 42);
+    if (utils_rand_next(&r) != 0x15780b2e0c2ec716ull || utils_rand_next(&r) != 0x6104d9866d113a7eull) return 1;
+    int counts[3] = {0, 0, 0};
+    for (int i = 0; i < 30000; i++) counts[utils_rand_below(&r, 3)]++;
+    for (int k = 0; k < 3; k++) if (counts[k] < 9500 || counts[k] > 10500) return 2;
+    for (int i = 0; i < 1000; i++) {
+        int v = utils_rand_range(&r, -5, 5);
+        if (v < -5 || v > 5) return 3;
+    }
+    if (utils_rand_below(&r, 1) != 0 || utils_rand_range(&r, 4, 4) != 4) return 4;
+    // the same seed marks and repairs the same blocks, another one does not
+    static const uint64_t SEEDS[3] = { 1234, 1234, 4321 };
+    char* runs[3];
+    for (int run = 0; run < 3; run++) {
+        disk_reset();
+        disk_seed(SEEDS[run]);
+        disk_mark_random_bad(40);
+        disk_repair();
+        runs[run] = disk_get_state();
+    }
+    int rc = 0;
+    if (!runs[0] || !runs[1] || !runs[2] || disk_get_seed() != 4321) rc = 5;
+    else if (strcmp(runs[0], runs[1]) != 0) rc = 6;
+    else if (strcmp(runs[0], runs[2]) == 0) rc = 7;
+    for (int run = 0; run < 3; run++) free(runs[run]);
+    disk_reset();
+    return rc;
+}
+
 int main() {
     disk_init("test_state.json");
     int fails = 0;
@@ -50,5 +894,106 @@ int main() {
     printf("[test_fragmented_and_defrag] %s (code=%d)\n", r2==0?"PASS":"FAIL", r2);
     fails += (r2 != 0);
 
+    int r3 = test_logs_formatted_on_read();
+    printf("[test_logs_formatted_on_read] %s (code=%d)\n", r3==0?"PASS":"FAIL", r3);
+    fails += (r3 != 0);
+
+    int r4 = test_log_query_cursor_and_filters();
+    printf("[test_log_query_cursor_and_filters] %s (code=%d)\n", r4==0?"PASS":"FAIL", r4);
+    fails += (r4 != 0);
+
+    int r5 = test_mutation_hook_fires();
+    printf("[test_mutation_hook_fires] %s (code=%d)\n", r5==0?"PASS":"FAIL", r5);
+    fails += (r5 != 0);
+
+    int r6 = test_gzip_state_payload();
+    printf("[test_gzip_state_payload] %s (code=%d)\n", r6==0?"PASS":"FAIL", r6);
+    fails += (r6 != 0);
+
+    int r7 = test_http_parser_partial_reads();
+    printf("[test_http_parser_partial_reads] %s (code=%d)\n", r7==0?"PASS":"FAIL", r7);
+    fails += (r7 != 0);
+
+    int r8 = test_router_dispatch();
+    printf("[test_router_dispatch] %s (code=%d)\n", r8==0?"PASS":"FAIL", r8);
+    fails += (r8 != 0);
+
+    int r9 = test_json_extract_one_pass();
+    printf("[test_json_extract_one_pass] %s (code=%d)\n", r9==0?"PASS":"FAIL", r9);
+    fails += (r9 != 0);
+
+    int r10 = test_parallel_int_array();
+    printf("[test_parallel_int_array] %s (code=%d)\n", r10==0?"PASS":"FAIL", r10);
+    fails += (r10 != 0);
+
+    int r11 = test_async_persist_coalesces();
+    printf("[test_async_persist_coalesces] %s (code=%d)\n", r11==0?"PASS":"FAIL", r11);
+    fails += (r11 != 0);
+
+    int r12 = test_durable_write_modes();
+    printf("[test_durable_write_modes] %s (code=%d)\n", r12==0?"PASS":"FAIL", r12);
+    fails += (r12 != 0);
+
+    int r13 = test_incremental_checkpoints();
+    printf("[test_incremental_checkpoints] %s (code=%d)\n", r13==0?"PASS":"FAIL", r13);
+    fails += (r13 != 0);
+
+    int r14 = test_snapshot_checksum_recovery();
+    printf("[test_snapshot_checksum_recovery] %s (code=%d)\n", r14==0?"PASS":"FAIL", r14);
+    fails += (r14 != 0);
+
+    int r15 = test_preallocation_modes();
+    printf("[test_preallocation_modes] %s (code=%d)\n", r15==0?"PASS":"FAIL", r15);
+    fails += (r15 != 0);
+
+    int r16 = test_system_mounts();
+    printf("[test_system_mounts] %s (code=%d)\n", r16==0?"PASS":"FAIL", r16);
+    fails += (r16 != 0);
+
+    int r17 = test_sampler_publishes();
+    printf("[test_sampler_publishes] %s (code=%d)\n", r17==0?"PASS":"FAIL", r17);
+    fails += (r17 != 0);
+
+    int r18 = test_diskstats_rates();
+    printf("[test_diskstats_rates] %s (code=%d)\n", r18==0?"PASS":"FAIL", r18);
+    fails += (r18 != 0);
+
+    int r19 = test_timeseries_rollups();
+    printf("[test_timeseries_rollups] %s (code=%d)\n", r19==0?"PASS":"FAIL", r19);
+    fails += (r19 != 0);
+
+    int r20 = test_forecast_time_to_full();
+    printf("[test_forecast_time_to_full] %s (code=%d)\n", r20==0?"PASS":"FAIL", r20);
+    fails += (r20 != 0);
+
+    int r21 = test_scan_bisects_bad_sectors();
+    printf("[test_scan_bisects_bad_sectors] %s (code=%d)\n", r21==0?"PASS":"FAIL", r21);
+    fails += (r21 != 0);
+
+    int r22 = test_aio_backends();
+    printf("[test_aio_backends] %s (code=%d)\n", r22==0?"PASS":"FAIL", r22);
+    fails += (r22 != 0);
+
+    int r23 = test_backing_image();
+    printf("[test_backing_image] %s (code=%d)\n", r23==0?"PASS":"FAIL", r23);
+    fails += (r23 != 0);
+
+    int r24 = test_block_checksums_and_scrub();
+    printf("[test_block_checksums_and_scrub] %s (code=%d)\n", r24==0?"PASS":"FAIL", r24);
+    fails += (r24 != 0);
+
+    int r25 = test_seeded_prng();
+    printf("[test_seeded_prng] %s (code=%d)\n", r25==0?"PASS":"FAIL", r25);
+    fails += (r25 != 0);
+    int r26 = test_log_seq_survives_reload();
+    printf("[test_log_seq_survives_reload] %s (code=%d)\n", r26==0?"PASS":"FAIL", r26);
+    fails += (r26 != 0);
+    int r27 = test_diskstats_whole_disks();
+    printf("[test_diskstats_whole_disks] %s (code=%d)\n", r27==0?"PASS":"FAIL", r27);
+    fails += (r27 != 0);
+    int r28 = test_read_deadlines();
+    printf("[test_read_deadlines] %s (code=%d)\n", r28==0?"PASS":"FAIL", r28);
+    fails += (r28 != 0);
+
     return fails ? 1 : 0;
 }